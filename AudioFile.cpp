@@ -0,0 +1,377 @@
+//
+// Reads the samples of AU and WAV files, memory-mapped where possible.
+//
+
+#include "AudioFile.hpp"
+#include <algorithm>
+#include <cstring>
+#include <sstream>
+
+#ifdef AUDIO_FILE_MMAP
+#include <sys/mman.h>
+#endif
+
+#if defined(__SSE2__)
+#define AUDIO_FILE_SSE2 1
+#include <emmintrin.h>
+#endif
+
+//
+// The string ".snd" in big-endian byte ordering.  This identifies the file as
+// an AU sound file.
+//
+#define AU_MAGIC 0x2e736e64
+
+//
+// The size of the header of an AU file.
+//
+const int AU_HEADER_SIZE = 24;
+
+//
+// WAV format tags.
+//
+const int WAV_FORMAT_PCM = 1;
+const int WAV_FORMAT_ALAW = 6;
+const int WAV_FORMAT_ULAW = 7;
+const int WAV_FORMAT_EXTENSIBLE = 0xfffe;
+
+//
+// The part of a WAV fmt chunk that is looked at, up to the sub-format of
+// WAVE_FORMAT_EXTENSIBLE.
+//
+const size_t WAV_FMT_MAX_SIZE = 40;
+
+static bool seek_file(FILE *file, uint64_t offset, int origin) {
+#ifdef _WIN32
+  return _fseeki64(file, static_cast<__int64>(offset), origin) == 0;
+#else
+  return fseeko(file, static_cast<off_t>(offset), origin) == 0;
+#endif
+}
+
+static uint64_t tell_file(FILE *file) {
+#ifdef _WIN32
+  return static_cast<uint64_t>(_ftelli64(file));
+#else
+  return static_cast<uint64_t>(ftello(file));
+#endif
+}
+
+static bool host_is_big_endian() {
+  const uint16_t one = 1;
+  uint8_t first;
+  memcpy(&first, &one, 1);
+  return first == 0;
+}
+
+static uint32_t read_be32(const uint8_t *bytes) {
+  return (uint32_t(bytes[0]) << 24) | (uint32_t(bytes[1]) << 16) |
+         (uint32_t(bytes[2]) << 8) | bytes[3];
+}
+
+static uint32_t read_le32(const uint8_t *bytes) {
+  return (uint32_t(bytes[3]) << 24) | (uint32_t(bytes[2]) << 16) |
+         (uint32_t(bytes[1]) << 8) | bytes[0];
+}
+
+static uint16_t read_le16(const uint8_t *bytes) {
+  return static_cast<uint16_t>((bytes[1] << 8) | bytes[0]);
+}
+
+std::string audio_format_tostr(const AudioFormat &format) {
+  static const char *const names[] = {"8-bit PCM", "16-bit PCM", "mu-law",
+                                      "A-law"};
+  std::stringstream ss;
+  ss << names[format.encoding] << ", " << format.sample_rate << "Hz, "
+     << format.channel_count << " channels";
+  return ss.str();
+}
+
+//
+// 16-bit samples of a mono file, which are in the byte order of the host
+// unless swap.
+//
+static void pcm16_to_linear(const uint8_t *data, size_t count, bool swap,
+                            int16_t *samples) {
+  if (!swap) {
+    memcpy(samples, data, count * 2);
+    return;
+  }
+  size_t ii = 0;
+#ifdef AUDIO_FILE_SSE2
+  for (; ii + 8 <= count; ii += 8) {
+    __m128i pair = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data));
+    pair = _mm_or_si128(_mm_slli_epi16(pair, 8), _mm_srli_epi16(pair, 8));
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(samples + ii), pair);
+    data += 16;
+  }
+#endif
+  for (; ii < count; ++ii, data += 2)
+    samples[ii] = static_cast<int16_t>((data[1] << 8) | data[0]);
+}
+
+//
+// 8-bit samples of a mono file, promoted to 16 bits by shifting them left,
+// since the detector won't pick them up otherwise (volume too low).
+//
+static void pcm8_to_linear(const uint8_t *data, size_t count, bool unsigned8,
+                           int16_t *samples) {
+  const uint8_t flip = unsigned8 ? 0x80 : 0;
+  size_t ii = 0;
+#ifdef AUDIO_FILE_SSE2
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i flipv = _mm_set1_epi8(static_cast<char>(flip));
+  for (; ii + 16 <= count; ii += 16) {
+    __m128i bytes = _mm_xor_si128(
+        _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + ii)), flipv);
+    // Interleaving zeros below every byte shifts it into the high half.
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(samples + ii),
+                     _mm_unpacklo_epi8(zero, bytes));
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(samples + ii + 8),
+                     _mm_unpackhi_epi8(zero, bytes));
+  }
+#endif
+  for (; ii < count; ++ii)
+    samples[ii] = static_cast<int16_t>(static_cast<int8_t>(data[ii] ^ flip) *
+                                       256);
+}
+
+bool audio_is_native_linear(const AudioFormat &format) {
+  return format.encoding == AUDIO_PCM16 && format.channel_count == 1 &&
+         format.big_endian == host_is_big_endian();
+}
+
+void audio_to_linear(const AudioFormat &format, const uint8_t *data,
+                     size_t frame_count, int channel, int16_t *samples) {
+  const int stride = audio_frame_bytes(format);
+  data += channel * audio_sample_bytes(format);
+
+  switch (format.encoding) {
+  case AUDIO_PCM16: {
+    bool swap = format.big_endian != host_is_big_endian();
+    if (format.channel_count == 1) {
+      pcm16_to_linear(data, frame_count, swap, samples);
+      break;
+    }
+    int hi = format.big_endian ? 0 : 1;
+    for (size_t ii = 0; ii < frame_count; ++ii, data += stride)
+      samples[ii] = static_cast<int16_t>((data[hi] << 8) | data[1 - hi]);
+    break;
+  }
+  case AUDIO_PCM8: {
+    if (format.channel_count == 1) {
+      pcm8_to_linear(data, frame_count, format.unsigned8, samples);
+      break;
+    }
+    const uint8_t flip = format.unsigned8 ? 0x80 : 0;
+    for (size_t ii = 0; ii < frame_count; ++ii, data += stride)
+      samples[ii] = static_cast<int16_t>(static_cast<int8_t>(*data ^ flip) *
+                                         256);
+    break;
+  }
+  case AUDIO_ULAW:
+  case AUDIO_ALAW: {
+    const int16_t *decode =
+        g711_table(format.encoding == AUDIO_ULAW ? G711_ULAW : G711_ALAW)
+            .samples;
+    for (size_t ii = 0; ii < frame_count; ++ii, data += stride)
+      samples[ii] = decode[*data];
+    break;
+  }
+  }
+}
+
+AudioFile::AudioFile()
+    : file_(nullptr), format_(), frame_count_(0), position_(0),
+      data_offset_(0), map_(nullptr), map_size_(0) {}
+
+AudioFile::~AudioFile() { Close(); }
+
+void AudioFile::Close() {
+#ifdef AUDIO_FILE_MMAP
+  if (map_)
+    munmap(const_cast<uint8_t *>(map_), map_size_);
+#endif
+  map_ = nullptr;
+  map_size_ = 0;
+  if (file_)
+    fclose(file_);
+  file_ = nullptr;
+  frame_count_ = 0;
+  position_ = 0;
+}
+
+bool AudioFile::Fail(const std::string &message) {
+  error_ = message;
+  Close();
+  return false;
+}
+
+bool AudioFile::ReadAt(uint64_t offset, void *data, size_t size) {
+  return seek_file(file_, offset, SEEK_SET) &&
+         fread(data, 1, size, file_) == size;
+}
+
+bool AudioFile::Open(const char *path, bool use_mmap) {
+  Close();
+  error_.clear();
+
+  file_ = fopen(path, "rb");
+  if (!file_)
+    return Fail("unable to open file");
+  if (!seek_file(file_, 0, SEEK_END))
+    return Fail("unable to seek");
+  uint64_t file_size = tell_file(file_);
+
+  uint8_t magic[4];
+  if (!ReadAt(0, magic, sizeof(magic)))
+    return Fail("file too short");
+  bool parsed;
+  if (read_be32(magic) == AU_MAGIC)
+    parsed = ParseAu(file_size);
+  else if (memcmp(magic, "RIFF", 4) == 0)
+    parsed = ParseWav(file_size);
+  else
+    return Fail("not an AU or WAV file");
+  if (!parsed)
+    return false;
+
+#ifdef AUDIO_FILE_MMAP
+  if (use_mmap && file_size > 0) {
+    void *map = mmap(nullptr, file_size, PROT_READ, MAP_PRIVATE,
+                     fileno(file_), 0);
+    if (map != MAP_FAILED) {
+      map_ = static_cast<const uint8_t *>(map);
+      map_size_ = file_size;
+      madvise(map, file_size, MADV_SEQUENTIAL);
+    }
+  }
+#endif
+  if (!map_ && !seek_file(file_, data_offset_, SEEK_SET))
+    return Fail("unable to seek");
+  return true;
+}
+
+bool AudioFile::ParseAu(uint64_t file_size) {
+  // The data in the AU file header is stored in big-endian byte ordering.
+  uint8_t header[AU_HEADER_SIZE];
+  if (!ReadAt(0, header, sizeof(header)))
+    return Fail("truncated AU header");
+  data_offset_ = read_be32(header + 4);
+  uint64_t data_size = read_be32(header + 8);
+  uint32_t encoding = read_be32(header + 12);
+
+  format_.sample_rate = static_cast<int>(read_be32(header + 16));
+  format_.channel_count = static_cast<int>(read_be32(header + 20));
+  format_.unsigned8 = false;
+  format_.big_endian = true;
+  switch (encoding) {
+  case 1:
+    format_.encoding = AUDIO_ULAW;
+    break;
+  case 2:
+    format_.encoding = AUDIO_PCM8;
+    break;
+  case 3:
+    format_.encoding = AUDIO_PCM16;
+    break;
+  case 27:
+    format_.encoding = AUDIO_ALAW;
+    break;
+  default: {
+    std::stringstream ss;
+    ss << "unsupported AU encoding " << encoding;
+    return Fail(ss.str());
+  }
+  }
+  if (format_.channel_count < 1 || data_offset_ > file_size)
+    return Fail("bad AU header");
+
+  // A data size of ~0 means "unknown", i.e. up to the end of the file.
+  data_size = std::min(data_size, file_size - data_offset_);
+  frame_count_ = data_size / audio_frame_bytes(format_);
+  return true;
+}
+
+bool AudioFile::ParseWav(uint64_t file_size) {
+  // The data in the WAV file header is stored in little-endian byte
+  // ordering, in chunks of an id and a size.
+  uint8_t riff[12];
+  if (!ReadAt(0, riff, sizeof(riff)) || memcmp(riff + 8, "WAVE", 4) != 0)
+    return Fail("not a WAVE file");
+
+  bool have_format = false;
+  uint64_t offset = sizeof(riff);
+  for (;;) {
+    uint8_t chunk[8];
+    if (offset + sizeof(chunk) > file_size || !ReadAt(offset, chunk, 8))
+      return Fail(have_format ? "no data chunk" : "no fmt chunk");
+    uint64_t size = read_le32(chunk + 4);
+    offset += sizeof(chunk);
+
+    if (memcmp(chunk, "fmt ", 4) == 0) {
+      uint8_t fmt[WAV_FMT_MAX_SIZE] = {0};
+      size_t fmt_size = std::min<uint64_t>(size, sizeof(fmt));
+      if (fmt_size < 16 || !ReadAt(offset, fmt, fmt_size))
+        return Fail("bad fmt chunk");
+      int tag = read_le16(fmt);
+      // WAVE_FORMAT_EXTENSIBLE keeps the real tag at the start of the
+      // sub-format GUID.
+      if (tag == WAV_FORMAT_EXTENSIBLE && fmt_size >= 26)
+        tag = read_le16(fmt + 24);
+      format_.channel_count = read_le16(fmt + 2);
+      format_.sample_rate = static_cast<int>(read_le32(fmt + 4));
+      int bits = read_le16(fmt + 14);
+      format_.unsigned8 = true;
+      format_.big_endian = false;
+      if (tag == WAV_FORMAT_PCM && bits == 8)
+        format_.encoding = AUDIO_PCM8;
+      else if (tag == WAV_FORMAT_PCM && bits == 16)
+        format_.encoding = AUDIO_PCM16;
+      else if (tag == WAV_FORMAT_ULAW && bits == 8)
+        format_.encoding = AUDIO_ULAW;
+      else if (tag == WAV_FORMAT_ALAW && bits == 8)
+        format_.encoding = AUDIO_ALAW;
+      else {
+        std::stringstream ss;
+        ss << "unsupported WAV format " << tag << " with " << bits
+           << " bits per sample";
+        return Fail(ss.str());
+      }
+      if (format_.channel_count < 1)
+        return Fail("bad fmt chunk");
+      have_format = true;
+    } else if (memcmp(chunk, "data", 4) == 0) {
+      if (!have_format)
+        return Fail("data chunk before fmt chunk");
+      data_offset_ = offset;
+      // Streaming writers leave the size at 0 or ~0 until they are done.
+      if (size == 0 || size == 0xffffffff)
+        size = file_size - offset;
+      frame_count_ = std::min(size, file_size - offset) /
+                     audio_frame_bytes(format_);
+      return true;
+    }
+
+    // Chunks are padded to an even size.
+    offset += size + (size & 1);
+  }
+}
+
+size_t AudioFile::Next(size_t max_frames, const uint8_t **data) {
+  size_t count = static_cast<size_t>(
+      std::min<uint64_t>(max_frames, frame_count_ - position_));
+  if (count == 0)
+    return 0;
+  size_t frame_bytes = audio_frame_bytes(format_);
+
+  if (map_) {
+    *data = map_ + data_offset_ + position_ * frame_bytes;
+  } else {
+    buffer_.resize(count * frame_bytes);
+    count = fread(&buffer_[0], frame_bytes, count, file_);
+    *data = &buffer_[0];
+  }
+  position_ += count;
+  return count;
+}
@@ -0,0 +1,124 @@
+//
+// Reads the samples of AU and WAV files, memory-mapped where possible.
+//
+
+#ifndef AUDIO_FILE
+#define AUDIO_FILE
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+#include "G711.hpp"
+
+#if defined(__unix__) || defined(__APPLE__)
+#define AUDIO_FILE_MMAP 1
+#endif
+
+enum AudioEncoding {
+  // 8-bit linear PCM, signed in AU files and unsigned in WAV files.
+  AUDIO_PCM8,
+  // 16-bit linear PCM, big-endian in AU files and little-endian in WAV
+  // files.
+  AUDIO_PCM16,
+  // G.711.
+  AUDIO_ULAW,
+  AUDIO_ALAW
+};
+
+struct AudioFormat {
+  AudioEncoding encoding;
+  int sample_rate;
+  int channel_count;
+  // 8-bit samples are unsigned, with 128 for silence.
+  bool unsigned8;
+  // 16-bit samples are big-endian.
+  bool big_endian;
+};
+
+// The bytes of one sample in format.
+inline int audio_sample_bytes(const AudioFormat &format) {
+  return format.encoding == AUDIO_PCM16 ? 2 : 1;
+}
+
+// The bytes of one frame, one sample per channel, in format.
+inline int audio_frame_bytes(const AudioFormat &format) {
+  return audio_sample_bytes(format) * format.channel_count;
+}
+
+// "PCM16, 8000Hz, 1 channel" and the like.
+std::string audio_format_tostr(const AudioFormat &format);
+
+// Whether the data of a file in format already is mono 16-bit samples in the
+// byte order of the host, so that it can be detected in place.
+bool audio_is_native_linear(const AudioFormat &format);
+
+// Converts frame_count frames of data, in format, to the linear samples of
+// channel.  Byte swapping and 8-bit promotion of mono files are vectorized.
+void audio_to_linear(const AudioFormat &format, const uint8_t *data,
+                     size_t frame_count, int channel, int16_t *samples);
+
+// An AU or WAV file, read front to back a block at a time.  The data is
+// memory-mapped on POSIX systems, so that a block is a pointer into the
+// mapping; otherwise, or if mapping fails (e.g. for a pipe), it is read into
+// an internal buffer in large blocks.
+class AudioFile {
+public:
+  AudioFile();
+  ~AudioFile();
+
+  AudioFile(const AudioFile &) = delete;
+  AudioFile &operator=(const AudioFile &) = delete;
+
+  // Returns false, with a description in error(), if the file cannot be read
+  // or is not an AU or WAV file in one of the AudioEncodings.  With
+  // use_mmap false, the file is always read into a buffer.
+  bool Open(const char *path, bool use_mmap = true);
+
+  void Close();
+
+  const AudioFormat &format() const { return format_; }
+
+  // The number of frames in the file.
+  uint64_t frame_count() const { return frame_count_; }
+
+  // The number of frames already returned by Next.
+  uint64_t position() const { return position_; }
+
+  // Whether the data is memory-mapped.
+  bool mapped() const { return map_ != nullptr; }
+
+  const std::string &error() const { return error_; }
+
+  // Points *data at the next frames, up to max_frames of them, and returns
+  // how many that is: 0 at the end of the file, or on a read error.  *data
+  // stays valid until the next call.
+  size_t Next(size_t max_frames, const uint8_t **data);
+
+private:
+  FILE *file_;
+  AudioFormat format_;
+  uint64_t frame_count_;
+  uint64_t position_;
+
+  // The offset of the first sample in the file.
+  uint64_t data_offset_;
+
+  // The whole file, when mapped.
+  const uint8_t *map_;
+  size_t map_size_;
+
+  // The block returned by Next, when not mapped.
+  std::vector<uint8_t> buffer_;
+
+  std::string error_;
+
+  bool ReadAt(uint64_t offset, void *data, size_t size);
+  bool ParseAu(uint64_t file_size);
+  bool ParseWav(uint64_t file_size);
+  bool Fail(const std::string &message);
+};
+
+#endif
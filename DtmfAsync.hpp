@@ -0,0 +1,237 @@
+//
+// Awaitable detectors and generators for event loops built on C++20
+// coroutines.  Unlike the rest of the library, which is C++17, this header
+// needs a C++20 compiler; it is header-only, so only the translation units
+// that include it need to be built as C++20.
+//
+
+#ifndef DTMF_ASYNC
+#define DTMF_ASYNC
+
+#if !defined(__cpp_impl_coroutine) || __cpp_impl_coroutine < 201902L
+#error "DtmfAsync.hpp needs C++20 coroutines"
+#endif
+
+#include <algorithm>
+#include <cassert>
+#include <coroutine>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include "DtmfDetector.hpp"
+#include "DtmfGenerator.hpp"
+#include "DtmfSampleRing.hpp"
+
+// Resumes the coroutines waiting on the detectors and generators attached to
+// it, all of them at once from Tick, which the event loop calls once per
+// frame period (e.g. from a 20 ms timer).  A Tick:
+//
+// 1. drains every attached DtmfSampleRing into its detector, for streams
+//    whose samples are captured on other threads;
+// 2. resumes every coroutine waiting for the next frame of a generator;
+// 3. resumes every coroutine waiting for a digit that has been detected,
+//    including digits detected by the coroutines resumed during the tick.
+//
+// Detectors never resume a coroutine from inside Detect, so nothing runs
+// while a detector is half-way through a batch.  The scheduler, and
+// everything attached to it, belongs to the event loop thread.
+class DtmfAsyncScheduler {
+public:
+  DtmfAsyncScheduler() {}
+
+  DtmfAsyncScheduler(const DtmfAsyncScheduler &) = delete;
+  DtmfAsyncScheduler &operator=(const DtmfAsyncScheduler &) = delete;
+
+  // The ring is drained on every Tick until it is detached.
+  void Attach(DtmfSampleRing *ring) { rings_.push_back(ring); }
+  void Detach(DtmfSampleRing *ring) {
+    rings_.erase(std::remove(rings_.begin(), rings_.end(), ring),
+                 rings_.end());
+  }
+
+  void Tick() {
+    ++ticks_;
+    for (DtmfSampleRing *ring : rings_)
+      ring->Drain();
+
+    // Coroutines that wait for a frame again are left for the next tick.
+    resuming_.swap(frame_waiters_);
+    for (std::coroutine_handle<> waiter : resuming_)
+      waiter.resume();
+    resuming_.clear();
+
+    while (!ready_.empty()) {
+      resuming_.swap(ready_);
+      for (std::coroutine_handle<> waiter : resuming_)
+        waiter.resume();
+      resuming_.clear();
+    }
+  }
+
+  // The number of calls to Tick so far.
+  uint64_t ticks() const { return ticks_; }
+
+  // The coroutines waiting for a frame or a digit.
+  size_t pending() const { return frame_waiters_.size() + ready_.size(); }
+
+  // For the awaitables below.
+  void WaitForFrame(std::coroutine_handle<> waiter) {
+    frame_waiters_.push_back(waiter);
+  }
+  void Ready(std::coroutine_handle<> waiter) { ready_.push_back(waiter); }
+
+private:
+  std::vector<DtmfSampleRing *> rings_;
+  std::vector<std::coroutine_handle<>> frame_waiters_;
+  std::vector<std::coroutine_handle<>> ready_;
+  std::vector<std::coroutine_handle<>> resuming_;
+  uint64_t ticks_ = 0;
+};
+
+// A detector whose digits are awaited: co_await detector.next_digit() gives
+// the next digit as soon as its first batch is detected, or '\0' once the
+// detector is closed and every digit has been taken.  Feed it with Detect,
+// or through a DtmfSampleRing attached to the scheduler.  One coroutine at a
+// time may wait on it, and the detector must outlive the wait.
+template <int SampleRate = DTMF_BASE_SAMPLE_RATE,
+          DtmfBackend Backend = DTMF_BACKEND_FIXED>
+class DtmfAsyncDetector : public DtmfDetectorBase {
+public:
+  explicit DtmfAsyncDetector(
+      DtmfAsyncScheduler *scheduler,
+      const DtmfDetectorConfig &config = DtmfDetectorConfig())
+      : DtmfDetectorBase(DtmfRate<SampleRate>::tables, DTMF_STRADDLE_STAGE,
+                         Backend, config),
+        scheduler_(scheduler) {}
+
+  class DigitAwaiter {
+  public:
+    explicit DigitAwaiter(DtmfAsyncDetector *detector) : detector_(detector) {}
+
+    bool await_ready() const { return detector_->digit_ready(); }
+    void await_suspend(std::coroutine_handle<> waiter) {
+      assert(!detector_->waiter_);
+      detector_->waiter_ = waiter;
+    }
+    char await_resume() { return detector_->TakeDigit(); }
+
+  private:
+    DtmfAsyncDetector *detector_;
+  };
+
+  DigitAwaiter next_digit() { return DigitAwaiter(this); }
+
+  // The digits detected but not taken yet.
+  int pending_digits() const {
+    return static_cast<int>(digits_.size() - next_digit_);
+  }
+
+  // Ends the tone in progress, if any, and wakes the waiting coroutine on the
+  // next Tick once the digits are all taken.
+  void Close() {
+    Flush();
+    closed_ = true;
+    Wake();
+  }
+
+private:
+  DtmfAsyncScheduler *scheduler_;
+  std::coroutine_handle<> waiter_;
+  // The digits detected, the first next_digit_ of them taken.
+  std::string digits_;
+  size_t next_digit_ = 0;
+  bool closed_ = false;
+
+  bool digit_ready() const { return pending_digits() > 0 || closed_; }
+
+  char TakeDigit() {
+    if (pending_digits() == 0)
+      return '\0';
+    char dial_char = digits_[next_digit_++];
+    if (next_digit_ == digits_.size()) {
+      digits_.clear();
+      next_digit_ = 0;
+    }
+    return dial_char;
+  }
+
+  void Wake() {
+    if (waiter_) {
+      scheduler_->Ready(waiter_);
+      waiter_ = nullptr;
+    }
+  }
+
+  void OnNewTone(char dial_char) override {
+    digits_ += dial_char;
+    Wake();
+  }
+};
+
+// What a DtmfAsyncGenerator gives for a frame.
+struct DtmfAsyncFrame {
+  // frame_size samples, valid until the next frame is awaited.
+  const int16_t *samples;
+  int sample_count;
+  // How many of the samples came from queued digits; the rest are silence.
+  int tone_samples;
+};
+
+// An 8 kHz generator whose frames are awaited: co_await
+// generator.next_frame() suspends until the next Tick of the scheduler, and
+// then gives the next frame_size samples of the queued digits (silence once
+// there are none), so a coroutine that sends each frame as it gets it paces
+// itself to the scheduler.  Digits can be queued from any thread, as with
+// DtmfStreamGenerator, up to queue_capacity of them.  One coroutine at a
+// time may wait on it, and the generator must outlive the wait.
+class DtmfAsyncGenerator {
+public:
+  DtmfAsyncGenerator(DtmfAsyncScheduler *scheduler, int frame_size,
+                     int32_t DurationPush = 70, int32_t DurationPause = 50,
+                     const DtmfToneTemplates *templates = nullptr,
+                     size_t queue_capacity = 256)
+      : scheduler_(scheduler),
+        generator_(DurationPush, DurationPause, templates, queue_capacity),
+        frame_(frame_size) {
+    assert(frame_size > 0);
+  }
+
+  DtmfStreamGenerator &generator() { return generator_; }
+
+  class FrameAwaiter {
+  public:
+    explicit FrameAwaiter(DtmfAsyncGenerator *generator)
+        : generator_(generator) {}
+
+    bool await_ready() const { return false; }
+    void await_suspend(std::coroutine_handle<> waiter) {
+      generator_->scheduler_->WaitForFrame(waiter);
+    }
+    DtmfAsyncFrame await_resume() { return generator_->NextFrame(); }
+
+  private:
+    DtmfAsyncGenerator *generator_;
+  };
+
+  FrameAwaiter next_frame() { return FrameAwaiter(this); }
+
+  // True while a digit or its pause is being generated or more are queued.
+  bool busy() const { return generator_.busy(); }
+
+private:
+  DtmfAsyncScheduler *scheduler_;
+  DtmfStreamGenerator generator_;
+  std::vector<int16_t> frame_;
+
+  DtmfAsyncFrame NextFrame() {
+    DtmfAsyncFrame frame;
+    frame.samples = frame_.data();
+    frame.sample_count = static_cast<int>(frame_.size());
+    frame.tone_samples =
+        static_cast<int>(generator_.Generate(frame_.data(), frame_.size()));
+    return frame;
+  }
+};
+
+#endif
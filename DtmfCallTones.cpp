@@ -0,0 +1,307 @@
+//
+// Call-progress and fax tone detection, see DtmfCallTones.hpp.
+//
+
+#include "DtmfCallTones.hpp"
+#include "Goertzel.hpp"
+#include <algorithm>
+
+// The frequencies of each bank, in Hz.
+static const double PROGRESS_FREQUENCIES[] = {350, 440, 480, 620};
+static const double FAX_FREQUENCIES[] = {1100, 2100};
+
+static const int PROGRESS_BANK = 0;
+static const int FAX_BANK = 1;
+
+// The kinds of block of the call-progress bank, by the pair of frequencies
+// they hold, and of the fax bank.
+enum { PROGRESS_DIAL = 1, PROGRESS_RINGBACK, PROGRESS_BUSY };
+enum { FAX_CALLING = 1, FAX_ANSWER };
+
+// Blocks whose mean square is below this, about -44 dBm0, hold no tone.
+const double CALL_TONE_MIN_POWER = 10000;
+// The least share of the energy of a block its tone must have, both
+// frequencies together for the dual tones.
+const double CALL_TONE_MIN_SHARE = 0.5;
+// The least share of each frequency of a dual tone.
+const double CALL_TONE_MIN_PAIR_SHARE = 0.1;
+
+// The longest silence within the cadence of each bank's tones, in ms: the
+// 4 s off of ringback, the 3 s off of CNG, with room to spare.
+static const int MAX_GAP_MS[DTMF_CALL_TONE_BANK_COUNT] = {6000, 4500};
+
+static bool within(int Value, int Min, int Max) {
+  return Value >= Min && Value <= Max;
+}
+
+// The tone whose cadence lasts Ms, as the on or off time of 480 + 620 Hz, or
+// -1 for neither.
+static int busy_cadence(int Ms) {
+  if (within(Ms, 350, 700))
+    return DTMF_CALL_TONE_BUSY;
+  if (within(Ms, 150, 349))
+    return DTMF_CALL_TONE_REORDER;
+  return -1;
+}
+
+DtmfCallToneTracker::DtmfCallToneTracker(const DtmfRateTables &tables,
+                                         unsigned banks)
+    : sample_rate_(tables.sample_rate),
+      block_size_(BLOCK_BATCHES * tables.batch_size),
+      batch_size_(tables.batch_size),
+      banks_(banks & (DTMF_CALL_TONES_PROGRESS | DTMF_CALL_TONES_FAX)),
+      koeff_count_(0) {
+  if (banks_)
+    block_samples_.resize(block_size_);
+  first_koeff_[PROGRESS_BANK] = koeff_count_;
+  if (banks_ & DTMF_CALL_TONES_PROGRESS)
+    for (double frequency : PROGRESS_FREQUENCIES)
+      koeffs_[koeff_count_++] = dtmf_detail::koeff(frequency, sample_rate_);
+  first_koeff_[FAX_BANK] = koeff_count_;
+  if (banks_ & DTMF_CALL_TONES_FAX)
+    for (double frequency : FAX_FREQUENCIES)
+      koeffs_[koeff_count_++] = dtmf_detail::koeff(frequency, sample_rate_);
+  Reset();
+}
+
+void DtmfCallToneTracker::Reset() {
+  std::fill(batch_energy_, batch_energy_ + BLOCK_BATCHES, 0);
+  block_pos_ = 0;
+  block_start_ = 0;
+  for (Cadence &cadence : cadence_) {
+    cadence = Cadence();
+    cadence.reported = -1;
+  }
+}
+
+size_t DtmfCallToneTracker::Advance(const int16_t *samples, size_t count,
+                                    DtmfCallToneEvent events[],
+                                    int *event_count) {
+  *event_count = 0;
+  size_t used = std::min<size_t>(count, block_size_ - block_pos_);
+
+  // The energy of each batch of the block, for the level check and ANSam.
+  for (size_t done = 0; done < used;) {
+    size_t pos = block_pos_ + done;
+    size_t batch = pos / batch_size_;
+    size_t span = std::min(used - done, (batch + 1) * batch_size_ - pos);
+    int64_t Energy = 0;
+    for (size_t ii = done; ii < done + span; ++ii) {
+      int32_t sample32 = samples[ii];
+      Energy += sample32 * sample32;
+    }
+    batch_energy_[batch] += Energy;
+    done += span;
+  }
+
+  std::copy(samples, samples + used, &block_samples_[block_pos_]);
+  block_pos_ += static_cast<int>(used);
+  if (block_pos_ == block_size_)
+    EndBlock(events, event_count);
+  return used;
+}
+
+void DtmfCallToneTracker::EndBlock(DtmfCallToneEvent events[],
+                                   int *event_count) {
+  int64_t Energy = 0;
+  for (int64_t batch_energy : batch_energy_)
+    Energy += batch_energy;
+
+  int kinds[DTMF_CALL_TONE_BANK_COUNT] = {0};
+  if (Energy >= CALL_TONE_MIN_POWER * block_size_) {
+    float Vk1[MAX_KOEFFS] = {0}, Vk2[MAX_KOEFFS] = {0};
+    goertzel_advance_float(koeffs_, koeff_count_, &block_samples_[0],
+                           block_size_, Vk1, Vk2);
+
+    // The share of the energy at each frequency: a sine of amplitude A
+    // on N samples has N * A**2 / 2 of energy and a Goertzel magnitude of
+    // (N * A / 2)**2, whatever its phase.
+    const double Scale = 2.0 / (static_cast<double>(block_size_) * Energy);
+    double Share[MAX_KOEFFS];
+    for (int kk = 0; kk < koeff_count_; ++kk) {
+      double Prev = Vk1[kk], PrevPrev = Vk2[kk];
+      Share[kk] = Scale * (Prev * Prev + PrevPrev * PrevPrev -
+                           koeffs_[kk] / 16384.0 * Prev * PrevPrev);
+    }
+    if (banks_ & DTMF_CALL_TONES_PROGRESS)
+      kinds[PROGRESS_BANK] =
+          ClassifyProgress(Share + first_koeff_[PROGRESS_BANK]);
+    if (banks_ & DTMF_CALL_TONES_FAX)
+      kinds[FAX_BANK] = ClassifyFax(Share + first_koeff_[FAX_BANK]);
+  }
+
+  for (int bank = 0; bank < DTMF_CALL_TONE_BANK_COUNT; ++bank)
+    if (banks_ & (1u << bank))
+      Step(bank, kinds[bank], events, event_count);
+
+  std::fill(batch_energy_, batch_energy_ + BLOCK_BATCHES, 0);
+  block_pos_ = 0;
+  block_start_ += block_size_;
+}
+
+// The two strongest frequencies must hold most of the energy, with neither
+// of them weak and nothing close to the weaker one.
+int DtmfCallToneTracker::ClassifyProgress(const double Share[]) const {
+  int First = 0, Second = -1;
+  for (int kk = 1; kk < 4; ++kk)
+    if (Share[kk] > Share[First])
+      First = kk;
+  for (int kk = 0; kk < 4; ++kk)
+    if (kk != First && (Second < 0 || Share[kk] > Share[Second]))
+      Second = kk;
+  double Third = 0;
+  for (int kk = 0; kk < 4; ++kk)
+    if (kk != First && kk != Second)
+      Third = std::max(Third, Share[kk]);
+
+  if (Share[First] + Share[Second] < CALL_TONE_MIN_SHARE ||
+      Share[Second] < CALL_TONE_MIN_PAIR_SHARE || Third > Share[Second] / 2)
+    return 0;
+
+  switch ((1 << First) | (1 << Second)) {
+  case 0x3: // 350 + 440 Hz
+    return PROGRESS_DIAL;
+  case 0x6: // 440 + 480 Hz
+    return PROGRESS_RINGBACK;
+  case 0xc: // 480 + 620 Hz
+    return PROGRESS_BUSY;
+  default:
+    return 0;
+  }
+}
+
+int DtmfCallToneTracker::ClassifyFax(const double Share[]) const {
+  if (Share[0] >= CALL_TONE_MIN_SHARE)
+    return FAX_CALLING;
+  if (Share[1] >= CALL_TONE_MIN_SHARE)
+    return FAX_ANSWER;
+  return 0;
+}
+
+// Follows the on and off segments of a bank from block to block.  An on
+// segment is a run of blocks of the same kind; it bridges a single block
+// without it, and ends with the last block of its kind.
+void DtmfCallToneTracker::Step(int bank, int kind, DtmfCallToneEvent events[],
+                               int *event_count) {
+  Cadence *cadence = &cadence_[bank];
+  const uint64_t block_end = block_start_ + block_size_;
+  uint64_t start = block_start_;
+
+  if (cadence->kind != 0) {
+    if (kind == cadence->kind) {
+      cadence->missed = 0;
+      cadence->on_end = block_end;
+      TrackOn(bank, cadence, events, event_count);
+      return;
+    }
+    if (cadence->missed == 0) {
+      cadence->missed = 1;
+      return;
+    }
+    // Whatever comes next starts with the bridged block.
+    start = cadence->on_end;
+    EndOn(bank, cadence, events, event_count);
+  }
+
+  if (kind != 0) {
+    cadence->kind = kind;
+    cadence->missed = 0;
+    cadence->on_start = start;
+    cadence->on_end = block_end;
+    cadence->lasting = false;
+    cadence->quiet = -1;
+    cadence->loud = -1;
+  }
+}
+
+// A block of the current on segment, from its second on.
+void DtmfCallToneTracker::TrackOn(int bank, Cadence *cadence,
+                                  DtmfCallToneEvent events[],
+                                  int *event_count) {
+  if (!cadence->lasting) {
+    cadence->lasting = true;
+    // The segment starts a new run unless it carries on the cadence of the
+    // one before.
+    if (cadence->kind != cadence->prev_kind ||
+        Milliseconds(cadence->on_start - cadence->off_start) >
+            MAX_GAP_MS[bank]) {
+      cadence->reported = -1;
+      cadence->prev_kind = 0;
+    }
+  }
+
+  const int on_ms = Milliseconds(cadence->on_end - cadence->on_start);
+  if (bank == PROGRESS_BANK) {
+    if (cadence->kind == PROGRESS_DIAL && on_ms >= 1000)
+      Report(cadence, DTMF_CALL_TONE_DIAL, cadence->on_start, cadence->on_end,
+             events, event_count);
+  } else if (cadence->kind == FAX_ANSWER &&
+             cadence->reported != DTMF_CALL_TONE_CED &&
+             cadence->reported != DTMF_CALL_TONE_ANSAM) {
+    // ANSam swings between 0.8 and 1.2 of its mean amplitude 15 times a
+    // second, so its batches differ in energy by up to 2.25 times; CED's
+    // hardly do.  Which of the two it is is settled once, as the block where
+    // the tone stops would look modulated.
+    for (int64_t batch_energy : batch_energy_) {
+      if (cadence->quiet < 0 || batch_energy < cadence->quiet)
+        cadence->quiet = batch_energy;
+      cadence->loud = std::max(cadence->loud, batch_energy);
+    }
+    if (on_ms >= 500) {
+      bool modulated = cadence->loud * 10 > cadence->quiet * 13;
+      Report(cadence, modulated ? DTMF_CALL_TONE_ANSAM : DTMF_CALL_TONE_CED,
+             cadence->on_start, cadence->on_end, events, event_count);
+    }
+  }
+}
+
+// The current on segment has ended with its last block.
+void DtmfCallToneTracker::EndOn(int bank, Cadence *cadence,
+                                DtmfCallToneEvent events[],
+                                int *event_count) {
+  const int kind = cadence->kind;
+  cadence->kind = 0;
+  // A single block is noise; the off segment before it goes on.
+  if (!cadence->lasting)
+    return;
+
+  const int on_ms = Milliseconds(cadence->on_end - cadence->on_start);
+  if (bank == PROGRESS_BANK) {
+    if (kind == PROGRESS_RINGBACK && within(on_ms, 700, 2600))
+      Report(cadence, DTMF_CALL_TONE_RINGBACK, cadence->on_start,
+             cadence->on_end, events, event_count);
+    // Busy and reorder need a whole cycle, on, off and on, at their rate.
+    int tone = busy_cadence(on_ms);
+    if (kind == PROGRESS_BUSY && tone >= 0 &&
+        cadence->prev_kind == PROGRESS_BUSY &&
+        busy_cadence(Milliseconds(cadence->prev_end -
+                                  cadence->prev_start)) == tone &&
+        busy_cadence(Milliseconds(cadence->on_start - cadence->prev_end)) ==
+            tone)
+      Report(cadence, static_cast<DtmfCallTone>(tone), cadence->prev_start,
+             cadence->on_end, events, event_count);
+  } else if (kind == FAX_CALLING && within(on_ms, 350, 800)) {
+    Report(cadence, DTMF_CALL_TONE_CNG, cadence->on_start, cadence->on_end,
+           events, event_count);
+  }
+
+  cadence->prev_kind = kind;
+  cadence->prev_start = cadence->on_start;
+  cadence->prev_end = cadence->on_end;
+  cadence->off_start = cadence->on_end;
+}
+
+void DtmfCallToneTracker::Report(Cadence *cadence, DtmfCallTone tone,
+                                 uint64_t start, uint64_t end,
+                                 DtmfCallToneEvent events[],
+                                 int *event_count) {
+  if (cadence->reported == tone)
+    return;
+  cadence->reported = tone;
+  events[(*event_count)++] = DtmfCallToneEvent{tone, start, end};
+}
+
+int DtmfCallToneTracker::Milliseconds(uint64_t samples) const {
+  return static_cast<int>(
+      std::min<uint64_t>(samples * 1000 / sample_rate_, INT32_MAX));
+}
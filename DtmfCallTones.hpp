@@ -0,0 +1,151 @@
+//
+// Call-progress and fax tone detection, run by DtmfDetectorBase next to the
+// DTMF decision.
+//
+
+#ifndef DTMF_CALL_TONES
+#define DTMF_CALL_TONES
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+#include "DtmfRateTables.hpp"
+
+// The groups of tones DtmfDetectorBase::EnableCallTones can look for, or-ed
+// together.  A group that is not enabled costs nothing.
+enum DtmfCallToneBank {
+  // Dial tone, ringback, busy and reorder: 350, 440, 480 and 620 Hz, as in
+  // the North American precise tone plan.
+  DTMF_CALL_TONES_PROGRESS = 1 << 0,
+  // The fax calling tone, CNG (1100 Hz), and the answer tones, CED and
+  // ANSam (2100 Hz).
+  DTMF_CALL_TONES_FAX = 1 << 1
+};
+
+const int DTMF_CALL_TONE_BANK_COUNT = 2;
+
+enum DtmfCallTone {
+  // 350 + 440 Hz, steady for a second.
+  DTMF_CALL_TONE_DIAL,
+  // 440 + 480 Hz, on for 0.7 to 2.6 s.
+  DTMF_CALL_TONE_RINGBACK,
+  // 480 + 620 Hz, 0.5 s on and 0.5 s off, twice.
+  DTMF_CALL_TONE_BUSY,
+  // 480 + 620 Hz, 0.25 s on and 0.25 s off, twice.
+  DTMF_CALL_TONE_REORDER,
+  // 1100 Hz, on for about 0.5 s.
+  DTMF_CALL_TONE_CNG,
+  // 2100 Hz, steady for 0.5 s.
+  DTMF_CALL_TONE_CED,
+  // 2100 Hz amplitude-modulated at 15 Hz (ANSam, V.8), steady for 0.5 s.
+  DTMF_CALL_TONE_ANSAM
+};
+
+// A call tone, reported once when it is recognized; a tone that goes on, or
+// repeats its cadence, is not reported again until something else has been
+// heard or it has stopped for a while.  Sample offsets count as in
+// DtmfToneEvent, and are accurate to a block (see DtmfCallToneTracker).
+struct DtmfCallToneEvent {
+  DtmfCallTone tone;
+  // The first sample of the tone, or of the first cycle of its cadence.
+  uint64_t start_sample;
+  // The end of the block the tone was recognized in.
+  uint64_t end_sample;
+};
+
+// Looks for the tones of the enabled banks in a stream of samples.
+//
+// 440 and 480 Hz are only 40 Hz apart, which a 12.75 ms batch cannot tell
+// apart, so the tones are decided over blocks of BLOCK_BATCHES batches,
+// 51 ms.  The samples of a block are kept until it is complete.  A block too
+// quiet to hold a tone is classified from its energy alone; the others run
+// through the Goertzel recurrences of the enabled frequencies in one go, on
+// the float kernels of DTMF_BACKEND_FLOAT (goertzel_advance_float).  A block
+// is classified by the share of its energy at each frequency, and the
+// cadence of the classified blocks decides the tone.
+class DtmfCallToneTracker {
+public:
+  static const int BLOCK_BATCHES = 4;
+
+  DtmfCallToneTracker(const DtmfRateTables &tables, unsigned banks);
+
+  unsigned banks() const { return banks_; }
+
+  // Runs up to count samples, stopping at the end of a block, and returns
+  // how many were used.  The tones recognized at the end of the block are
+  // stored to events, which must hold DTMF_CALL_TONE_BANK_COUNT of them, and
+  // their number to event_count.
+  size_t Advance(const int16_t *samples, size_t count,
+                 DtmfCallToneEvent events[], int *event_count);
+
+  // Forgets everything; sample offsets start from 0 again.
+  void Reset();
+
+private:
+  // The frequencies of both banks, the enabled ones in koeffs_.
+  static const int MAX_KOEFFS = 6;
+
+  // Where a bank is in the cadence of its tones.  A kind is a class of
+  // blocks: which of the bank's frequencies a block holds, 0 for none.
+  struct Cadence {
+    // The kind of the current on segment, 0 while off.
+    int kind;
+    // Blocks in a row without kind, at most one, which the segment bridges
+    // (e.g. the phase reversals of an answer tone).
+    int missed;
+    // The current on segment, while kind is set.
+    uint64_t on_start;
+    uint64_t on_end;
+    // Whether the current on segment has lasted a second block; shorter ones
+    // are dropped as noise.
+    bool lasting;
+    // Where the current off segment started: the end of the last on segment
+    // that was not dropped.
+    uint64_t off_start;
+    // That on segment, for the tones that need two cycles.
+    int prev_kind;
+    uint64_t prev_start;
+    uint64_t prev_end;
+    // The tone reported for the current run of segments, or -1.
+    int reported;
+    // The smallest and largest batch energy of the on segment, from its
+    // second block on, for telling ANSam from CED.
+    int64_t quiet;
+    int64_t loud;
+  };
+
+  int ClassifyProgress(const double Share[]) const;
+  int ClassifyFax(const double Share[]) const;
+  void EndBlock(DtmfCallToneEvent events[], int *event_count);
+  void Step(int bank, int kind, DtmfCallToneEvent events[], int *event_count);
+  void TrackOn(int bank, Cadence *cadence, DtmfCallToneEvent events[],
+               int *event_count);
+  void EndOn(int bank, Cadence *cadence, DtmfCallToneEvent events[],
+             int *event_count);
+  void Report(Cadence *cadence, DtmfCallTone tone, uint64_t start,
+              uint64_t end, DtmfCallToneEvent events[], int *event_count);
+  int Milliseconds(uint64_t samples) const;
+
+  int sample_rate_;
+  int block_size_;
+  int batch_size_;
+  unsigned banks_;
+
+  int16_t koeffs_[MAX_KOEFFS];
+  int koeff_count_;
+  // The index in koeffs_ of the first frequency of each enabled bank.
+  int first_koeff_[DTMF_CALL_TONE_BANK_COUNT];
+
+  // The block in progress: its samples, the energy of each of its batches,
+  // the samples seen and where it started.  No samples are kept while no
+  // bank is enabled.
+  std::vector<int16_t> block_samples_;
+  int64_t batch_energy_[BLOCK_BATCHES];
+  int block_pos_;
+  uint64_t block_start_;
+
+  Cadence cadence_[DTMF_CALL_TONE_BANK_COUNT];
+};
+
+#endif
@@ -0,0 +1,88 @@
+//
+// The parts of the DTMF detection algorithm that DtmfDetectorBase and
+// DtmfDetectorBank share.  This header is internal to the library.
+//
+
+#ifndef DTMF_DETECTION
+#define DTMF_DETECTION
+
+#include <stdint.h>
+
+#include "DtmfDetector.hpp"
+
+// These coefficients include the 8 DTMF frequencies plus 10 harmonics.
+const unsigned COEFF_NUMBER = 18;
+
+// The DTMF frequencies themselves come first in CONSTANTS.
+const unsigned DTMF_FREQUENCY_NUMBER = 8;
+
+// The Goertzel coefficients, see DtmfDetector.cpp.
+extern const int16_t CONSTANTS[COEFF_NUMBER];
+
+// Batches whose average magnitude is below this are treated as silence, with
+// the default thresholds (DTMF_PROFILE_DEFAULT).
+extern const int32_t powerThreshold;
+
+// The number of left shifts that normalize L_var1, see DtmfDetector.cpp.
+int16_t norm_l(int32_t L_var1);
+
+// The number of bits a batch is shifted left by during normalization: the
+// smallest norm_l over its non-zero samples, minus 16.
+//
+// norm_l(x) == norm_l(~x) for negative x and norm_l only grows as its
+// operand shrinks, so the smallest norm_l belongs to the largest
+// x ^ (x >> 31), Peak, and a single count-leading-zeros finds it.  AbsSum,
+// the sum of the sample magnitudes, tells an all-zero batch (Dial stays 32)
+// from one that only holds zeros and -1s (norm_l(-1) == 31).
+inline int32_t DTMF_normalization_shift(int32_t AbsSum, int32_t Peak) {
+  int32_t Dial;
+  if (Peak == 0) {
+    Dial = AbsSum ? 31 : 32;
+  } else {
+#if defined(__GNUC__) || defined(__clang__)
+    Dial = __builtin_clz(static_cast<uint32_t>(Peak)) - 1;
+#else
+    Dial = norm_l(Peak);
+#endif
+  }
+  return Dial - 16;
+}
+
+// The decision for a single batch is made in two stages, so that the
+// magnitudes of the last COEFF_NUMBER - DTMF_FREQUENCY_NUMBER frequencies
+// only need to be computed for batches that pass the first one.
+//
+// Both stages decide with the default thresholds; DtmfDetectorBase compiles
+// its own for the other profiles.
+//
+// DTMF_check_dial_tones looks at the DTMF_FREQUENCY_NUMBER DTMF frequencies
+// only.  Returns false if the batch holds no tone, and stores the check that
+// failed to Reason unless it is null; otherwise finds the max row (Row) and
+// max column (Column) frequencies.
+bool DTMF_check_dial_tones(const int32_t T[], int32_t *Row, int32_t *Column,
+                           DtmfRejectReason *Reason = nullptr);
+
+// DTMF_check_harmonics needs all COEFF_NUMBER magnitudes and the Row and
+// Column found by the first stage.  Returns the tone, or ' ' if there is
+// none, with Reason as in DTMF_check_dial_tones.
+//
+// Neither stage divides: the ratio checks multiply and compare instead, bin
+// by bin without branches, and the tone is looked up from Row and Column.
+char DTMF_check_harmonics(const int32_t T[], int32_t Row, int32_t Column,
+                          DtmfRejectReason *Reason = nullptr);
+
+// DTMF_check_dial_tones for COUNT channels at once, whose magnitudes are laid
+// out as goertzel_filter_channels writes them: frequency kk of channel jj at
+// Magnitudes[kk * LANES + jj].  Passed[jj] tells whether channel jj passed,
+// and if so Row[jj] and Column[jj] are its max row and max column.  The
+// channels are checked in SIMD lanes where the CPU has them.
+void DTMF_check_dial_tones_lanes(const int32_t Magnitudes[], uint32_t LANES,
+                                 uint32_t COUNT, int32_t Row[],
+                                 int32_t Column[], bool Passed[]);
+
+// Sums the magnitudes of COUNT samples, and finds the largest
+// sample ^ (sample >> 31) among them, for DTMF_normalization_shift.
+void DTMF_batch_magnitudes(const int16_t Samples[], int COUNT,
+                           int32_t *AbsSum, int32_t *Peak);
+
+#endif
@@ -0,0 +1,347 @@
+//
+// DTMF detection for many independent streams, sharded across worker threads.
+//
+
+#include "DtmfDetectionService.hpp"
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+// The life of a stream slot.  OpenStream moves it from FREE to OPEN and
+// CloseStream from OPEN to CLOSING; its worker moves it back to FREE once
+// the stream is done with.
+enum {
+  STREAM_FREE,
+  STREAM_OPEN,
+  STREAM_CLOSING
+};
+
+// Sends the events of a stream to the event queue of the worker that owns
+// the stream.
+class DtmfDetectionService::StreamDetector : public DtmfDetectorBase {
+public:
+  StreamDetector(const DtmfServiceConfig &config, int stream)
+      : DtmfDetectorBase(config.tables, config.straddle_mode, config.backend,
+                         config.detector),
+        stream_(stream), worker_(nullptr) {}
+
+  void set_worker(Worker *worker) { worker_ = worker; }
+
+private:
+  int stream_;
+  Worker *worker_;
+
+  void OnToneEvent(const DtmfToneEvent &tone) override;
+};
+
+struct DtmfDetectionService::Stream {
+  explicit Stream(int queue_samples)
+      : samples(queue_samples), state(STREAM_FREE), migrate_to(-1),
+        samples_detected(0), worker(-1), samples_at_rebalance(0) {}
+
+  // From the producer to the worker.
+  SpscRing<int16_t> samples;
+
+  // Only used by the worker that owns the stream, and replaced by
+  // OpenStream while the slot is free.
+  std::unique_ptr<StreamDetector> detector;
+
+  std::atomic<int> state;
+
+  // The worker the stream is to be moved to, or -1.  Set by Rebalance, and
+  // taken by the worker that owns the stream.
+  std::atomic<int> migrate_to;
+
+  // Written by the worker that owns the stream.
+  std::atomic<uint64_t> samples_detected;
+
+  // Bookkeeping of the control side, under control_mutex_: the worker the
+  // stream belongs to, or is on its way to, and samples_detected as of the
+  // last Rebalance.
+  int worker;
+  uint64_t samples_at_rebalance;
+};
+
+struct DtmfDetectionService::Worker {
+  explicit Worker(int event_queue_size)
+      : events(event_queue_size), dropped_events(0), stop(false),
+        stream_count(0) {}
+
+  std::thread thread;
+
+  // The streams the worker owns.  Only locked by the worker once per sweep,
+  // and by the control side when a stream is added.
+  std::mutex streams_mutex;
+  std::vector<int> streams;
+
+  // From the worker to PollEvent.
+  SpscRing<DtmfStreamEvent> events;
+  std::atomic<uint64_t> dropped_events;
+
+  std::atomic<bool> stop;
+
+  // The number of open streams that belong to the worker, under
+  // control_mutex_.
+  int stream_count;
+};
+
+void DtmfDetectionService::StreamDetector::OnToneEvent(
+    const DtmfToneEvent &tone) {
+  DtmfStreamEvent event = {stream_, tone};
+  if (!worker_->events.Push(event))
+    worker_->dropped_events.fetch_add(1, std::memory_order_relaxed);
+}
+
+DtmfDetectionService::DtmfDetectionService(const DtmfServiceConfig &config)
+    : config_(config), poll_worker_(0) {
+  assert(config.max_streams > 0);
+  int worker_count = config.worker_count;
+  if (worker_count <= 0)
+    worker_count = std::max(1u, std::thread::hardware_concurrency());
+
+  streams_.reserve(config.max_streams);
+  for (int ii = 0; ii < config.max_streams; ++ii)
+    streams_.emplace_back(new Stream(config.stream_queue_samples));
+
+  workers_.reserve(worker_count);
+  for (int ii = 0; ii < worker_count; ++ii)
+    workers_.emplace_back(new Worker(config.event_queue_size));
+  for (int ii = 0; ii < worker_count; ++ii) {
+    Worker *worker = workers_[ii].get();
+    worker->thread = std::thread(&DtmfDetectionService::Run, this, worker);
+#ifdef __linux__
+    if (!config.cpus.empty()) {
+      cpu_set_t cpus;
+      CPU_ZERO(&cpus);
+      CPU_SET(config.cpus[ii % config.cpus.size()], &cpus);
+      pthread_setaffinity_np(worker->thread.native_handle(), sizeof(cpus),
+                             &cpus);
+    }
+#endif
+  }
+}
+
+DtmfDetectionService::~DtmfDetectionService() {
+  for (auto &worker : workers_)
+    worker->stop.store(true, std::memory_order_release);
+  for (auto &worker : workers_)
+    worker->thread.join();
+}
+
+int DtmfDetectionService::OpenStream() {
+  std::lock_guard<std::mutex> lock(control_mutex_);
+
+  int id = 0;
+  while (id < config_.max_streams &&
+         streams_[id]->state.load(std::memory_order_acquire) != STREAM_FREE)
+    ++id;
+  if (id == config_.max_streams)
+    return -1;
+
+  // Nobody else looks at a free slot, and the worker's mutex below publishes
+  // the new state to it.
+  Stream *stream = streams_[id].get();
+  stream->samples.Clear();
+  stream->detector.reset(new StreamDetector(config_, id));
+  stream->state.store(STREAM_OPEN, std::memory_order_relaxed);
+  stream->migrate_to.store(-1, std::memory_order_relaxed);
+  stream->samples_detected.store(0, std::memory_order_relaxed);
+  stream->samples_at_rebalance = 0;
+
+  stream->worker = PickWorker();
+  Worker *worker = workers_[stream->worker].get();
+  ++worker->stream_count;
+  stream->detector->set_worker(worker);
+
+  std::lock_guard<std::mutex> worker_lock(worker->streams_mutex);
+  worker->streams.push_back(id);
+  return id;
+}
+
+int DtmfDetectionService::Push(int stream, const int16_t *samples,
+                               int sample_count) {
+  assert(stream >= 0 && stream < config_.max_streams);
+  return static_cast<int>(
+      streams_[stream]->samples.Write(samples, sample_count));
+}
+
+void DtmfDetectionService::CloseStream(int stream) {
+  assert(stream >= 0 && stream < config_.max_streams);
+  std::lock_guard<std::mutex> lock(control_mutex_);
+  Stream *closing = streams_[stream].get();
+  assert(closing->state.load(std::memory_order_relaxed) == STREAM_OPEN);
+
+  --workers_[closing->worker]->stream_count;
+  closing->state.store(STREAM_CLOSING, std::memory_order_release);
+
+  if (config_.rebalance_on_close)
+    RebalanceLocked();
+}
+
+bool DtmfDetectionService::PollEvent(DtmfStreamEvent *event) {
+  // Start from a different worker every time, so that a busy worker cannot
+  // hold back the events of the others.
+  int count = worker_count();
+  for (int ii = 0; ii < count; ++ii) {
+    Worker *worker = workers_[(poll_worker_ + ii) % count].get();
+    if (worker->events.Pop(event)) {
+      poll_worker_ = (poll_worker_ + ii + 1) % count;
+      return true;
+    }
+  }
+  return false;
+}
+
+void DtmfDetectionService::Rebalance() {
+  std::lock_guard<std::mutex> lock(control_mutex_);
+  RebalanceLocked();
+}
+
+uint64_t DtmfDetectionService::dropped_events() const {
+  uint64_t dropped = 0;
+  for (auto &worker : workers_)
+    dropped += worker->dropped_events.load(std::memory_order_relaxed);
+  return dropped;
+}
+
+int DtmfDetectionService::PickWorker() const {
+  int best = 0;
+  for (int ii = 1; ii < worker_count(); ++ii)
+    if (workers_[ii]->stream_count < workers_[best]->stream_count)
+      best = ii;
+  return best;
+}
+
+void DtmfDetectionService::RebalanceLocked() {
+  // The load of every open stream, and of every worker.
+  std::vector<int> open;
+  std::vector<uint64_t> stream_load(streams_.size());
+  std::vector<uint64_t> worker_load(workers_.size());
+  for (int id = 0; id < config_.max_streams; ++id) {
+    Stream *stream = streams_[id].get();
+    if (stream->state.load(std::memory_order_relaxed) != STREAM_OPEN)
+      continue;
+    uint64_t detected =
+        stream->samples_detected.load(std::memory_order_relaxed);
+    if (config_.balance_policy == DTMF_BALANCE_FEWEST_SAMPLES)
+      stream_load[id] = detected - stream->samples_at_rebalance;
+    else
+      stream_load[id] = 1;
+    stream->samples_at_rebalance = detected;
+    worker_load[stream->worker] += stream_load[id];
+    open.push_back(id);
+  }
+
+  // Move a stream from the busiest worker to the idlest one for as long as
+  // that brings them closer together.  Every move makes the loads strictly
+  // more even, so this ends.
+  for (;;) {
+    auto busiest = std::max_element(worker_load.begin(), worker_load.end()) -
+                   worker_load.begin();
+    auto idlest = std::min_element(worker_load.begin(), worker_load.end()) -
+                  worker_load.begin();
+    uint64_t gap = worker_load[busiest] - worker_load[idlest];
+
+    // The best stream to move is the one closest to half the gap; any
+    // stream with a load between 0 and the gap, exclusive, helps.
+    int best = -1;
+    uint64_t best_miss = gap;
+    for (int id : open) {
+      Stream *stream = streams_[id].get();
+      uint64_t load = stream_load[id];
+      if (stream->worker != busiest || load == 0 || load >= gap)
+        continue;
+      uint64_t miss = load * 2 > gap ? load * 2 - gap : gap - load * 2;
+      if (miss < best_miss) {
+        best = id;
+        best_miss = miss;
+      }
+    }
+    if (best < 0)
+      break;
+
+    Stream *stream = streams_[best].get();
+    worker_load[busiest] -= stream_load[best];
+    worker_load[idlest] += stream_load[best];
+    --workers_[busiest]->stream_count;
+    ++workers_[idlest]->stream_count;
+    stream->worker = static_cast<int>(idlest);
+    stream->migrate_to.store(static_cast<int>(idlest),
+                             std::memory_order_release);
+  }
+}
+
+// Detects over whatever the producer has queued, and returns false if that
+// was nothing.  At most two contiguous pieces are taken, so that a stream
+// that never stops cannot hold up the others.
+bool DtmfDetectionService::ServeStream(Stream *stream) {
+  bool served = false;
+  for (int piece = 0; piece < 2; ++piece) {
+    const int16_t *samples;
+    size_t count = stream->samples.Peek(&samples);
+    if (count == 0)
+      break;
+    stream->detector->Detect(samples, static_cast<int>(count));
+    stream->samples.Consume(count);
+    stream->samples_detected.fetch_add(count, std::memory_order_relaxed);
+    served = true;
+  }
+  return served;
+}
+
+void DtmfDetectionService::Run(Worker *worker) {
+  // Streams leaving this worker, and where to.
+  std::vector<std::pair<int, int>> leaving;
+
+  while (!worker->stop.load(std::memory_order_acquire)) {
+    bool busy = false;
+    {
+      std::lock_guard<std::mutex> lock(worker->streams_mutex);
+      std::vector<int> &streams = worker->streams;
+      for (size_t ii = 0; ii < streams.size();) {
+        int id = streams[ii];
+        Stream *stream = streams_[id].get();
+        busy |= ServeStream(stream);
+
+        int target = stream->migrate_to.exchange(-1, std::memory_order_acquire);
+        if (target >= 0) {
+          streams[ii] = streams.back();
+          streams.pop_back();
+          leaving.push_back(std::make_pair(id, target));
+          continue;
+        }
+
+        if (stream->state.load(std::memory_order_acquire) == STREAM_CLOSING) {
+          // The producer is done, so this gets every sample it pushed.
+          while (ServeStream(stream))
+            ;
+          stream->detector->Flush();
+          streams[ii] = streams.back();
+          streams.pop_back();
+          stream->state.store(STREAM_FREE, std::memory_order_release);
+          continue;
+        }
+        ++ii;
+      }
+    }
+
+    // Hand the leaving streams over without holding our own lock, so that
+    // two workers swapping streams cannot deadlock.
+    for (auto &move : leaving) {
+      Worker *target = workers_[move.second].get();
+      std::lock_guard<std::mutex> lock(target->streams_mutex);
+      streams_[move.first]->detector->set_worker(target);
+      target->streams.push_back(move.first);
+    }
+    leaving.clear();
+
+    if (!busy)
+      std::this_thread::sleep_for(
+          std::chrono::microseconds(config_.idle_wait_us));
+  }
+}
@@ -0,0 +1,135 @@
+//
+// DTMF detection for many independent streams, sharded across worker threads.
+//
+
+#ifndef DTMF_DETECTION_SERVICE
+#define DTMF_DETECTION_SERVICE
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <stdint.h>
+#include <thread>
+#include <vector>
+
+#include "DtmfDetector.hpp"
+#include "SpscRing.hpp"
+
+// What DtmfDetectionService::Rebalance evens out between the workers.  New
+// streams always go to the worker with the fewest open streams, as they have
+// no history yet.
+enum DtmfBalancePolicy {
+  // The number of open streams.
+  DTMF_BALANCE_FEWEST_STREAMS,
+  // The number of samples detected since the last call to Rebalance, for
+  // streams that carry very different amounts of audio.
+  DTMF_BALANCE_FEWEST_SAMPLES
+};
+
+struct DtmfServiceConfig {
+  // The number of worker threads.  0 means one per hardware thread.
+  int worker_count = 0;
+  // The CPUs the workers are pinned to, worker i to cpus[i % cpus.size()].
+  // Left empty, the workers are not pinned.  Only supported on Linux.
+  std::vector<int> cpus;
+  // The maximum number of streams open at once.
+  int max_streams = 256;
+  // The samples each stream can queue before Push drops them, rounded up to
+  // a power of two.
+  int stream_queue_samples = 8192;
+  // The events each worker can queue before they are dropped, rounded up to
+  // a power of two.
+  int event_queue_size = 1024;
+  // How long a worker that found no samples waits before it looks again.
+  int idle_wait_us = 200;
+  DtmfBalancePolicy balance_policy = DTMF_BALANCE_FEWEST_STREAMS;
+  // Call Rebalance whenever a stream is closed.
+  bool rebalance_on_close = true;
+  // The sample rate of every stream, see DtmfRate.
+  DtmfRateTables tables = DtmfRate<DTMF_BASE_SAMPLE_RATE>::tables;
+  DtmfStraddleMode straddle_mode = DTMF_STRADDLE_STAGE;
+  DtmfBackend backend = DTMF_BACKEND_FIXED;
+  // The thresholds every stream is decided with.
+  DtmfDetectorConfig detector;
+};
+
+// A tone found in one of the streams of a DtmfDetectionService.
+struct DtmfStreamEvent {
+  int stream;
+  DtmfToneEvent tone;
+};
+
+// Runs a detector per stream on a fixed set of worker threads.  Every stream
+// belongs to exactly one worker at a time, so a detector is never shared
+// between threads and the workers never wait on each other.
+//
+// Samples go from the producer of a stream to its worker through a
+// lock-free single-producer single-consumer queue, and events come back
+// through one such queue per worker, so neither path takes a lock.  Locks are
+// only taken when streams are opened, closed or moved between workers.
+//
+// Thread safety: OpenStream, CloseStream and Rebalance may be called from any
+// thread.  Push must only be called by one thread per stream at a time, and
+// PollEvent by one thread at a time.
+//
+// The events of a stream come back in order, unless Rebalance moved the
+// stream while one of them was still queued; DtmfToneEvent::start_sample
+// tells them apart.
+class DtmfDetectionService {
+public:
+  explicit DtmfDetectionService(const DtmfServiceConfig &config);
+
+  // Stops the workers.  Tones still in progress are not reported.
+  ~DtmfDetectionService();
+
+  DtmfDetectionService(const DtmfDetectionService &) = delete;
+  DtmfDetectionService &operator=(const DtmfDetectionService &) = delete;
+
+  int worker_count() const { return static_cast<int>(workers_.size()); }
+
+  // Returns the id of a new stream, or -1 if config.max_streams are open.
+  int OpenStream();
+
+  // Queues sample_count samples of stream for detection, and returns how
+  // many of them fit; the rest are dropped.
+  int Push(int stream, const int16_t *samples, int sample_count);
+
+  // Call once the last Push for stream has returned.  The worker reports the
+  // tone in progress, if any, once the samples pushed so far have been
+  // detected, and then frees the stream id.
+  void CloseStream(int stream);
+
+  // Returns false if no event is queued.
+  bool PollEvent(DtmfStreamEvent *event);
+
+  // Moves streams from the busiest workers to the idlest ones, according to
+  // config.balance_policy, until no move would improve the balance.
+  void Rebalance();
+
+  // The events dropped because a worker's event queue was full.
+  uint64_t dropped_events() const;
+
+private:
+  class StreamDetector;
+  struct Stream;
+  struct Worker;
+
+  DtmfServiceConfig config_;
+
+  std::vector<std::unique_ptr<Stream>> streams_;
+  std::vector<std::unique_ptr<Worker>> workers_;
+
+  // Serializes OpenStream, CloseStream and Rebalance, and guards the
+  // bookkeeping they share: stream_count and the worker of each stream.
+  std::mutex control_mutex_;
+
+  // The worker PollEvent looks at first.
+  int poll_worker_;
+
+  void Run(Worker *worker);
+  bool ServeStream(Stream *stream);
+  int PickWorker() const;
+  void RebalanceLocked();
+};
+
+#endif
@@ -6,80 +6,101 @@
  */
 
 #include "DtmfDetector.hpp"
+#include "DtmfDetection.hpp"
+#include "DtmfThreadPool.hpp"
+#include "Goertzel.hpp"
 #include <algorithm>
 #include <cassert>
+#include <cstdlib>
+#include <functional>
+
+#if defined(__SSE2__) && !defined(DTMF_NO_SIMD)
+#define DTMF_SSE2 1
+#include <emmintrin.h>
+#endif
 
 #if DEBUG
 #include <cstdio>
 #endif
 
-// This is the same function as in DtmfGenerator.cpp
-static inline int32_t MPY48SR(int16_t o16, int32_t o32) {
-  uint32_t Temp0;
-  int32_t Temp1;
-  Temp0 = (((uint16_t)o32 * o16) + 0x4000) >> 15;
-  Temp1 = (int16_t)(o32 >> 16) * o16;
-  return (Temp1 << 1) + Temp0;
+#ifndef DTMF_NO_STATS
+#define DTMF_STATS 1
+#if (defined(__GNUC__) || defined(__clang__)) &&                              \
+    (defined(__x86_64__) || defined(__i386__))
+#define DTMF_STATS_TSC 1
+#include <x86intrin.h>
+#else
+#include <chrono>
+#endif
+#endif
+
+bool dtmf_stats_enabled() {
+#ifdef DTMF_STATS
+  return true;
+#else
+  return false;
+#endif
 }
 
-// The Goertzel algorithm.
-// For a good description and walkthrough, see:
-// https://sites.google.com/site/hobbydebraj/home/goertzel-algorithm-dtmf-detection
-//
-// Koeff0           Coefficient for the first frequency.
-// Koeff1           Coefficient for the second frequency.
-// arraySamples     Input samples to process.  Must be COUNT elements long.
-// Magnitude0       Detected magnitude of the first frequency.
-// Magnitude1       Detected magnitude of the second frequency.
-// COUNT            The number of elements in arraySamples.  Always equal to
-//                  DTMF_DETECTION_BATCH_SIZE in practice.
-static void goertzel_filter(int16_t Koeff0, int16_t Koeff1,
-                            const int16_t arraySamples[], int32_t *Magnitude0,
-                            int32_t *Magnitude1, uint32_t COUNT) {
-  int32_t Temp0, Temp1;
-  uint16_t ii;
-  // Vk1_0    prev (first frequency)
-  // Vk2_0    prev_prev (first frequency)
-  //
-  // Vk1_1    prev (second frequency)
-  // Vk2_0    prev_prev (second frequency)
-  int32_t Vk1_0 = 0, Vk2_0 = 0, Vk1_1 = 0, Vk2_1 = 0;
-
-  // Iterate over all the input samples
-  // For each sample, process the two frequencies we're interested in:
-  // output = Input + 2*coeff*prev - prev_prev
-  // N.B. bit-shifting to the left achieves the multiplication by 2.
-  for (ii = 0; ii < COUNT; ++ii) {
-    Temp0 = MPY48SR(Koeff0, Vk1_0 << 1) - Vk2_0 + arraySamples[ii],
-    Temp1 = MPY48SR(Koeff1, Vk1_1 << 1) - Vk2_1 + arraySamples[ii];
-    Vk2_0 = Vk1_0, Vk2_1 = Vk1_1;
-    Vk1_0 = Temp0, Vk1_1 = Temp1;
-  }
-
-  // Magnitude: prev_prev**prev_prev + prev*prev - coeff*prev*prev_prev
-
-  // TODO: what does shifting by 10 bits to the right achieve?  Probably to
-  // make room for the magnitude calculations.
-  Vk1_0 >>= 10, Vk1_1 >>= 10, Vk2_0 >>= 10, Vk2_1 >>= 10;
-  Temp0 = MPY48SR(Koeff0, Vk1_0 << 1), Temp1 = MPY48SR(Koeff1, Vk1_1 << 1);
-  Temp0 = (int16_t)Temp0 * (int16_t)Vk2_0,
-  Temp1 = (int16_t)Temp1 * (int16_t)Vk2_1;
-  Temp0 =
-      (int16_t)Vk1_0 * (int16_t)Vk1_0 + (int16_t)Vk2_0 * (int16_t)Vk2_0 - Temp0;
-  Temp1 =
-      (int16_t)Vk1_1 * (int16_t)Vk1_1 + (int16_t)Vk2_1 * (int16_t)Vk2_1 - Temp1;
-  *Magnitude0 = Temp0, *Magnitude1 = Temp1;
-  return;
+// The clock batch timing is measured with, see DtmfDetectorStats.  Always 0
+// without DTMF_STATS, so that the timing compiles out.
+static inline uint64_t stats_ticks() {
+#if defined(DTMF_STATS_TSC)
+  return __rdtsc();
+#elif defined(DTMF_STATS)
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+#else
+  return 0;
+#endif
+}
+
+// Counts a batch whose decision took Ticks in the histogram.
+static inline void count_ticks(DtmfDetectorStats *stats, uint64_t Ticks) {
+#ifdef DTMF_STATS
+  int Bucket = 0;
+  while (Ticks > 1 && Bucket < DTMF_STATS_TICK_BUCKETS - 1) {
+    Ticks >>= 1;
+    ++Bucket;
+  }
+  ++stats->batch_ticks[Bucket];
+#endif
+}
+
+// Counts a batch whose decision started at Start in the histogram, unless
+// the silence check silenced it, which Silent, the silent batches counted
+// before, tells.
+static inline void count_batch_ticks(DtmfDetectorStats *stats, uint64_t Start,
+                                     uint64_t Silent) {
+#ifdef DTMF_STATS
+  if (stats->stages.silent == Silent)
+    count_ticks(stats, stats_ticks() - Start);
+#endif
+}
+
+// Counts a batch silenced by the noise gate alone.
+static inline void count_noise_gated(DtmfDetectorStats *stats) {
+#ifdef DTMF_STATS
+  ++stats->noise_gated;
+#endif
+}
+
+// Counts a batch rejected by the decision.
+static inline void count_rejection(DtmfDetectorStats *stats,
+                                   DtmfRejectReason Reason) {
+#ifdef DTMF_STATS
+  if (Reason < DTMF_REJECT_REASON_COUNT)
+    ++stats->rejected[Reason];
+#endif
 }
 
-// This is a GSM function, for concrete processors she may be replaced
-// for same processor's optimized function (norm_l)
 // This is a GSM function, for concrete processors she may be replaced
 // for same processor's optimized function (norm_l)
 //
 // This function is used for normalization. TODO: how exactly does it work?
 // Result is highest non-zero bit position
-static inline int16_t norm_l(int32_t L_var1) {
+int16_t norm_l(int32_t L_var1) {
   int16_t var_out;
 
   if (L_var1 == 0) {
@@ -101,9 +122,6 @@ static inline int16_t norm_l(int32_t L_var1) {
   return (var_out);
 }
 
-// These coefficients include the 8 DTMF frequencies plus 10 harmonics.
-static const unsigned COEFF_NUMBER = 18;
-
 // These frequencies are slightly different to what is in the generator.
 // More importantly, they are also different to what is described at:
 // http://en.wikipedia.org/wiki/Dual-tone_multi-frequency_signaling
@@ -115,7 +133,7 @@ static const unsigned COEFF_NUMBER = 18;
 // It seems this is done to simplify harmonic detection.
 //
 // A fixed-size array to hold the coefficients
-const int16_t CONSTANTS[COEFF_NUMBER] = {
+constexpr int16_t CONSTANTS[COEFF_NUMBER] = {
     27860, // 0: 706Hz, harmonics include: 78Hz, 235Hz, 3592Hz
     26745, // 1: 784Hz, apparently a high G, harmonics: 78Hz
     25529, // 2: 863Hz, harmonics: 78Hz
@@ -169,152 +187,1367 @@ const int16_t CONSTANTS[COEFF_NUMBER] = {
     -30555  // 3529Hz, 3*1176Hz, 5*706Hz
 };
 
-const int32_t powerThreshold = 328;
-const int32_t dialTonesToOhersTones = 16;
-const int32_t dialTonesToOhersDialTones = 6;
+// The 8 kHz table generated at compile time must be exactly CONSTANTS, so
+// that detection at 8 kHz is unchanged.
+static constexpr bool matches_constants(const DtmfRateTables &Tables) {
+  for (unsigned ii = 0; ii < COEFF_NUMBER; ++ii)
+    if (Tables.koeffs[ii] != CONSTANTS[ii])
+      return false;
+  return Tables.batch_size == DTMF_DETECTION_BATCH_SIZE &&
+         Tables.magnitude_shift == GOERTZEL_MAGNITUDE_SHIFT;
+}
+static_assert(matches_constants(DtmfRate<8000>::tables),
+              "the 8 kHz tables must match CONSTANTS");
+
+// The thresholds of each DtmfProfile but DTMF_PROFILE_CUSTOM.
+static constexpr DtmfDetectorConfig PRESETS[DTMF_PROFILE_CUSTOM] = {
+    // DTMF_PROFILE_DEFAULT
+    {328, 6, 16, 64, 96},
+    // DTMF_PROFILE_Q24: 4 dB is 102/256, 8 dB 41/256.
+    {328, 6, 16, 102, 41},
+    // DTMF_PROFILE_MOBILE: 10 dB is 26/256.
+    {164, 4, 12, 26, 26},
+    // DTMF_PROFILE_TALK_OFF: 3 dB is 128/256.
+    {328, 8, 32, 102, 128},
+};
+
+const int32_t powerThreshold = PRESETS[DTMF_PROFILE_DEFAULT].power_threshold;
+
+DtmfDetectorConfig DtmfDetectorConfig::Preset(DtmfProfile profile) {
+  return profile < DTMF_PROFILE_CUSTOM ? PRESETS[profile]
+                                       : PRESETS[DTMF_PROFILE_DEFAULT];
+}
+
+DtmfProfile DtmfDetectorConfig::profile() const {
+  for (int ii = 0; ii < DTMF_PROFILE_CUSTOM; ++ii) {
+    const DtmfDetectorConfig &preset = PRESETS[ii];
+    if (power_threshold == preset.power_threshold &&
+        dial_tone_ratio == preset.dial_tone_ratio &&
+        harmonic_ratio == preset.harmonic_ratio &&
+        twist_limit == preset.twist_limit &&
+        reverse_twist_limit == preset.reverse_twist_limit)
+      return static_cast<DtmfProfile>(ii);
+  }
+  return DTMF_PROFILE_CUSTOM;
+}
+
+// Strong scaled by Limit 256ths, the least the weaker group of a tone may be.
+static inline int32_t twist_scale(int32_t Strong, int32_t Limit) {
+  return static_cast<int32_t>((static_cast<int64_t>(Strong) * Limit) >> 8);
+}
 
-static char DTMF_detection(const int16_t short_array_samples[]);
+// The thresholds the decision is compiled for.  The detection functions below
+// are templates on one of these: DtmfPresetRules has the thresholds of a
+// preset as constants, and DtmfConfigRules reads those of any config.
+template <DtmfProfile Profile> struct DtmfPresetRules {
+  DtmfPresetRules() {}
+  explicit DtmfPresetRules(const DtmfDetectorConfig &) {}
+
+  int32_t power_threshold() const { return PRESETS[Profile].power_threshold; }
+  int32_t dial_tone_ratio() const { return PRESETS[Profile].dial_tone_ratio; }
+  int32_t harmonic_ratio() const { return PRESETS[Profile].harmonic_ratio; }
+
+  // True if the row is too weak next to the column (normal twist).  The
+  // original detector's shifts are kept, so that the default preset decides
+  // bit for bit as it did.
+  bool row_too_weak(int32_t Row, int32_t Column) const {
+    if (Profile == DTMF_PROFILE_DEFAULT)
+      return Row < (Column >> 2);
+    return Row < twist_scale(Column, PRESETS[Profile].twist_limit);
+  }
+
+  // True if the column is too weak next to the row (reverse twist).
+  bool column_too_weak(int32_t Row, int32_t Column) const {
+    if (Profile == DTMF_PROFILE_DEFAULT)
+      return Column < ((Row >> 1) - (Row >> 3));
+    return Column < twist_scale(Row, PRESETS[Profile].reverse_twist_limit);
+  }
+};
+
+struct DtmfConfigRules {
+  explicit DtmfConfigRules(const DtmfDetectorConfig &config)
+      : config_(config) {}
+
+  int32_t power_threshold() const { return config_.power_threshold; }
+  int32_t dial_tone_ratio() const { return config_.dial_tone_ratio; }
+  int32_t harmonic_ratio() const { return config_.harmonic_ratio; }
+
+  bool row_too_weak(int32_t Row, int32_t Column) const {
+    return Row < twist_scale(Column, config_.twist_limit);
+  }
+
+  bool column_too_weak(int32_t Row, int32_t Column) const {
+    return Column < twist_scale(Row, config_.reverse_twist_limit);
+  }
+
+  const DtmfDetectorConfig &config_;
+};
+
+typedef DtmfPresetRules<DTMF_PROFILE_DEFAULT> DtmfDefaultRules;
+
+template <class Rules>
+static char DTMF_detection(const DtmfRateTables &Tables, DtmfBackend Backend,
+                           const DtmfDetectorConfig &Config,
+                           const int16_t short_array_samples[],
+                           DtmfDetectorStats *stats, int32_t *RowEnergy,
+                           int32_t *ColumnEnergy);
+template <class Rules>
+static char DTMF_g711_detection(const DtmfRateTables &Tables,
+                                DtmfBackend Backend,
+                                const DtmfDetectorConfig &Config,
+                                const uint8_t g711_codes[],
+                                const int16_t Decode[],
+                                DtmfDetectorStats *stats,
+                                int32_t *RowEnergy, int32_t *ColumnEnergy);
+template <class Rules>
+static char DTMF_carried_detection(const DtmfRateTables &Tables,
+                                   const DtmfDetectorConfig &Config,
+                                   int32_t AbsSum, int32_t Peak,
+                                   float Vk1[], float Vk2[],
+                                   const int16_t Tail[], int TailCount,
+                                   DtmfDetectorStats *stats,
+                                   int32_t *RowEnergy, int32_t *ColumnEnergy);
+
+// The window of a sliding detector, as the hops it is made of, see
+// DtmfDetectorBase::hop_sums_.
+struct DtmfWindowHops {
+  const int16_t *koeffs;
+  // The samples of each hop, hop_size apiece, in ring order.
+  const int16_t *samples;
+  int hop_size;
+  // The ring index of the oldest hop, and the number of hops.
+  int oldest;
+  int count;
+  uint8_t *filtered;
+  float *vk1;
+  float *vk2;
+  const double *propagators;
+};
+
+template <class Rules>
+static char DTMF_window_detection(const DtmfRateTables &Tables,
+                                  const DtmfDetectorConfig &Config,
+                                  int32_t AbsSum, int32_t Peak,
+                                  const DtmfWindowHops &Hops,
+                                  DtmfDetectorStats *stats,
+                                  int32_t *RowEnergy, int32_t *ColumnEnergy);
+static void batch_magnitudes(const int16_t short_array_samples[], int COUNT,
+                             int32_t *AbsSum, int32_t *Peak);
+template <class Rules>
+static char DTMF_normalized_detection(const DtmfRateTables &Tables,
+                                      const Rules &R,
+                                      const int16_t internalArray[],
+                                      int32_t Dial, DtmfDetectorStats *stats,
+                                      int32_t *RowEnergy,
+                                      int32_t *ColumnEnergy);
+template <class Rules>
+static char DTMF_float_detection(const DtmfRateTables &Tables,
+                                 const Rules &R,
+                                 const int16_t short_array_samples[],
+                                 int32_t Dial, DtmfDetectorStats *stats,
+                                 int32_t *RowEnergy, int32_t *ColumnEnergy);
+template <class Rules>
+static char DTMF_finish_detection(const Rules &R, int32_t T[], int32_t Row,
+                                  int32_t Column, int32_t Dial,
+                                  DtmfDetectorStats *stats,
+                                  int32_t *RowEnergy, int32_t *ColumnEnergy);
+template <class Rules>
+static bool check_dial_tones(const Rules &R, const int32_t T[], int32_t *Row,
+                             int32_t *Column, DtmfRejectReason *Reason);
+template <class Rules>
+static char check_harmonics(const Rules &R, const int32_t T[], int32_t Row,
+                            int32_t Column, DtmfRejectReason *Reason);
+
+// The detection functions of DtmfDetectorBase, compiled for one set of rules.
+struct DtmfDecision {
+  char (*detection)(const DtmfRateTables &Tables, DtmfBackend Backend,
+                    const DtmfDetectorConfig &Config,
+                    const int16_t short_array_samples[],
+                    DtmfDetectorStats *stats, int32_t *RowEnergy,
+                    int32_t *ColumnEnergy);
+  char (*g711_detection)(const DtmfRateTables &Tables, DtmfBackend Backend,
+                         const DtmfDetectorConfig &Config,
+                         const uint8_t g711_codes[], const int16_t Decode[],
+                         DtmfDetectorStats *stats, int32_t *RowEnergy,
+                         int32_t *ColumnEnergy);
+  char (*carried_detection)(const DtmfRateTables &Tables,
+                            const DtmfDetectorConfig &Config, int32_t AbsSum,
+                            int32_t Peak, float Vk1[], float Vk2[],
+                            const int16_t Tail[], int TailCount,
+                            DtmfDetectorStats *stats, int32_t *RowEnergy,
+                            int32_t *ColumnEnergy);
+  char (*window_detection)(const DtmfRateTables &Tables,
+                           const DtmfDetectorConfig &Config, int32_t AbsSum,
+                           int32_t Peak, const DtmfWindowHops &Hops,
+                           DtmfDetectorStats *stats, int32_t *RowEnergy,
+                           int32_t *ColumnEnergy);
+};
+
+#define DTMF_DECISION(Rules)                                                   \
+  { DTMF_detection<Rules>, DTMF_g711_detection<Rules>,                        \
+    DTMF_carried_detection<Rules>, DTMF_window_detection<Rules> }
+
+// Indexed by DtmfProfile.
+static const DtmfDecision DECISIONS[DTMF_PROFILE_CUSTOM + 1] = {
+    DTMF_DECISION(DtmfDefaultRules),
+    DTMF_DECISION(DtmfPresetRules<DTMF_PROFILE_Q24>),
+    DTMF_DECISION(DtmfPresetRules<DTMF_PROFILE_MOBILE>),
+    DTMF_DECISION(DtmfPresetRules<DTMF_PROFILE_TALK_OFF>),
+    DTMF_DECISION(DtmfConfigRules),
+};
+
+#undef DTMF_DECISION
 
 //--------------------------------------------------------------------
-DtmfDetectorBase::DtmfDetectorBase() {
-  buf_sample_count_ = 0;
+DtmfEventRing::DtmfEventRing(int capacity)
+    : events_(capacity), head_(0), size_(0), dropped_(0) {
+  assert(capacity > 0);
+}
+
+bool DtmfEventRing::Push(const DtmfToneEvent &event) {
+  if (size_ == capacity()) {
+    ++dropped_;
+    return false;
+  }
+  int tail = head_ + size_;
+  if (tail >= capacity())
+    tail -= capacity();
+  events_[tail] = event;
+  ++size_;
+  return true;
+}
+
+bool DtmfEventRing::Pop(DtmfToneEvent *event) {
+  if (size_ == 0)
+    return false;
+  *event = events_[head_];
+  if (++head_ == capacity())
+    head_ = 0;
+  --size_;
+  return true;
+}
+
+void DtmfEventRing::Clear() {
+  head_ = 0;
+  size_ = 0;
+  dropped_ = 0;
+}
+
+//--------------------------------------------------------------------
+DtmfDigitSink::DtmfDigitSink(char *storage, int capacity)
+    : storage_(storage), capacity_(capacity), size_(0), dropped_(0) {
+  assert(capacity >= 0);
+}
+
+bool DtmfDigitSink::Append(char dial_char) {
+  if (size_ == capacity_) {
+    ++dropped_;
+    return false;
+  }
+  storage_[size_++] = dial_char;
+  return true;
+}
+
+void DtmfDigitSink::Clear() {
+  size_ = 0;
+  dropped_ = 0;
+}
+
+//--------------------------------------------------------------------
+void DtmfNoiseFloor::Add(int32_t abs_sum) {
+  window_min_ = std::min(window_min_, abs_sum);
+  if (window_count_ > 0)
+    floor_ = std::min(floor_, abs_sum);
+  if (++window_batches_ < WINDOW_BATCHES)
+    return;
+
+  // The window is whole, and takes the place of the oldest one.
+  window_mins_[next_window_] = window_min_;
+  next_window_ = (next_window_ + 1) % WINDOW_COUNT;
+  if (window_count_ < WINDOW_COUNT)
+    ++window_count_;
+  floor_ = *std::min_element(window_mins_, window_mins_ + window_count_);
+  window_min_ = INT32_MAX;
+  window_batches_ = 0;
+}
+
+void DtmfNoiseFloor::Reset() {
+  floor_ = 0;
+  window_min_ = INT32_MAX;
+  window_batches_ = 0;
+  next_window_ = 0;
+  window_count_ = 0;
+}
+
+//--------------------------------------------------------------------
+static_assert(DTMF_COEFF_COUNT == COEFF_NUMBER,
+              "DTMF_COEFF_COUNT must match CONSTANTS");
+
+DtmfDetectorBase::DtmfDetectorBase(DtmfStraddleMode straddle_mode,
+                                   DtmfBackend backend,
+                                   const DtmfDetectorConfig &config)
+    : DtmfDetectorBase(DtmfRate<DTMF_BASE_SAMPLE_RATE>::tables, straddle_mode,
+                       backend, config) {}
+
+DtmfDetectorBase::DtmfDetectorBase(const DtmfRateTables &tables,
+                                   DtmfStraddleMode straddle_mode,
+                                   DtmfBackend backend,
+                                   const DtmfDetectorConfig &config)
+    : tables_(tables), straddle_mode_(straddle_mode),
+      // Only the float recurrences carry exactly, see DTMF_STRADDLE_CARRY.
+      backend_(straddle_mode == DTMF_STRADDLE_CARRY ? DTMF_BACKEND_FLOAT
+                                                    : backend),
+      config_(config), decision_(&DECISIONS[config.profile()]),
+      hop_size_(tables.batch_size), call_tones_(tables, 0) {
+  assert(tables.batch_size <= DTMF_MAX_BATCH_SIZE);
+  // Carrying never stages samples.
+  if (straddle_mode == DTMF_STRADDLE_STAGE)
+    buf_samples_.resize(tables.batch_size);
+  ClearCarry();
   prev_dial_ = ' ';
+  missed_windows_ = 0;
+  hop_head_ = 0;
+  hop_count_ = 0;
+  batch_start_sample_ = 0;
+  gate_armed_ = false;
+  UpdateGate();
+  ClearStats();
+}
+
+DtmfDetectorBase::DtmfDetectorBase(const DtmfRateTables &tables, int hop_size,
+                                   DtmfBackend backend,
+                                   const DtmfDetectorConfig &config)
+    : DtmfDetectorBase(tables, DTMF_STRADDLE_STAGE, backend, config) {
+  assert(hop_size >= 2 && tables.batch_size % hop_size == 0);
+  hop_size_ = hop_size;
+  // With a hop of a whole batch this is just DTMF_STRADDLE_STAGE.
+  int hop_total = tables.batch_size / hop_size;
+  if (hop_total == 1)
+    return;
+
+  // Windows are decided from the float state of their hops.
+  backend_ = DTMF_BACKEND_FLOAT;
+  hop_sums_.resize(hop_total);
+  hop_peaks_.resize(hop_total);
+  hop_filtered_.resize(hop_total);
+  hop_vk1_.resize(hop_total * DTMF_COEFF_COUNT);
+  hop_vk2_.resize(hop_total * DTMF_COEFF_COUNT);
+  hop_samples_.resize(tables.batch_size);
+
+  // A step of the recurrences on a zero sample takes (prev, prev_prev) to
+  // (Koeff * prev - prev_prev, prev); Q14 coefficients are exact in double.
+  hop_propagators_.resize(hop_total * 4 * DTMF_COEFF_COUNT);
+  for (unsigned kk = 0; kk < COEFF_NUMBER; ++kk) {
+    const double Koeff = tables.koeffs[kk] / 16384.0;
+    double Hop[4] = {1, 0, 0, 1};
+    for (int ii = 0; ii < hop_size; ++ii) {
+      double Next[4] = {Koeff * Hop[0] - Hop[2], Koeff * Hop[1] - Hop[3],
+                        Hop[0], Hop[1]};
+      std::copy(Next, Next + 4, Hop);
+    }
+    double Power[4] = {1, 0, 0, 1};
+    for (int mm = 0; mm < hop_total; ++mm) {
+      for (int ee = 0; ee < 4; ++ee)
+        hop_propagators_[(mm * 4 + ee) * DTMF_COEFF_COUNT + kk] = Power[ee];
+      double Next[4] = {Hop[0] * Power[0] + Hop[1] * Power[2],
+                        Hop[0] * Power[1] + Hop[1] * Power[3],
+                        Hop[2] * Power[0] + Hop[3] * Power[2],
+                        Hop[2] * Power[1] + Hop[3] * Power[3]};
+      std::copy(Next, Next + 4, Power);
+    }
+  }
+}
+
+void DtmfDetectorBase::ClearStageCounters() {
+  stats_.stages = DtmfStageCounters();
+}
+
+void DtmfDetectorBase::ClearStats() { stats_ = DtmfDetectorStats(); }
+
+// The number of whole batches ProcessBatches sums up at a time.
+const int GATE_SPAN_BATCHES = 8;
+
+void DtmfDetectorBase::UpdateGate() {
+  gate_sum_ =
+      static_cast<int64_t>(config_.power_threshold) * tables_.batch_size;
+  if (config_.noise_gate_ratio > 0)
+    gate_sum_ = std::max(gate_sum_,
+                         (static_cast<int64_t>(noise_floor_.floor()) *
+                          config_.noise_gate_ratio) >> 4);
+}
+
+// True if a batch whose sample magnitudes add up to abs_sum is under the gate,
+// in which case it is counted as silent, as the silence check of the decision
+// would.  The caller still has to report it.
+bool DtmfDetectorBase::Gated(int32_t abs_sum) {
+  if (abs_sum >= gate_sum_)
+    return false;
+  ++stats_.stages.batches;
+  ++stats_.stages.silent;
+  if (abs_sum >=
+      static_cast<int64_t>(config_.power_threshold) * tables_.batch_size)
+    count_noise_gated(&stats_);
+  TrackNoise(abs_sum, ' ');
+  return true;
+}
+
+// Feeds the noise floor with a batch, unless it holds a tone.
+void DtmfDetectorBase::TrackNoise(int32_t abs_sum, char dial_char) {
+  if (config_.noise_gate_ratio <= 0 || dial_char != ' ')
+    return;
+  noise_floor_.Add(abs_sum);
+  UpdateGate();
+}
+
+// Decides batch_count whole batches at samples.  While the noise gate is on,
+// or the stream is silent, the sample magnitudes of up to GATE_SPAN_BATCHES
+// batches are summed in a single pass first, and each run of batches under
+// the gate is skipped as a whole, without normalization or filters.  Without
+// the noise gate that is exactly the silence check of the decision, made
+// early; with it, each batch is still gated against the floor as it stood
+// after the batch before, so that how the input is split up makes no
+// difference.
+void DtmfDetectorBase::ProcessBatches(const int16_t *samples,
+                                      int batch_count) {
+  const int batch_size = tables_.batch_size;
+  while (batch_count > 0) {
+    if (!gate_armed_ && config_.noise_gate_ratio <= 0) {
+      uint64_t silent = stats_.stages.silent;
+      ProcessBatch(samples);
+      gate_armed_ = stats_.stages.silent != silent;
+      samples += batch_size;
+      --batch_count;
+      continue;
+    }
+
+    const int span = std::min(batch_count, GATE_SPAN_BATCHES);
+    int32_t AbsSums[GATE_SPAN_BATCHES];
+    for (int ii = 0; ii < span; ++ii) {
+      int32_t Peak;
+      batch_magnitudes(samples + ii * batch_size, batch_size, &AbsSums[ii],
+                       &Peak);
+    }
+
+    int gated = 0;
+    for (int ii = 0; ii < span; ++ii) {
+      if (Gated(AbsSums[ii])) {
+        ++gated;
+        continue;
+      }
+      if (gated != 0) {
+        OnDetectedRun(' ', gated, 0, 0);
+        gated = 0;
+      }
+      char dial_char = ProcessBatch(samples + ii * batch_size);
+      TrackNoise(AbsSums[ii], dial_char);
+    }
+    if (gated != 0)
+      OnDetectedRun(' ', gated, 0, 0);
+
+    // Stay armed while the span ends in silence.
+    gate_armed_ = AbsSums[span - 1] < gate_sum_;
+    samples += span * batch_size;
+    batch_count -= span;
+  }
+}
+
+void DtmfDetectorBase::EnableCallTones(unsigned banks) {
+  call_tones_ = DtmfCallToneTracker(tables_, banks);
+}
+
+void DtmfDetectorBase::DetectCallTones(const int16_t *samples,
+                                       size_t sample_count) {
+  DtmfCallToneEvent events[DTMF_CALL_TONE_BANK_COUNT];
+  while (sample_count > 0) {
+    int event_count;
+    size_t used =
+        call_tones_.Advance(samples, sample_count, events, &event_count);
+    for (int ii = 0; ii < event_count; ++ii)
+      OnCallTone(events[ii]);
+    samples += used;
+    sample_count -= used;
+  }
 }
 
 void DtmfDetectorBase::Detect(const int16_t *samples, int sample_count) {
+  if (call_tones_.banks() && sample_count > 0)
+    DetectCallTones(samples, sample_count);
+  if (!hop_sums_.empty())
+    DetectSliding(samples, sample_count);
+  else if (straddle_mode_ == DTMF_STRADDLE_CARRY)
+    DetectCarried(samples, sample_count);
+  else
+    DetectStaged(samples, sample_count);
+}
+
+void DtmfDetectorBase::DetectStaged(const int16_t *samples, int sample_count) {
+  const int batch_size = tables_.batch_size;
   if (buf_sample_count_ != 0) {
     // Copy the input array into the back of buf_samples_.
-    int count_to_copy =
-        std::min(sample_count, DTMF_DETECTION_BATCH_SIZE - buf_sample_count_);
+    int count_to_copy = std::min(sample_count, batch_size - buf_sample_count_);
     std::copy(samples, samples + count_to_copy,
-              buf_samples_ + buf_sample_count_);
+              &buf_samples_[0] + buf_sample_count_);
     buf_sample_count_ += count_to_copy;
     samples += count_to_copy;
     sample_count -= count_to_copy;
-    if (sample_count < DTMF_DETECTION_BATCH_SIZE) {
+    if (buf_sample_count_ < batch_size) {
       return;
     }
-  }
 
-  // process batch samples in buffer
-  if (buf_sample_count_ == DTMF_DETECTION_BATCH_SIZE) {
-    char dial_char = DTMF_detection(buf_samples_);
-    OnDetectedTone(dial_char);
+    // process batch samples in buffer
+    ProcessBatches(&buf_samples_[0], 1);
     buf_sample_count_ = 0;
   }
 
   // process samples in input data directory
-  while (sample_count >= DTMF_DETECTION_BATCH_SIZE) {
-    // Determine the tone present in the current batch
-    char dial_char = DTMF_detection(samples);
-    OnDetectedTone(dial_char);
-
-    samples += DTMF_DETECTION_BATCH_SIZE;
-    sample_count -= DTMF_DETECTION_BATCH_SIZE;
-  }
+  int batch_count = sample_count / batch_size;
+  ProcessBatches(samples, batch_count);
+  samples += batch_count * batch_size;
+  sample_count -= batch_count * batch_size;
 
   // We have sample_count samples left to process, but it's not enough for an
   // entire batch. Store the samples to the buffer and deal with them next time
   // this function is called.
-  assert(buf_sample_count_ == 0 && sample_count < DTMF_DETECTION_BATCH_SIZE);
-  std::copy(samples, samples + sample_count, buf_samples_);
+  assert(buf_sample_count_ == 0 && sample_count < batch_size);
+  std::copy(samples, samples + sample_count, buf_samples_.begin());
   buf_sample_count_ = sample_count;
 }
 
-void DtmfDetectorBase::OnDetectedTone(char dial_char) {
-  // Determine if we should register it as a new tone, or
-  // ignore it as a continuation of a previous tone.
-  if (dial_char != prev_dial_ && dial_char != ' ') {
-    OnNewTone(dial_char);
+void DtmfDetectorBase::DetectCarried(const int16_t *samples,
+                                     int sample_count) {
+  const int batch_size = tables_.batch_size;
+  while (sample_count > 0) {
+    // Whole batches are processed straight from the input, as when staging.
+    if (buf_sample_count_ == 0 && sample_count >= batch_size) {
+      int batch_count = sample_count / batch_size;
+      ProcessBatches(samples, batch_count);
+      samples += batch_count * batch_size;
+      sample_count -= batch_count * batch_size;
+      continue;
+    }
+
+    // The start of a batch that straddles calls.
+    int count = std::min(sample_count, batch_size - buf_sample_count_);
+    if (buf_sample_count_ + count < batch_size) {
+      Carry(samples, count);
+      samples += count;
+      sample_count -= count;
+      continue;
+    }
+
+    // The rest of it, which is still at hand: its recurrences wait for the
+    // silence check, and the other frequencies for the first stage of the
+    // decision, as when staging.
+    int32_t row_energy = 0, column_energy = 0;
+    int32_t AbsSum, Peak;
+    batch_magnitudes(samples, count, &AbsSum, &Peak);
+    carry_abs_sum_ += AbsSum;
+    carry_peak_ = std::max(carry_peak_, Peak);
+    char dial_char = ' ';
+    if (!Gated(carry_abs_sum_)) {
+      uint64_t start = stats_ticks();
+      uint64_t silent = stats_.stages.silent;
+      dial_char = decision_->carried_detection(
+          tables_, config_, carry_abs_sum_, carry_peak_, carry_vk1_,
+          carry_vk2_, samples, count, &stats_, &row_energy, &column_energy);
+      count_batch_ticks(&stats_, start, silent);
+      TrackNoise(carry_abs_sum_, dial_char);
+    }
+    OnDetectedTone(dial_char, row_energy, column_energy);
+    ClearCarry();
+    samples += count;
+    sample_count -= count;
+  }
+}
+
+void DtmfDetectorBase::DetectSliding(const int16_t *samples,
+                                     int sample_count) {
+  const int hop_total = static_cast<int>(hop_sums_.size());
+  while (sample_count > 0) {
+    int count = std::min(sample_count, hop_size_ - buf_sample_count_);
+
+    // The hop goes where the one it replaces was.
+    int hop = hop_count_ < hop_total ? hop_count_ : hop_head_;
+    if (buf_sample_count_ == 0) {
+      hop_sums_[hop] = 0;
+      hop_peaks_[hop] = 0;
+      hop_filtered_[hop] = 0;
+    }
+    int32_t AbsSum, Peak;
+    batch_magnitudes(samples, count, &AbsSum, &Peak);
+    hop_sums_[hop] += AbsSum;
+    hop_peaks_[hop] = std::max(hop_peaks_[hop], Peak);
+    std::copy(samples, samples + count,
+              &hop_samples_[hop * hop_size_ + buf_sample_count_]);
+    buf_sample_count_ += count;
+    samples += count;
+    sample_count -= count;
+
+    if (buf_sample_count_ == hop_size_) {
+      // The hop is complete, and takes the place of the oldest one.  It is
+      // only filtered once a window that holds it is not silent.
+      if (hop_count_ < hop_total)
+        ++hop_count_;
+      else
+        hop_head_ = (hop_head_ + 1) % hop_total;
+      buf_sample_count_ = 0;
+
+      // Once there is a full window, decide on it.
+      if (hop_count_ == hop_total)
+        ProcessWindow();
+    }
+  }
+}
+
+void DtmfDetectorBase::Carry(const int16_t *samples, int count) {
+  int32_t AbsSum, Peak;
+  batch_magnitudes(samples, count, &AbsSum, &Peak);
+  carry_abs_sum_ += AbsSum;
+  carry_peak_ = std::max(carry_peak_, Peak);
+  // The state stays zero for as long as the samples do.
+  if (carry_abs_sum_ != 0)
+    goertzel_advance_float(tables_.koeffs, COEFF_NUMBER, samples, count,
+                           carry_vk1_, carry_vk2_);
+  buf_sample_count_ += count;
+}
+
+void DtmfDetectorBase::ClearCarry() {
+  buf_sample_count_ = 0;
+  carry_abs_sum_ = 0;
+  carry_peak_ = 0;
+  std::fill(carry_vk1_, carry_vk1_ + DTMF_COEFF_COUNT, 0.0f);
+  std::fill(carry_vk2_, carry_vk2_ + DTMF_COEFF_COUNT, 0.0f);
+}
+
+void DtmfDetectorBase::ProcessWindow() {
+  int32_t AbsSum = 0, Peak = 0;
+  for (size_t ii = 0; ii < hop_sums_.size(); ++ii) {
+    AbsSum += hop_sums_[ii];
+    Peak = std::max(Peak, hop_peaks_[ii]);
+  }
+
+  // Silent windows are told from the sums of their hops.
+  if (Gated(AbsSum)) {
+    OnDetectedTone(' ', 0, 0);
+    return;
+  }
+
+  // The others are decided from the state of the recurrences of their hops.
+  int32_t row_energy = 0, column_energy = 0;
+  uint64_t start = stats_ticks();
+  uint64_t silent = stats_.stages.silent;
+  DtmfWindowHops hops = {tables_.koeffs,
+                         &hop_samples_[0],
+                         hop_size_,
+                         hop_head_,
+                         static_cast<int>(hop_sums_.size()),
+                         &hop_filtered_[0],
+                         &hop_vk1_[0],
+                         &hop_vk2_[0],
+                         &hop_propagators_[0]};
+  char dial_char = decision_->window_detection(
+      tables_, config_, AbsSum, Peak, hops, &stats_, &row_energy,
+      &column_energy);
+  count_batch_ticks(&stats_, start, silent);
+  TrackNoise(AbsSum, dial_char);
+  OnDetectedTone(dial_char, row_energy, column_energy);
+}
+
+char DtmfDetectorBase::ProcessBatch(const int16_t *samples) {
+  // Determine the tone present in the current batch
+  int32_t row_energy = 0, column_energy = 0;
+  uint64_t start = stats_ticks();
+  uint64_t silent = stats_.stages.silent;
+  char dial_char = decision_->detection(tables_, backend_, config_, samples,
+                                        &stats_, &row_energy, &column_energy);
+  count_batch_ticks(&stats_, start, silent);
+  OnDetectedTone(dial_char, row_energy, column_energy);
+  return dial_char;
+}
+
+// The number of G.711 samples decoded at a time when there is no fused path.
+const int G711_DECODE_BLOCK = 256;
+
+void DtmfDetectorBase::Detect(const uint8_t *g711_samples, int sample_count,
+                              G711Law law) {
+  const int16_t *decode = g711_table(law).samples;
+  if (!hop_sums_.empty() || straddle_mode_ == DTMF_STRADDLE_CARRY ||
+      call_tones_.banks() || config_.noise_gate_ratio > 0) {
+    int16_t samples[G711_DECODE_BLOCK];
+    while (sample_count > 0) {
+      int count = std::min(sample_count, G711_DECODE_BLOCK);
+      for (int ii = 0; ii < count; ++ii)
+        samples[ii] = decode[g711_samples[ii]];
+      Detect(samples, count);
+      g711_samples += count;
+      sample_count -= count;
+    }
+    return;
+  }
+
+  // As DetectStaged, decoding into buf_samples_ where it copies.
+  const int batch_size = tables_.batch_size;
+  if (buf_sample_count_ != 0) {
+    int count_to_copy = std::min(sample_count, batch_size - buf_sample_count_);
+    for (int ii = 0; ii < count_to_copy; ++ii)
+      buf_samples_[buf_sample_count_ + ii] = decode[g711_samples[ii]];
+    buf_sample_count_ += count_to_copy;
+    g711_samples += count_to_copy;
+    sample_count -= count_to_copy;
+    if (buf_sample_count_ < batch_size) {
+      return;
+    }
+
+    ProcessBatch(&buf_samples_[0]);
+    buf_sample_count_ = 0;
+  }
+
+  while (sample_count >= batch_size) {
+    ProcessG711Batch(g711_samples, g711_table(law));
+    g711_samples += batch_size;
+    sample_count -= batch_size;
+  }
+
+  for (int ii = 0; ii < sample_count; ++ii)
+    buf_samples_[ii] = decode[g711_samples[ii]];
+  buf_sample_count_ = sample_count;
+}
+
+void DtmfDetectorBase::ProcessG711Batch(const uint8_t *codes,
+                                        const G711Table &table) {
+  int32_t row_energy = 0, column_energy = 0;
+  uint64_t start = stats_ticks();
+  uint64_t silent = stats_.stages.silent;
+  char dial_char = decision_->g711_detection(tables_, backend_, config_,
+                                             codes, table.samples, &stats_,
+                                             &row_energy, &column_energy);
+  count_batch_ticks(&stats_, start, silent);
+  OnDetectedTone(dial_char, row_energy, column_energy);
+}
+
+void DtmfDetectorBase::OnDetectedTone(char dial_char, int32_t row_energy,
+                                      int32_t column_energy) {
+  // In sliding mode, a tone only ends once a whole batch has gone by without
+  // it, so that a single window rejected in the middle of a tone does not
+  // split it in two.
+  if (dial_char == ' ' && prev_dial_ != ' ' &&
+      missed_windows_ < static_cast<int>(hop_sums_.size()) - 1) {
+    ++missed_windows_;
+    batch_start_sample_ += hop_size_;
+    return;
+  }
+  missed_windows_ = 0;
+
+  if (dial_char != prev_dial_) {
+    // The previous tone, if any, ended with the previous batch.
+    Flush();
+
+    // Register a new tone.
+    if (dial_char != ' ') {
+      tone_.dial_char = dial_char;
+      tone_.start_sample = batch_start_sample_;
+      tone_.end_sample = batch_start_sample_ + tables_.batch_size;
+      tone_.peak_row_energy = row_energy;
+      tone_.peak_column_energy = column_energy;
+      OnNewTone(dial_char);
+    }
+  } else if (dial_char != ' ') {
+    // A continuation of the previous tone.
+    tone_.end_sample = batch_start_sample_ + tables_.batch_size;
+    tone_.peak_row_energy = std::max(tone_.peak_row_energy, row_energy);
+    tone_.peak_column_energy =
+        std::max(tone_.peak_column_energy, column_energy);
   }
 
   // Store the current tone.
   prev_dial_ = dial_char;
+  batch_start_sample_ += hop_size_;
+}
+
+// A run of consecutive batches with the same decision, with the largest
+// energies of its batches.
+struct DtmfDecisionRun {
+  char dial_char;
+  uint64_t batch_count;
+  int32_t row_energy;
+  int32_t column_energy;
+};
+
+// Adds the statistics in From to To.
+static void merge_stats(const DtmfDetectorStats &From, DtmfDetectorStats *To) {
+  To->stages.batches += From.stages.batches;
+  To->stages.silent += From.stages.silent;
+  To->stages.dial_tones_rejected += From.stages.dial_tones_rejected;
+  To->stages.harmonics_rejected += From.stages.harmonics_rejected;
+  To->stages.detected += From.stages.detected;
+  To->noise_gated += From.noise_gated;
+  for (int ii = 0; ii < DTMF_REJECT_REASON_COUNT; ++ii)
+    To->rejected[ii] += From.rejected[ii];
+  for (int ii = 0; ii < DTMF_STATS_TICK_BUCKETS; ++ii)
+    To->batch_ticks[ii] += From.batch_ticks[ii];
+}
+
+// Decide batch_count whole batches of samples, and append the decisions to
+// runs.
+static void detect_runs(const DtmfRateTables &Tables, DtmfBackend Backend,
+                        const DtmfDetectorConfig &Config,
+                        const DtmfDecision *Decision, const int16_t *samples,
+                        size_t batch_count,
+                        std::vector<DtmfDecisionRun> *runs,
+                        DtmfDetectorStats *stats) {
+  for (size_t bb = 0; bb < batch_count; ++bb) {
+    int32_t row_energy = 0, column_energy = 0;
+    uint64_t start = stats_ticks();
+    uint64_t silent = stats->stages.silent;
+    char dial_char = Decision->detection(
+        Tables, Backend, Config, samples + bb * Tables.batch_size, stats,
+        &row_energy, &column_energy);
+    count_batch_ticks(stats, start, silent);
+    if (!runs->empty() && runs->back().dial_char == dial_char) {
+      DtmfDecisionRun &run = runs->back();
+      ++run.batch_count;
+      run.row_energy = std::max(run.row_energy, row_energy);
+      run.column_energy = std::max(run.column_energy, column_energy);
+    } else {
+      runs->push_back(
+          DtmfDecisionRun{dial_char, 1, row_energy, column_energy});
+    }
+  }
+}
+
+void DtmfDetectorBase::DetectParallel(const int16_t *samples,
+                                      size_t sample_count,
+                                      DtmfThreadPool &pool) {
+  const size_t batch_size = tables_.batch_size;
+  if (!hop_sums_.empty() || pool.thread_count() <= 1 ||
+      config_.noise_gate_ratio > 0) {
+    for (size_t done = 0; done < sample_count;) {
+      int count = static_cast<int>(
+          std::min<size_t>(sample_count - done, 1 << 30));
+      Detect(samples + done, count);
+      done += count;
+    }
+    return;
+  }
+
+  // Complete the batch started by a previous call first, so that the rest
+  // starts on a batch boundary.
+  if (buf_sample_count_ != 0) {
+    int count = static_cast<int>(
+        std::min(sample_count, batch_size - buf_sample_count_));
+    Detect(samples, count);
+    samples += count;
+    sample_count -= count;
+  }
+
+  // Every worker decides a contiguous share of the whole batches.
+  size_t batch_count = sample_count / batch_size;
+  size_t chunk_count = std::min<size_t>(pool.thread_count(), batch_count);
+  std::vector<std::vector<DtmfDecisionRun>> runs(chunk_count);
+  std::vector<DtmfDetectorStats> stats(chunk_count, DtmfDetectorStats());
+  std::vector<size_t> first_batch(chunk_count + 1, 0);
+  for (size_t cc = 0; cc < chunk_count; ++cc) {
+    size_t count = batch_count / chunk_count + (cc < batch_count % chunk_count);
+    first_batch[cc + 1] = first_batch[cc] + count;
+    pool.Add(cc);
+  }
+  std::function<void(size_t)> run = [&](size_t cc) {
+    detect_runs(tables_, backend_, config_, decision_,
+                samples + first_batch[cc] * batch_size,
+                first_batch[cc + 1] - first_batch[cc], &runs[cc], &stats[cc]);
+  };
+  pool.Start(run);
+  // The call tones need the batches in order; this thread has nothing else
+  // to do meanwhile.
+  if (call_tones_.banks())
+    DetectCallTones(samples, batch_count * batch_size);
+  pool.Wait();
+
+  // Stitch the chunks together by replaying their decisions in order, as if
+  // the batches had been processed one after the other.
+  for (size_t cc = 0; cc < chunk_count; ++cc) {
+    for (const DtmfDecisionRun &run : runs[cc])
+      OnDetectedRun(run.dial_char, run.batch_count, run.row_energy,
+                    run.column_energy);
+    merge_stats(stats[cc], &stats_);
+  }
+
+  // The samples after the last whole batch wait for the next call.
+  size_t rest = sample_count - batch_count * batch_size;
+  Detect(samples + batch_count * batch_size, static_cast<int>(rest));
+}
+
+// The same as batch_count calls to OnDetectedTone with dial_char, with
+// row_energy and column_energy the largest energies among them.
+void DtmfDetectorBase::OnDetectedRun(char dial_char, uint64_t batch_count,
+                                     int32_t row_energy,
+                                     int32_t column_energy) {
+  assert(hop_sums_.empty() && batch_count > 0);
+  OnDetectedTone(dial_char, row_energy, column_energy);
+  // The others would only move the end of the tone on.
+  batch_start_sample_ += (batch_count - 1) * hop_size_;
+  if (dial_char != ' ')
+    tone_.end_sample = batch_start_sample_ - hop_size_ + tables_.batch_size;
+}
+
+void DtmfDetectorBase::Flush() {
+  if (prev_dial_ != ' ') {
+    tone_.duration = tone_.end_sample - tone_.start_sample;
+    OnToneEvent(tone_);
+  }
+  prev_dial_ = ' ';
+}
+
+// Sum the magnitudes of COUNT samples and find the largest
+// sample ^ (sample >> 31) in a single pass.  x ^ (x >> 31) is x for
+// non-negative x and ~x == |x| - 1 for negative x, so it never overflows 16
+// bits and
+//   |x| == (x ^ (x >> 31)) - (x >> 31).
+static void batch_magnitudes(const int16_t short_array_samples[], int COUNT,
+                             int32_t *AbsSum, int32_t *Peak) {
+  int32_t Sum = 0, Max = 0;
+  int ii = 0;
+#ifdef DTMF_SSE2
+  const __m128i Ones = _mm_set1_epi16(1);
+  __m128i SumV = _mm_setzero_si128(), MaxV = _mm_setzero_si128();
+  for (; ii + 8 <= COUNT; ii += 8) {
+    __m128i Sample = _mm_loadu_si128(
+        reinterpret_cast<const __m128i *>(short_array_samples + ii));
+    __m128i Sign = _mm_srai_epi16(Sample, 15);
+    __m128i Magnitude = _mm_xor_si128(Sample, Sign);
+    MaxV = _mm_max_epi16(MaxV, Magnitude);
+    // Pairwise sums widen to 32 bits, so nothing overflows.
+    SumV = _mm_add_epi32(SumV, _mm_madd_epi16(Magnitude, Ones));
+    SumV = _mm_sub_epi32(SumV, _mm_madd_epi16(Sign, Ones));
+  }
+  SumV = _mm_add_epi32(SumV, _mm_shuffle_epi32(SumV, _MM_SHUFFLE(1, 0, 3, 2)));
+  SumV = _mm_add_epi32(SumV, _mm_shuffle_epi32(SumV, _MM_SHUFFLE(2, 3, 0, 1)));
+  Sum = _mm_cvtsi128_si32(SumV);
+  MaxV = _mm_max_epi16(MaxV, _mm_shuffle_epi32(MaxV, _MM_SHUFFLE(1, 0, 3, 2)));
+  MaxV = _mm_max_epi16(MaxV, _mm_shuffle_epi32(MaxV, _MM_SHUFFLE(2, 3, 0, 1)));
+  MaxV = _mm_max_epi16(MaxV, _mm_srli_epi32(MaxV, 16));
+  Max = static_cast<int16_t>(_mm_cvtsi128_si32(MaxV));
+#endif
+  for (; ii < COUNT; ii++) {
+    int32_t sample32 = short_array_samples[ii];
+    Sum += abs(sample32);
+    Max = std::max(Max, sample32 ^ (sample32 >> 31));
+  }
+  *AbsSum = Sum, *Peak = Max;
+}
+
+void DTMF_batch_magnitudes(const int16_t Samples[], int COUNT,
+                           int32_t *AbsSum, int32_t *Peak) {
+  batch_magnitudes(Samples, COUNT, AbsSum, Peak);
+}
+
+// Shift COUNT samples left by Dial bits.  Dial never pushes a sample out of
+// 16 bits, see DTMF_normalization_shift.
+static void batch_shift_left(const int16_t short_array_samples[], int COUNT,
+                             int32_t Dial, int16_t internalArray[]) {
+  int ii = 0;
+#ifdef DTMF_SSE2
+  const __m128i Count = _mm_cvtsi32_si128(Dial);
+  for (; ii + 8 <= COUNT; ii += 8) {
+    __m128i Sample = _mm_loadu_si128(
+        reinterpret_cast<const __m128i *>(short_array_samples + ii));
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(internalArray + ii),
+                     _mm_sll_epi16(Sample, Count));
+  }
+#endif
+  for (; ii < COUNT; ii++) {
+    int32_t sample32 = short_array_samples[ii];
+    internalArray[ii] = static_cast<int16_t>(sample32 * (1 << Dial));
+  }
 }
 
 //-----------------------------------------------------------------
-// Detect a tone in a single batch of samples (DTMF_DETECTION_BATCH_SIZE
-// elements).
-char DTMF_detection(const int16_t short_array_samples[]) {
-  // The magnitude of each coefficient in the current frame.  Populated
-  // by goertzel_filter
-  int32_t T[COEFF_NUMBER];
+// Detect a tone in a single batch of samples (Tables.batch_size elements).
+// Counts the batch in stats.  If there is a tone, its row and column
+// magnitudes, scaled back to the level of the input, are stored to RowEnergy
+// and ColumnEnergy.
+template <class Rules>
+char DTMF_detection(const DtmfRateTables &Tables, DtmfBackend Backend,
+                    const DtmfDetectorConfig &Config,
+                    const int16_t short_array_samples[],
+                    DtmfDetectorStats *stats, int32_t *RowEnergy,
+                    int32_t *ColumnEnergy) {
+  const Rules R(Config);
 
-  // An array of size DTMF_DETECTION_BATCH_SIZE.  Used as input to the Goertzel
+  // An array of size Tables.batch_size.  Used as input to the Goertzel
   // function.
-  int16_t internalArray[DTMF_DETECTION_BATCH_SIZE];
+  int16_t internalArray[DTMF_MAX_BATCH_SIZE];
 
-  char return_value = ' ';
-  unsigned ii;
+  // AbsSum       Sum of the sample magnitudes in the batch.
+  // Peak         The largest sample ^ (sample >> 31) in the batch.
+  // Dial         The number of bits the batch is shifted left by during
+  //              normalization.
+  int32_t AbsSum, Peak;
+  batch_magnitudes(short_array_samples, Tables.batch_size, &AbsSum, &Peak);
 
-  // Dial         TODO: what is this?
-  // return_value The tone detected in this batch (can be silence).
-  // ii           Iteration variable
-
-  {
-    // Quick check for silence by calculate average magnitude
-    int32_t Sum = 0;
-    for (ii = 0; ii < DTMF_DETECTION_BATCH_SIZE; ii++) {
-      Sum += abs(short_array_samples[ii]);
-      // if(short_array_samples[ii] >= 0)
-      //    Sum += short_array_samples[ii];
-      // else
-      //    Sum -= short_array_samples[ii];
-    }
-    Sum /= DTMF_DETECTION_BATCH_SIZE;
-    if (Sum < powerThreshold)
-      return ' ';
+  ++stats->stages.batches;
+
+  // Quick check for silence by calculate average magnitude
+  if (AbsSum / Tables.batch_size < R.power_threshold()) {
+    ++stats->stages.silent;
+    return ' ';
   }
 
+  int32_t Dial = DTMF_normalization_shift(AbsSum, Peak);
+  if (Backend == DTMF_BACKEND_FLOAT)
+    return DTMF_float_detection(Tables, R, short_array_samples, Dial, stats,
+                                RowEnergy, ColumnEnergy);
+
   // Normalization
-  {
-    // Iterate over each sample.
-    // First, adjusting Dial to an appropriate value for the batch.
-    int32_t Dial = 32;
-    for (ii = 0; ii < DTMF_DETECTION_BATCH_SIZE; ii++) {
-      int32_t sample32 = static_cast<int32_t>(short_array_samples[ii]);
-      if (sample32 != 0) {
-        if (Dial > norm_l(sample32)) {
-          Dial = norm_l(sample32);
-        }
-      }
-    }
+  batch_shift_left(short_array_samples, Tables.batch_size, Dial,
+                   internalArray);
 
-    Dial -= 16;
+  return DTMF_normalized_detection(Tables, R, internalArray, Dial, stats,
+                                   RowEnergy, ColumnEnergy);
+}
 
-    // Next, utilize Dial for scaling and populate internalArray.
-    for (ii = 0; ii < DTMF_DETECTION_BATCH_SIZE; ii++) {
-      int32_t sample32 = short_array_samples[ii];
-      internalArray[ii] = static_cast<int16_t>(sample32 << Dial);
+//-----------------------------------------------------------------
+// DTMF_detection for a batch of G.711 code words, which Decode maps to
+// linear samples.  The code words are decoded straight into the buffer
+// normalization works in, and normalized there.
+template <class Rules>
+char DTMF_g711_detection(const DtmfRateTables &Tables, DtmfBackend Backend,
+                         const DtmfDetectorConfig &Config,
+                         const uint8_t g711_codes[], const int16_t Decode[],
+                         DtmfDetectorStats *stats, int32_t *RowEnergy,
+                         int32_t *ColumnEnergy) {
+  const Rules R(Config);
+  int16_t internalArray[DTMF_MAX_BATCH_SIZE];
+  for (int ii = 0; ii < Tables.batch_size; ii++)
+    internalArray[ii] = Decode[g711_codes[ii]];
+
+  int32_t AbsSum, Peak;
+  batch_magnitudes(internalArray, Tables.batch_size, &AbsSum, &Peak);
+
+  ++stats->stages.batches;
+
+  // Quick check for silence by calculate average magnitude
+  if (AbsSum / Tables.batch_size < R.power_threshold()) {
+    ++stats->stages.silent;
+    return ' ';
+  }
+
+  int32_t Dial = DTMF_normalization_shift(AbsSum, Peak);
+  if (Backend == DTMF_BACKEND_FLOAT)
+    return DTMF_float_detection(Tables, R, internalArray, Dial, stats,
+                                RowEnergy, ColumnEnergy);
+
+  // Normalization, in place.
+  batch_shift_left(internalArray, Tables.batch_size, Dial, internalArray);
+
+  return DTMF_normalized_detection(Tables, R, internalArray, Dial, stats,
+                                   RowEnergy, ColumnEnergy);
+}
+
+//-----------------------------------------------------------------
+// The rest of DTMF_detection, once the batch is normalized: internalArray
+// holds its samples shifted left by Dial bits.
+template <class Rules>
+static char DTMF_normalized_detection(const DtmfRateTables &Tables,
+                                      const Rules &R,
+                                      const int16_t internalArray[],
+                                      int32_t Dial, DtmfDetectorStats *stats,
+                                      int32_t *RowEnergy,
+                                      int32_t *ColumnEnergy) {
+  // The magnitude of each coefficient in the current frame.  Populated
+  // by goertzel_filter_bank
+  int32_t T[COEFF_NUMBER];
+
+  // Frequency detection, in two stages.  First only the 8 DTMF frequencies
+  // are processed, in a single pass over internalArray; most batches that
+  // are not silent but hold no tone (e.g. speech) are rejected right there.
+  int32_t Row, Column;
+  goertzel_filter_bank(Tables.koeffs, DTMF_FREQUENCY_NUMBER, internalArray,
+                       Tables.batch_size, T, Tables.magnitude_shift);
+  DtmfRejectReason Reason;
+  if (!check_dial_tones(R, T, &Row, &Column, &Reason)) {
+    ++stats->stages.dial_tones_rejected;
+    count_rejection(stats, Reason);
+    return ' ';
+  }
+
+  // Then the other frequencies, for the few batches that are left.
+  goertzel_filter_bank(Tables.koeffs + DTMF_FREQUENCY_NUMBER,
+                       COEFF_NUMBER - DTMF_FREQUENCY_NUMBER, internalArray,
+                       Tables.batch_size, T + DTMF_FREQUENCY_NUMBER,
+                       Tables.magnitude_shift);
+
+  return DTMF_finish_detection(R, T, Row, Column, Dial, stats, RowEnergy,
+                               ColumnEnergy);
+}
+
+//-----------------------------------------------------------------
+// The rest of DTMF_detection for DTMF_BACKEND_FLOAT.  The samples are not
+// shifted: the float filters need no headroom, and put their magnitudes on
+// the scale of normalized samples, Dial bits up, themselves.
+template <class Rules>
+static char DTMF_float_detection(const DtmfRateTables &Tables,
+                                 const Rules &R,
+                                 const int16_t short_array_samples[],
+                                 int32_t Dial, DtmfDetectorStats *stats,
+                                 int32_t *RowEnergy, int32_t *ColumnEnergy) {
+  int32_t T[COEFF_NUMBER];
+
+  int32_t Row, Column;
+  goertzel_filter_bank_float(Tables.koeffs, DTMF_FREQUENCY_NUMBER,
+                             short_array_samples, Tables.batch_size, Dial, T,
+                             Tables.magnitude_shift);
+  DtmfRejectReason Reason;
+  if (!check_dial_tones(R, T, &Row, &Column, &Reason)) {
+    ++stats->stages.dial_tones_rejected;
+    count_rejection(stats, Reason);
+    return ' ';
+  }
+
+  goertzel_filter_bank_float(Tables.koeffs + DTMF_FREQUENCY_NUMBER,
+                             COEFF_NUMBER - DTMF_FREQUENCY_NUMBER,
+                             short_array_samples, Tables.batch_size, Dial,
+                             T + DTMF_FREQUENCY_NUMBER,
+                             Tables.magnitude_shift);
+
+  return DTMF_finish_detection(R, T, Row, Column, Dial, stats, RowEnergy,
+                               ColumnEnergy);
+}
+
+//-----------------------------------------------------------------
+// DTMF_detection for a batch whose first samples have already been run
+// through the float Goertzel recurrences, see DTMF_STRADDLE_CARRY.  AbsSum
+// and Peak are as in DTMF_detection, for the whole batch.  Vk1 and Vk2 hold
+// the state of the COEFF_NUMBER recurrences after the first samples, and are
+// advanced over the TailCount samples at Tail that end the batch as far as
+// the decision needs them.  The decision is bit for bit that of
+// DTMF_float_detection on the whole batch.
+template <class Rules>
+char DTMF_carried_detection(const DtmfRateTables &Tables,
+                            const DtmfDetectorConfig &Config, int32_t AbsSum,
+                            int32_t Peak, float Vk1[], float Vk2[],
+                            const int16_t Tail[], int TailCount,
+                            DtmfDetectorStats *stats, int32_t *RowEnergy,
+                            int32_t *ColumnEnergy) {
+  const Rules R(Config);
+  int32_t T[COEFF_NUMBER];
+
+  ++stats->stages.batches;
+
+  // Quick check for silence by calculate average magnitude
+  if (AbsSum / Tables.batch_size < R.power_threshold()) {
+    ++stats->stages.silent;
+    return ' ';
+  }
+
+  // The float filters put their magnitudes on the scale of normalized
+  // samples themselves.
+  int32_t Dial = DTMF_normalization_shift(AbsSum, Peak);
+
+  int32_t Row, Column;
+  goertzel_advance_float(Tables.koeffs, DTMF_FREQUENCY_NUMBER, Tail,
+                         TailCount, Vk1, Vk2);
+  goertzel_state_magnitudes_float(Tables.koeffs, DTMF_FREQUENCY_NUMBER, Vk1,
+                                  Vk2, Dial, T, Tables.magnitude_shift);
+  DtmfRejectReason Reason;
+  if (!check_dial_tones(R, T, &Row, &Column, &Reason)) {
+    ++stats->stages.dial_tones_rejected;
+    count_rejection(stats, Reason);
+    return ' ';
+  }
+
+  goertzel_advance_float(Tables.koeffs + DTMF_FREQUENCY_NUMBER,
+                         COEFF_NUMBER - DTMF_FREQUENCY_NUMBER, Tail,
+                         TailCount, Vk1 + DTMF_FREQUENCY_NUMBER,
+                         Vk2 + DTMF_FREQUENCY_NUMBER);
+  goertzel_state_magnitudes_float(
+      Tables.koeffs + DTMF_FREQUENCY_NUMBER,
+      COEFF_NUMBER - DTMF_FREQUENCY_NUMBER, Vk1 + DTMF_FREQUENCY_NUMBER,
+      Vk2 + DTMF_FREQUENCY_NUMBER, Dial, T + DTMF_FREQUENCY_NUMBER,
+      Tables.magnitude_shift);
+
+  return DTMF_finish_detection(R, T, Row, Column, Dial, stats, RowEnergy,
+                               ColumnEnergy);
+}
+
+//-----------------------------------------------------------------
+// The magnitudes of Count coefficients from First over the window of a
+// sliding detector, from the float state of its hops: the recurrences are
+// linear, so their state over the window is the sum of the state of each hop
+// carried over the hops that follow it.  The sum is taken in double, so that
+// it stays as close to the float recurrences over the whole window as they
+// are to exact.  Hops are only filtered here, the first time a window that
+// holds them needs them.
+static void window_magnitudes(const DtmfWindowHops &Hops, unsigned First,
+                              unsigned Count, int32_t Shift,
+                              int32_t Magnitudes[], int32_t MagnitudeShift) {
+  double Prev[COEFF_NUMBER] = {0}, PrevPrev[COEFF_NUMBER] = {0};
+  for (int hh = 0, hop = Hops.oldest; hh < Hops.count; ++hh) {
+    float *Vk1 = Hops.vk1 + hop * DTMF_COEFF_COUNT + First;
+    float *Vk2 = Hops.vk2 + hop * DTMF_COEFF_COUNT + First;
+    if (Hops.filtered[hop] < First + Count) {
+      std::fill(Vk1, Vk1 + Count, 0.0f);
+      std::fill(Vk2, Vk2 + Count, 0.0f);
+      goertzel_advance_float(Hops.koeffs + First, Count,
+                             Hops.samples + hop * Hops.hop_size, Hops.hop_size,
+                             Vk1, Vk2);
+      Hops.filtered[hop] = static_cast<uint8_t>(First + Count);
     }
+    if (++hop == Hops.count)
+      hop = 0;
+
+    // The newest hop is carried over none.
+    const double *P0 = Hops.propagators +
+                       (Hops.count - 1 - hh) * 4 * DTMF_COEFF_COUNT + First;
+    const double *P1 = P0 + DTMF_COEFF_COUNT;
+    const double *P2 = P1 + DTMF_COEFF_COUNT;
+    const double *P3 = P2 + DTMF_COEFF_COUNT;
+    for (unsigned kk = 0; kk < Count; ++kk) {
+      Prev[kk] += P0[kk] * Vk1[kk] + P1[kk] * Vk2[kk];
+      PrevPrev[kk] += P2[kk] * Vk1[kk] + P3[kk] * Vk2[kk];
+    }
+  }
+
+  float Vk1[COEFF_NUMBER], Vk2[COEFF_NUMBER];
+  for (unsigned kk = 0; kk < Count; ++kk) {
+    Vk1[kk] = static_cast<float>(Prev[kk]);
+    Vk2[kk] = static_cast<float>(PrevPrev[kk]);
+  }
+  goertzel_state_magnitudes_float(Hops.koeffs + First, Count, Vk1, Vk2, Shift,
+                                  Magnitudes, MagnitudeShift);
+}
+
+// DTMF_detection for a window of a sliding detector.  AbsSum and Peak are as
+// in DTMF_detection, for the whole window.  The magnitudes are those of
+// window_magnitudes, for the DTMF frequencies, then the others if the first
+// stage of the decision passes, as when staging with DTMF_BACKEND_FLOAT.
+template <class Rules>
+char DTMF_window_detection(const DtmfRateTables &Tables,
+                           const DtmfDetectorConfig &Config, int32_t AbsSum,
+                           int32_t Peak, const DtmfWindowHops &Hops,
+                           DtmfDetectorStats *stats, int32_t *RowEnergy,
+                           int32_t *ColumnEnergy) {
+  const Rules R(Config);
+  int32_t T[COEFF_NUMBER];
+
+  ++stats->stages.batches;
+
+  // Quick check for silence by calculate average magnitude
+  if (AbsSum / Tables.batch_size < R.power_threshold()) {
+    ++stats->stages.silent;
+    return ' ';
+  }
+
+  int32_t Dial = DTMF_normalization_shift(AbsSum, Peak);
+
+  int32_t Row, Column;
+  window_magnitudes(Hops, 0, DTMF_FREQUENCY_NUMBER, Dial, T,
+                    Tables.magnitude_shift);
+  DtmfRejectReason Reason;
+  if (!check_dial_tones(R, T, &Row, &Column, &Reason)) {
+    ++stats->stages.dial_tones_rejected;
+    count_rejection(stats, Reason);
+    return ' ';
   }
 
-  // Frequency detection
-  goertzel_filter(CONSTANTS[0], CONSTANTS[1], internalArray, &T[0], &T[1],
-                  DTMF_DETECTION_BATCH_SIZE);
-  goertzel_filter(CONSTANTS[2], CONSTANTS[3], internalArray, &T[2], &T[3],
-                  DTMF_DETECTION_BATCH_SIZE);
-  goertzel_filter(CONSTANTS[4], CONSTANTS[5], internalArray, &T[4], &T[5],
-                  DTMF_DETECTION_BATCH_SIZE);
-  goertzel_filter(CONSTANTS[6], CONSTANTS[7], internalArray, &T[6], &T[7],
-                  DTMF_DETECTION_BATCH_SIZE);
-  goertzel_filter(CONSTANTS[8], CONSTANTS[9], internalArray, &T[8], &T[9],
-                  DTMF_DETECTION_BATCH_SIZE);
-  goertzel_filter(CONSTANTS[10], CONSTANTS[11], internalArray, &T[10], &T[11],
-                  DTMF_DETECTION_BATCH_SIZE);
-  goertzel_filter(CONSTANTS[12], CONSTANTS[13], internalArray, &T[12], &T[13],
-                  DTMF_DETECTION_BATCH_SIZE);
-  goertzel_filter(CONSTANTS[14], CONSTANTS[15], internalArray, &T[14], &T[15],
-                  DTMF_DETECTION_BATCH_SIZE);
-  goertzel_filter(CONSTANTS[16], CONSTANTS[17], internalArray, &T[16], &T[17],
-                  DTMF_DETECTION_BATCH_SIZE);
+  window_magnitudes(Hops, DTMF_FREQUENCY_NUMBER,
+                    COEFF_NUMBER - DTMF_FREQUENCY_NUMBER, Dial,
+                    T + DTMF_FREQUENCY_NUMBER, Tables.magnitude_shift);
 
+  return DTMF_finish_detection(R, T, Row, Column, Dial, stats, RowEnergy,
+                               ColumnEnergy);
+}
+
+// The last stage of DTMF_detection, once all COEFF_NUMBER magnitudes are in
+// T.  Dial is the normalization shift of the batch.
+template <class Rules>
+static char DTMF_finish_detection(const Rules &R, int32_t T[], int32_t Row,
+                                  int32_t Column, int32_t Dial,
+                                  DtmfDetectorStats *stats,
+                                  int32_t *RowEnergy, int32_t *ColumnEnergy) {
 #if DEBUG
-  for (ii = 0; ii < COEFF_NUMBER; ++ii)
+  for (unsigned ii = 0; ii < COEFF_NUMBER; ++ii)
     printf("%d ", T[ii]);
   printf("\n");
 #endif
 
+  DtmfRejectReason Reason = DTMF_REJECT_REASON_COUNT;
+  char dial_char = check_harmonics(R, T, Row, Column, &Reason);
+  if (dial_char == ' ') {
+    ++stats->stages.harmonics_rejected;
+    count_rejection(stats, Reason);
+  } else {
+    ++stats->stages.detected;
+    // Normalization scaled the samples by 2**Dial, and the magnitudes by the
+    // square of that.
+    *RowEnergy = T[Row] >> (2 * Dial);
+    *ColumnEnergy = T[Column] >> (2 * Dial);
+  }
+  return dial_char;
+}
+
+// Stores Why to Reason, if given; for the checks to return with.
+static inline void reject(DtmfRejectReason *Reason, DtmfRejectReason Why) {
+  if (Reason)
+    *Reason = Why;
+}
+
+// The push button of each max row and max column, the columns counted from
+// the first column frequency (T[4]).
+static constexpr char BUTTONS[4][4] = {{'1', '2', '3', 'A'},
+                                       {'4', '5', '6', 'B'},
+                                       {'7', '8', '9', 'C'},
+                                       {'*', '0', '#', 'D'}};
+
+// True if Strong / Weak < Ratio, for Strong > 0 and Weak != 0, without the
+// divide.  For Weak > 0 the quotient is rounded down, so it is below the
+// integer Ratio exactly when Strong is below Ratio * Weak.  Weak can also be
+// negative, since the fixed-point magnitudes wrap around (as can Sum in
+// check_harmonics); the quotient is then -(Strong / -Weak) rounded down, below
+// Ratio exactly when Strong is at least (Ratio - 1) * Weak.  The products are
+// taken in 64 bits so that they cannot overflow.
+static inline bool below_ratio(int32_t Strong, int32_t Weak, int32_t Ratio) {
+  const int64_t Bound =
+      static_cast<int64_t>(Weak) * (Weak > 0 ? Ratio : Ratio - 1);
+  return Weak > 0 ? Strong < Bound : Strong >= Bound;
+}
+
+//-----------------------------------------------------------------
+// Check the max row and max column tones against the other dial tones
+// T[First] to T[Last - 1], with zeros replaced by ones.  Returns false if
+// the relations to any of them are less then threshold.
+//
+// Each bin is checked without branching on the others, so that the loop can
+// be vectorized.
+template <class Rules>
+static inline bool other_dial_tones_check(const Rules &R, const int32_t T[],
+                                          unsigned First, unsigned Last,
+                                          int32_t Row, int32_t Column) {
+  const int32_t RowValue = T[Row], ColumnValue = T[Column];
+  const int32_t Ratio = R.dial_tone_ratio();
+  // Column == 4 corresponds to 1176Hz.
+  // TODO: what is so special about this frequency?
+  const int32_t ColumnRatio = Column != 4 ? Ratio : Ratio / 3;
+  bool Failed = false;
+  for (unsigned ii = First; ii < Last; ++ii) {
+    const int32_t Other = T[ii] ? T[ii] : 1;
+    // The max row and max column themselves, and any other tone exactly as
+    // strong, are skipped.
+    Failed |= (Other != ColumnValue) & (Other != RowValue) &
+              (below_ratio(RowValue, Other, Ratio) |
+               below_ratio(ColumnValue, Other, ColumnRatio));
+  }
+  return !Failed;
+}
+
+//-----------------------------------------------------------------
+// First stage of the decision, which only needs the magnitudes of the 8 DTMF
+// frequencies (T[0] to T[7]).  Every check that does not involve the other 10
+// frequencies is made here; each of them can only reject the batch, so
+// running them before the rest leaves the final decision unchanged.
+template <class Rules>
+static bool check_dial_tones(const Rules &R, const int32_t T[], int32_t *pRow,
+                             int32_t *pColumn, DtmfRejectReason *Reason) {
   int32_t Row = 0;
   int32_t Temp = 0;
   // Row      Index of the maximum row frequency in T
@@ -339,6 +1572,53 @@ char DTMF_detection(const int16_t short_array_samples[]) {
     }
   }
 
+  // The second stage divides the max row and max column by an average that
+  // is never less than 1, so they must be at least as large as the threshold.
+  // This also means that T[Row] and T[Column] are never zero below.
+  if (T[Row] < R.dial_tone_ratio() || T[Column] < R.dial_tone_ratio()) {
+    reject(Reason, DTMF_REJECT_WEAK);
+    return false;
+  }
+
+  // Next, check if the volume of the row and column frequencies
+  // is similar.  If they are different, then they aren't part of
+  // the same tone.
+  //
+  // In the literature, this is known as "twist".
+  // If relations max colum to max row is large then the twist limit then
+  // return (4 by default)
+  if (R.row_too_weak(T[Row], T[Column])) {
+    reject(Reason, DTMF_REJECT_TWIST);
+    return false;
+  }
+  // If relations max row to max colum is large then the reverse twist limit
+  // then return (about 2.7 by default)
+  // The reason why the twist calculations aren't symmetric is that the
+  // allowed ratios for normal and reverse twist are different.
+  if (R.column_too_weak(T[Row], T[Column])) {
+    reject(Reason, DTMF_REJECT_REVERSE_TWIST);
+    return false;
+  }
+
+  // If relations max row and max column tones to other dial tones are
+  // less then threshold then return
+  if (!other_dial_tones_check(R, T, 0, 8, Row, Column)) {
+    reject(Reason, DTMF_REJECT_OTHER_DIAL_TONE);
+    return false;
+  }
+
+  *pRow = Row, *pColumn = Column;
+  return true;
+}
+
+//-----------------------------------------------------------------
+// Second stage of the decision, for batches that passed the first one.
+// Needs all COEFF_NUMBER magnitudes.
+template <class Rules>
+static char check_harmonics(const Rules &R, const int32_t T[], int32_t Row,
+                            int32_t Column, DtmfRejectReason *Reason) {
+  unsigned ii;
+
   int32_t Sum = 0;
   // Find average value dial tones without max row and max column
   for (ii = 0; ii < 10; ii++) {
@@ -357,134 +1637,172 @@ char DTMF_detection(const int16_t short_array_samples[]) {
   // are less then threshold then return
   // This means the tones are too quiet compared to the other, non-max
   // DTMF frequencies.
-  if (T[Row] / Sum < dialTonesToOhersDialTones)
+  if (below_ratio(T[Row], Sum, R.dial_tone_ratio()) ||
+      below_ratio(T[Column], Sum, R.dial_tone_ratio())) {
+    reject(Reason, DTMF_REJECT_DIAL_TONE_RATIO);
     return ' ';
-  if (T[Column] / Sum < dialTonesToOhersDialTones)
-    return ' ';
-
-  // Next, check if the volume of the row and column frequencies
-  // is similar.  If they are different, then they aren't part of
-  // the same tone.
-  //
-  // In the literature, this is known as "twist".
-  // If relations max colum to max row is large then 4 then return
-  if (T[Row] < (T[Column] >> 2))
-    return ' ';
-  // If relations max colum to max row is large then 4 then return
-  // The reason why the twist calculations aren't symmetric is that the
-  // allowed ratios for normal and reverse twist are different.
-  if (T[Column] < ((T[Row] >> 1) - (T[Row] >> 3)))
-    return ' ';
-
-  // N.B. looks like avoiding a divide by zero.
-  for (ii = 0; ii < COEFF_NUMBER; ii++)
-    if (T[ii] == 0)
-      T[ii] = 1;
+  }
 
   // If relations max row and max column to all other tones are less then
   // threshold then return
-  // Check for the presence of strong harmonics.
-  for (ii = 10; ii < COEFF_NUMBER; ii++) {
-    if (T[Row] / T[ii] < dialTonesToOhersTones)
-      return ' ';
-    if (T[Column] / T[ii] < dialTonesToOhersTones)
-      return ' ';
+  // Check for the presence of strong harmonics.  Whatever the harmonic, the
+  // weaker of the max row and max column fails whenever the stronger does,
+  // so only the weaker one needs checking.
+  const int32_t Weaker = std::min(T[Row], T[Column]);
+  bool Failed = false;
+  for (ii = 10; ii < COEFF_NUMBER; ii++)
+    Failed |= below_ratio(Weaker, T[ii] ? T[ii] : 1, R.harmonic_ratio());
+  if (Failed) {
+    reject(Reason, DTMF_REJECT_HARMONIC);
+    return ' ';
   }
 
-  // If relations max row and max column tones to other dial tones are
-  // less then threshold then return
-  for (ii = 0; ii < 10; ii++) {
-    // TODO:
-    // The next two nested if's can be collapsed into a single
-    // if-statement.  Basically, he's checking that the current
-    // tone is NOT the maximum tone.
-    //
-    // A simpler check would have been (ii != Column && ii != Row)
-    //
-    if (T[ii] != T[Column]) {
-      if (T[ii] != T[Row]) {
-        if (T[Row] / T[ii] < dialTonesToOhersDialTones)
-          return ' ';
-        if (Column != 4) {
-          // Column == 4 corresponds to 1176Hz.
-          // TODO: what is so special about this frequency?
-          if (T[Column] / T[ii] < dialTonesToOhersDialTones)
-            return ' ';
-        } else {
-          if (T[Column] / T[ii] < (dialTonesToOhersDialTones / 3))
-            return ' ';
-        }
-      }
-    }
+  // The remaining other dial tones (the first 8 were checked by
+  // DTMF_check_dial_tones).
+  if (!other_dial_tones_check(R, T, 8, 10, Row, Column)) {
+    reject(Reason, DTMF_REJECT_OTHER_DIAL_TONE);
+    return ' ';
   }
 
   // We are choosed a push button
   // Determine the tone based on the row and column frequencies.
-  switch (Row) {
-  case 0:
-    switch (Column) {
-    case 4:
-      return_value = '1';
-      break;
-    case 5:
-      return_value = '2';
-      break;
-    case 6:
-      return_value = '3';
-      break;
-    case 7:
-      return_value = 'A';
-      break;
-    };
-    break;
-  case 1:
-    switch (Column) {
-    case 4:
-      return_value = '4';
-      break;
-    case 5:
-      return_value = '5';
-      break;
-    case 6:
-      return_value = '6';
-      break;
-    case 7:
-      return_value = 'B';
-      break;
-    };
-    break;
-  case 2:
-    switch (Column) {
-    case 4:
-      return_value = '7';
-      break;
-    case 5:
-      return_value = '8';
-      break;
-    case 6:
-      return_value = '9';
-      break;
-    case 7:
-      return_value = 'C';
-      break;
-    };
-    break;
-  case 3:
-    switch (Column) {
-    case 4:
-      return_value = '*';
-      break;
-    case 5:
-      return_value = '0';
-      break;
-    case 6:
-      return_value = '#';
-      break;
-    case 7:
-      return_value = 'D';
-      break;
+  return BUTTONS[Row][Column - 4];
+}
+
+bool DTMF_check_dial_tones(const int32_t T[], int32_t *Row, int32_t *Column,
+                           DtmfRejectReason *Reason) {
+  return check_dial_tones(DtmfDefaultRules(), T, Row, Column, Reason);
+}
+
+#ifdef DTMF_SSE2
+// Mask ? A : B, lane by lane.
+static inline __m128i select_sse2(__m128i Mask, __m128i A, __m128i B) {
+  return _mm_or_si128(_mm_and_si128(Mask, A), _mm_andnot_si128(Mask, B));
+}
+
+// The low 32 bits of A * B, lane by lane; SSE2 has no _mm_mullo_epi32.
+static inline __m128i mullo_sse2(__m128i A, __m128i B) {
+  __m128i Even = _mm_mul_epu32(A, B);
+  __m128i Odd = _mm_mul_epu32(_mm_srli_epi64(A, 32), _mm_srli_epi64(B, 32));
+  return _mm_unpacklo_epi32(_mm_shuffle_epi32(Even, _MM_SHUFFLE(0, 0, 2, 0)),
+                            _mm_shuffle_epi32(Odd, _MM_SHUFFLE(0, 0, 2, 0)));
+}
+
+// below_ratio for 4 lanes, in 32 bits: Ratio and the Weak beyond which its
+// products with Ratio (for Weak > 0) or Ratio - 1 (for Weak < 0) would leave
+// 32 bits are given per lane.  Those products are out of reach of any Strong,
+// so the wrapped ones are overridden.
+struct DtmfLaneRatio {
+  __m128i positive, negative, max_weak, min_weak;
+
+  explicit DtmfLaneRatio(int32_t Ratio)
+      : positive(_mm_set1_epi32(Ratio)), negative(_mm_set1_epi32(Ratio - 1)),
+        max_weak(_mm_set1_epi32(INT32_MAX / Ratio)),
+        min_weak(_mm_set1_epi32(Ratio > 1 ? INT32_MIN / (Ratio - 1)
+                                          : INT32_MIN)) {}
+
+  // Mask ? A : B.
+  DtmfLaneRatio(__m128i Mask, const DtmfLaneRatio &A, const DtmfLaneRatio &B)
+      : positive(select_sse2(Mask, A.positive, B.positive)),
+        negative(select_sse2(Mask, A.negative, B.negative)),
+        max_weak(select_sse2(Mask, A.max_weak, B.max_weak)),
+        min_weak(select_sse2(Mask, A.min_weak, B.min_weak)) {}
+};
+
+static inline __m128i below_ratio_sse2(__m128i Strong, __m128i Weak,
+                                       const DtmfLaneRatio &Ratio) {
+  const __m128i Positive = _mm_cmpgt_epi32(Weak, _mm_setzero_si128());
+  const __m128i Bound = mullo_sse2(
+      Weak, select_sse2(Positive, Ratio.positive, Ratio.negative));
+  const __m128i Below = _mm_cmplt_epi32(Strong, Bound);
+  const __m128i PositiveBelow =
+      _mm_or_si128(_mm_cmpgt_epi32(Weak, Ratio.max_weak), Below);
+  const __m128i NegativeBelow = _mm_or_si128(
+      _mm_cmplt_epi32(Weak, Ratio.min_weak),
+      _mm_andnot_si128(Below, _mm_set1_epi32(-1)));
+  return select_sse2(Positive, PositiveBelow, NegativeBelow);
+}
+
+// The largest of T[First] to T[First + 3] above 0, found as check_dial_tones
+// does, for 4 lanes: its index goes to Index, and it (or T[First], if none is
+// above 0) to Value.
+static inline void max_tone_sse2(const __m128i T[], int First, __m128i *Index,
+                                 __m128i *Value) {
+  const __m128i Zero = _mm_setzero_si128();
+  __m128i Max = Zero;
+  *Index = _mm_set1_epi32(First);
+  for (int ii = First; ii < First + 4; ++ii) {
+    __m128i Larger = _mm_cmpgt_epi32(T[ii], Max);
+    *Index = select_sse2(Larger, _mm_set1_epi32(ii), *Index);
+    Max = select_sse2(Larger, T[ii], Max);
+  }
+  *Value = select_sse2(_mm_cmpgt_epi32(Max, Zero), Max, T[First]);
+}
+#endif
+
+void DTMF_check_dial_tones_lanes(const int32_t Magnitudes[], uint32_t LANES,
+                                 uint32_t COUNT, int32_t Row[],
+                                 int32_t Column[], bool Passed[]) {
+  const DtmfDefaultRules R;
+  uint32_t jj = 0;
+#ifdef DTMF_SSE2
+  // check_dial_tones for 4 channels at once, with every check made for every
+  // lane; a check can only reject, so the lanes that pass are the same.
+  const __m128i Zero = _mm_setzero_si128();
+  const DtmfLaneRatio RowRatio(R.dial_tone_ratio());
+  const DtmfLaneRatio OtherColumnRatio(R.dial_tone_ratio() / 3);
+  for (; jj + 4 <= COUNT; jj += 4) {
+    __m128i T[DTMF_FREQUENCY_NUMBER];
+    for (unsigned kk = 0; kk < DTMF_FREQUENCY_NUMBER; ++kk)
+      T[kk] = _mm_loadu_si128(
+          reinterpret_cast<const __m128i *>(Magnitudes + kk * LANES + jj));
+
+    __m128i RowIndex, RowValue, ColumnIndex, ColumnValue;
+    max_tone_sse2(T, 0, &RowIndex, &RowValue);
+    max_tone_sse2(T, 4, &ColumnIndex, &ColumnValue);
+
+    // DTMF_REJECT_WEAK, and the twists of the default rules.
+    const __m128i Ratio = _mm_set1_epi32(R.dial_tone_ratio());
+    __m128i Failed = _mm_or_si128(_mm_cmplt_epi32(RowValue, Ratio),
+                                  _mm_cmplt_epi32(ColumnValue, Ratio));
+    Failed = _mm_or_si128(
+        Failed, _mm_cmplt_epi32(RowValue, _mm_srai_epi32(ColumnValue, 2)));
+    Failed = _mm_or_si128(
+        Failed, _mm_cmplt_epi32(ColumnValue,
+                                _mm_sub_epi32(_mm_srai_epi32(RowValue, 1),
+                                              _mm_srai_epi32(RowValue, 3))));
+
+    // other_dial_tones_check over the 8 DTMF frequencies.
+    const DtmfLaneRatio ColumnRatio(
+        _mm_cmpeq_epi32(ColumnIndex, _mm_set1_epi32(4)), OtherColumnRatio,
+        RowRatio);
+    for (unsigned ii = 0; ii < DTMF_FREQUENCY_NUMBER; ++ii) {
+      const __m128i Other = select_sse2(_mm_cmpeq_epi32(T[ii], Zero),
+                                        _mm_set1_epi32(1), T[ii]);
+      const __m128i Same = _mm_or_si128(_mm_cmpeq_epi32(Other, ColumnValue),
+                                        _mm_cmpeq_epi32(Other, RowValue));
+      const __m128i Below =
+          _mm_or_si128(below_ratio_sse2(RowValue, Other, RowRatio),
+                       below_ratio_sse2(ColumnValue, Other, ColumnRatio));
+      Failed = _mm_or_si128(Failed, _mm_andnot_si128(Same, Below));
     }
+
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(Row + jj), RowIndex);
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(Column + jj), ColumnIndex);
+    const int FailedMask = _mm_movemask_ps(_mm_castsi128_ps(Failed));
+    for (int ll = 0; ll < 4; ++ll)
+      Passed[jj + ll] = !(FailedMask & (1 << ll));
   }
+#endif
+  for (; jj < COUNT; ++jj) {
+    int32_t T[DTMF_FREQUENCY_NUMBER];
+    for (unsigned kk = 0; kk < DTMF_FREQUENCY_NUMBER; ++kk)
+      T[kk] = Magnitudes[kk * LANES + jj];
+    Passed[jj] = check_dial_tones(R, T, &Row[jj], &Column[jj], nullptr);
+  }
+}
 
-  return return_value;
+char DTMF_check_harmonics(const int32_t T[], int32_t Row, int32_t Column,
+                          DtmfRejectReason *Reason) {
+  return check_harmonics(DtmfDefaultRules(), T, Row, Column, Reason);
 }
@@ -0,0 +1,275 @@
+//
+// A DTMF detector for many channels that advance in lock step.
+//
+
+#include "DtmfDetectorBank.hpp"
+#include "DtmfDetection.hpp"
+#include "Goertzel.hpp"
+#include <algorithm>
+#include <cassert>
+#include <cstdlib>
+
+#if defined(__SSE2__) && !defined(DTMF_NO_SIMD)
+#define DTMF_SSE2 1
+#include <emmintrin.h>
+#endif
+
+DtmfDetectorBank::DtmfDetectorBank(int channel_count)
+    : channel_count_(channel_count),
+      lane_count_((channel_count + GOERTZEL_CHANNEL_ALIGN - 1) /
+                  GOERTZEL_CHANNEL_ALIGN * GOERTZEL_CHANNEL_ALIGN),
+      buf_samples_(DTMF_DETECTION_BATCH_SIZE * channel_count),
+      buf_sample_count_(0), prev_dial_(channel_count, ' '),
+      sum_(channel_count), peak_(channel_count), dial_(channel_count),
+      active_(channel_count), lane_passed_(new bool[channel_count]),
+      passed_(channel_count), row_(channel_count), column_(channel_count),
+      T_(channel_count * COEFF_NUMBER),
+      normalized_(DTMF_DETECTION_BATCH_SIZE * lane_count_),
+      normalized_passed_(DTMF_DETECTION_BATCH_SIZE * lane_count_),
+      magnitudes_(COEFF_NUMBER * lane_count_), channels_(channel_count) {
+  assert(channel_count > 0);
+  ClearStageCounters();
+}
+
+void DtmfDetectorBank::ClearStageCounters() {
+  stage_counters_ = DtmfStageCounters();
+}
+
+DtmfDetectorBank::~DtmfDetectorBank() {}
+
+void DtmfDetectorBank::DetectInterleaved(const int16_t *frames,
+                                         int frame_count) {
+  if (buf_sample_count_ != 0) {
+    // Complete the batch started by a previous call.
+    int count_to_copy =
+        std::min(frame_count, DTMF_DETECTION_BATCH_SIZE - buf_sample_count_);
+    std::copy(frames, frames + count_to_copy * channel_count_,
+              &buf_samples_[buf_sample_count_ * channel_count_]);
+    buf_sample_count_ += count_to_copy;
+    frames += count_to_copy * channel_count_;
+    frame_count -= count_to_copy;
+    if (buf_sample_count_ < DTMF_DETECTION_BATCH_SIZE)
+      return;
+
+    ProcessInterleavedBatch(&buf_samples_[0]);
+    buf_sample_count_ = 0;
+  }
+
+  // Whole batches are processed straight from the input.
+  while (frame_count >= DTMF_DETECTION_BATCH_SIZE) {
+    ProcessInterleavedBatch(frames);
+    frames += DTMF_DETECTION_BATCH_SIZE * channel_count_;
+    frame_count -= DTMF_DETECTION_BATCH_SIZE;
+  }
+
+  std::copy(frames, frames + frame_count * channel_count_, &buf_samples_[0]);
+  buf_sample_count_ = frame_count;
+}
+
+// Interleaves count frames of planar channels, from offset on, into
+// buf_samples_.
+void DtmfDetectorBank::StagePlanar(const int16_t *const *channels, int offset,
+                                   int count) {
+  for (int ch = 0; ch < channel_count_; ++ch) {
+    const int16_t *src = channels[ch] + offset;
+    int16_t *dst = &buf_samples_[buf_sample_count_ * channel_count_ + ch];
+    for (int ii = 0; ii < count; ++ii)
+      dst[ii * channel_count_] = src[ii];
+  }
+  buf_sample_count_ += count;
+}
+
+void DtmfDetectorBank::DetectPlanar(const int16_t *const *channels,
+                                    int frame_count) {
+  int offset = 0;
+  if (buf_sample_count_ != 0) {
+    // Complete the batch started by a previous call, in buf_samples_.
+    offset =
+        std::min(frame_count, DTMF_DETECTION_BATCH_SIZE - buf_sample_count_);
+    StagePlanar(channels, 0, offset);
+    if (buf_sample_count_ < DTMF_DETECTION_BATCH_SIZE)
+      return;
+
+    ProcessInterleavedBatch(&buf_samples_[0]);
+    buf_sample_count_ = 0;
+  }
+
+  // Whole batches are read in place, a channel at a time.
+  while (frame_count - offset >= DTMF_DETECTION_BATCH_SIZE) {
+    for (int ch = 0; ch < channel_count_; ++ch)
+      channels_[ch] = channels[ch] + offset;
+    ProcessBatch(&channels_[0], 1);
+    offset += DTMF_DETECTION_BATCH_SIZE;
+  }
+
+  StagePlanar(channels, offset, frame_count - offset);
+}
+
+void DtmfDetectorBank::ProcessInterleavedBatch(const int16_t *frames) {
+  for (int ch = 0; ch < channel_count_; ++ch)
+    channels_[ch] = frames + ch;
+  ProcessBatch(&channels_[0], channel_count_);
+}
+
+// Sums the sample magnitudes, and finds the peaks, of COUNT interleaved
+// frames of CHANNEL_COUNT channels, all channels of a frame at once.
+static void channel_magnitudes(const int16_t frames[], int CHANNEL_COUNT,
+                               int COUNT, int32_t AbsSum[], int32_t Peak[]) {
+  int ch = 0;
+#ifdef DTMF_SSE2
+  // 8 channels per vector; as in batch_magnitudes, |x| is taken as
+  // (x ^ (x >> 31)) - (x >> 31), widened to 32 bits before it is summed.
+  for (; ch + 8 <= CHANNEL_COUNT; ch += 8) {
+    const __m128i Zero = _mm_setzero_si128();
+    __m128i SumLow = Zero, SumHigh = Zero, Max = Zero;
+    const int16_t *row = frames + ch;
+    for (int ii = 0; ii < COUNT; ++ii, row += CHANNEL_COUNT) {
+      __m128i Sample = _mm_loadu_si128(reinterpret_cast<const __m128i *>(row));
+      __m128i Sign = _mm_srai_epi16(Sample, 15);
+      __m128i Magnitude = _mm_xor_si128(Sample, Sign);
+      Max = _mm_max_epi16(Max, Magnitude);
+      SumLow = _mm_sub_epi32(
+          _mm_add_epi32(SumLow, _mm_unpacklo_epi16(Magnitude, Zero)),
+          _mm_unpacklo_epi16(Sign, Sign));
+      SumHigh = _mm_sub_epi32(
+          _mm_add_epi32(SumHigh, _mm_unpackhi_epi16(Magnitude, Zero)),
+          _mm_unpackhi_epi16(Sign, Sign));
+    }
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(AbsSum + ch), SumLow);
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(AbsSum + ch + 4), SumHigh);
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(Peak + ch),
+                     _mm_unpacklo_epi16(Max, Zero));
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(Peak + ch + 4),
+                     _mm_unpackhi_epi16(Max, Zero));
+  }
+#endif
+  for (; ch < CHANNEL_COUNT; ++ch) {
+    int32_t Sum = 0, Max = 0;
+    const int16_t *sample = frames + ch;
+    for (int ii = 0; ii < COUNT; ++ii, sample += CHANNEL_COUNT) {
+      int32_t sample32 = *sample;
+      Sum += abs(sample32);
+      Max = std::max(Max, sample32 ^ (sample32 >> 31));
+    }
+    AbsSum[ch] = Sum, Peak[ch] = Max;
+  }
+}
+
+// The same steps as DTMF_detection, each one done for every channel before
+// moving on to the next.
+void DtmfDetectorBank::ProcessBatch(const int16_t *const *channels,
+                                    int stride) {
+  int32_t *sum = &sum_[0];
+  int32_t *peak = &peak_[0];
+  int ch, ii;
+
+  // Quick check for silence by calculate average magnitude.  The same sweep
+  // finds the peak used for normalization, see DTMF_normalization_shift.
+  // Interleaved frames are swept a frame, and so all channels, at a time;
+  // planar channels one channel at a time.
+  if (stride == 1) {
+    for (ch = 0; ch < channel_count_; ++ch)
+      DTMF_batch_magnitudes(channels[ch], DTMF_DETECTION_BATCH_SIZE, &sum[ch],
+                            &peak[ch]);
+  } else {
+    channel_magnitudes(channels[0], channel_count_, DTMF_DETECTION_BATCH_SIZE,
+                       sum, peak);
+  }
+
+  int active_count = 0;
+  for (ch = 0; ch < channel_count_; ++ch) {
+    dial_[ch] = ' ';
+    if (sum[ch] / DTMF_DETECTION_BATCH_SIZE >= powerThreshold)
+      active_[active_count++] = ch;
+  }
+  stage_counters_.batches += channel_count_;
+  stage_counters_.silent += channel_count_ - active_count;
+
+  if (active_count != 0) {
+    int lanes = (active_count + GOERTZEL_CHANNEL_ALIGN - 1) /
+                GOERTZEL_CHANNEL_ALIGN * GOERTZEL_CHANNEL_ALIGN;
+
+    // Normalization.  Only the active channels are copied, next to each
+    // other, and the remaining lanes are padded with silence.
+    for (int jj = 0; jj < active_count; ++jj) {
+      ch = active_[jj];
+      const int16_t *samples = channels[ch];
+      int32_t Dial = DTMF_normalization_shift(sum[ch], peak[ch]);
+      for (ii = 0; ii < DTMF_DETECTION_BATCH_SIZE; ++ii) {
+        int32_t sample32 = samples[ii * stride];
+        normalized_[ii * lanes + jj] =
+            static_cast<int16_t>(sample32 * (1 << Dial));
+      }
+    }
+    for (ii = 0; ii < DTMF_DETECTION_BATCH_SIZE; ++ii) {
+      int32_t *row = &normalized_[0] + ii * lanes;
+      std::fill(row + active_count, row + lanes, 0);
+    }
+
+    // Frequency detection, one channel per lane, in the same two stages as
+    // DTMF_detection.  First the DTMF frequencies only, and the checks that
+    // only need them, also one channel per lane.
+    goertzel_filter_channels(CONSTANTS, DTMF_FREQUENCY_NUMBER,
+                             &normalized_[0], lanes, DTMF_DETECTION_BATCH_SIZE,
+                             &magnitudes_[0]);
+    DTMF_check_dial_tones_lanes(&magnitudes_[0], lanes, active_count,
+                                &row_[0], &column_[0], &lane_passed_[0]);
+
+    int passed_count = 0;
+    for (int jj = 0; jj < active_count; ++jj) {
+      if (!lane_passed_[jj])
+        continue;
+      int32_t *T = &T_[passed_count * COEFF_NUMBER];
+      for (unsigned kk = 0; kk < DTMF_FREQUENCY_NUMBER; ++kk)
+        T[kk] = magnitudes_[kk * lanes + jj];
+      passed_[passed_count++] = jj;
+    }
+    stage_counters_.dial_tones_rejected += active_count - passed_count;
+
+    if (passed_count != 0) {
+      // Then the other frequencies, for the channels that are left.  Their
+      // normalized samples are packed next to each other once more.
+      int passed_lanes = (passed_count + GOERTZEL_CHANNEL_ALIGN - 1) /
+                         GOERTZEL_CHANNEL_ALIGN * GOERTZEL_CHANNEL_ALIGN;
+      for (ii = 0; ii < DTMF_DETECTION_BATCH_SIZE; ++ii) {
+        const int32_t *src = &normalized_[0] + ii * lanes;
+        int32_t *dst = &normalized_passed_[0] + ii * passed_lanes;
+        for (int kk = 0; kk < passed_count; ++kk)
+          dst[kk] = src[passed_[kk]];
+        std::fill(dst + passed_count, dst + passed_lanes, 0);
+      }
+
+      goertzel_filter_channels(
+          CONSTANTS + DTMF_FREQUENCY_NUMBER,
+          COEFF_NUMBER - DTMF_FREQUENCY_NUMBER, &normalized_passed_[0],
+          passed_lanes, DTMF_DETECTION_BATCH_SIZE, &magnitudes_[0]);
+
+      for (int kk = 0; kk < passed_count; ++kk) {
+        int32_t *T = &T_[kk * COEFF_NUMBER];
+        for (unsigned bb = DTMF_FREQUENCY_NUMBER; bb < COEFF_NUMBER; ++bb)
+          T[bb] = magnitudes_[(bb - DTMF_FREQUENCY_NUMBER) * passed_lanes + kk];
+        const int jj = passed_[kk];
+        char dial_char = DTMF_check_harmonics(T, row_[jj], column_[jj]);
+        if (dial_char == ' ')
+          ++stage_counters_.harmonics_rejected;
+        else
+          ++stage_counters_.detected;
+        dial_[active_[jj]] = dial_char;
+      }
+    }
+  }
+
+  for (ch = 0; ch < channel_count_; ++ch)
+    OnDetectedTone(ch, dial_[ch]);
+}
+
+void DtmfDetectorBank::OnDetectedTone(int channel, char dial_char) {
+  // Determine if we should register it as a new tone, or
+  // ignore it as a continuation of a previous tone.
+  if (dial_char != prev_dial_[channel] && dial_char != ' ') {
+    OnNewTone(channel, dial_char);
+  }
+
+  // Store the current tone.
+  prev_dial_[channel] = dial_char;
+}
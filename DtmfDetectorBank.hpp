@@ -0,0 +1,106 @@
+//
+// A DTMF detector for many channels that advance in lock step.
+//
+
+#ifndef DTMF_DETECTOR_BANK
+#define DTMF_DETECTOR_BANK
+
+#include <memory>
+#include <stdint.h>
+#include <vector>
+
+#include "DtmfDetector.hpp"
+
+// Detects DTMF tones in channel_count streams at once, e.g. all the legs
+// mixed by a media server.  The per-channel state is kept in
+// structure-of-arrays form and every batch of DTMF_DETECTION_BATCH_SIZE
+// frames is analysed for all channels together: the silence check sweeps
+// several channels per SIMD vector, and the Goertzel filters and the first
+// stage of the decision run with one channel per SIMD lane.  Channels that
+// are silent in a batch are left out of the Goertzel pass, and only those
+// that pass the first stage go on to the harmonics, one at a time.
+//
+// Each channel reports exactly the tones a DtmfDetector fed with that
+// channel's samples alone would report.
+class DtmfDetectorBank {
+public:
+  explicit DtmfDetectorBank(int channel_count);
+  virtual ~DtmfDetectorBank();
+
+  int channel_count() const { return channel_count_; }
+
+  // frames holds frame_count frames of channel_count interleaved samples.
+  void DetectInterleaved(const int16_t *frames, int frame_count);
+
+  // channels holds channel_count pointers to frame_count samples each.  Whole
+  // batches are read where they are; only a batch that straddles two calls
+  // is copied.
+  void DetectPlanar(const int16_t *const *channels, int frame_count);
+
+  // Counts every batch of every channel.
+  const DtmfStageCounters &GetStageCounters() const { return stage_counters_; }
+
+  void ClearStageCounters();
+
+protected:
+  virtual void OnNewTone(int channel, char dial_char) = 0;
+
+private:
+  int channel_count_;
+
+  // channel_count_ rounded up to a whole number of SIMD lanes.
+  int lane_count_;
+
+  // A single batch of interleaved frames, for input that does not arrive in
+  // whole batches.
+  std::vector<int16_t> buf_samples_;
+
+  // The number of frames in buf_samples_.
+  int buf_sample_count_;
+
+  // The tone detected in the previous batch, per channel.
+  std::vector<char> prev_dial_;
+
+  DtmfStageCounters stage_counters_;
+
+  // Scratch space for ProcessBatch, allocated once.
+  //
+  // sum_           Sum of the sample magnitudes, per channel.
+  // peak_          The largest sample ^ (sample >> 31), per channel.
+  // dial_          The tone detected in the current batch, per channel.
+  // active_        The channels that are not silent in the current batch.
+  // lane_passed_   Whether each active channel passed
+  //                DTMF_check_dial_tones_lanes.
+  // passed_        The active channels (indices into active_) that passed.
+  // row_, column_  The max row and column of each active channel.
+  // T_             The magnitudes of each channel in passed_.
+  // normalized_    Normalized samples of the active channels, frame by frame.
+  // normalized_passed_
+  //                Normalized samples of the channels in passed_.
+  // magnitudes_    Goertzel magnitudes straight from the kernel.
+  std::vector<int32_t> sum_;
+  std::vector<int32_t> peak_;
+  std::vector<char> dial_;
+  std::vector<int> active_;
+  std::unique_ptr<bool[]> lane_passed_;
+  std::vector<int> passed_;
+  std::vector<int32_t> row_;
+  std::vector<int32_t> column_;
+  std::vector<int32_t> T_;
+  std::vector<int32_t> normalized_;
+  std::vector<int32_t> normalized_passed_;
+  std::vector<int32_t> magnitudes_;
+
+  // The first sample of each channel in the batch being processed.
+  std::vector<const int16_t *> channels_;
+
+  void StagePlanar(const int16_t *const *channels, int offset, int count);
+  void ProcessInterleavedBatch(const int16_t *frames);
+  // Sample ii of channel ch is at channels[ch][ii * stride]: stride is 1 for
+  // planar input, and channel_count_ for interleaved frames, whose channels
+  // must then follow each other from channels[0].
+  void ProcessBatch(const int16_t *const *channels, int stride);
+  void OnDetectedTone(int channel, char dial_char);
+};
+
+#endif
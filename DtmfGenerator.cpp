@@ -7,6 +7,8 @@
 
 #include "DtmfGenerator.hpp"
 
+#include <cstring>
+
 // Multiplicaton of two fixed-point numbers
 static inline int32_t MPY48SR(int16_t o16, int32_t o32) {
   // http://stackoverflow.com/questions/12864216/why-perform-multiplication-in-this-way
@@ -38,10 +40,11 @@ static inline int32_t MPY48SR(int16_t o16, int32_t o32) {
 static void frequency_oscillator(int16_t Coeff0, int16_t Coeff1, int16_t y[],
                                  uint32_t COUNT, int32_t *y1_0, int32_t *y1_1,
                                  int32_t *y2_0, int32_t *y2_1) {
-  // the register keyword isn't really useful and achieves little.
+  // These used to be declared register, which isn't really useful, achieves
+  // little and is gone from C++17.
   // http://www.drdobbs.com/keywords-that-arent-or-comments-by-anoth/184403859
-  register int32_t Temp1_0, Temp1_1, Temp2_0, Temp2_1, Temp0, Temp1, Subject;
-  uint16_t ii;
+  int32_t Temp1_0, Temp1_1, Temp2_0, Temp2_1, Temp0, Temp1, Subject;
+  uint32_t ii;
 
   // Write the parameters to the registers.
   // As far as I can tell, using commas instead of the semicolon does not
@@ -80,6 +83,27 @@ static const int16_t TEMP_COEFF[8] = {
     9315   // 1633Hz
 };
 
+// The index of a push button in "123A456B789C*0#D", or -1 for anything else.
+static int dial_button_index(char button) {
+  static const char BUTTONS[] = "123A456B789C*0#D";
+  for (int ii = 0; ii < 16; ++ii)
+    if (BUTTONS[ii] == button)
+      return ii;
+  return -1;
+}
+
+bool dtmf_button_coefficients(char dial_char, int16_t *Row,
+                              int16_t *Column) {
+  int index = dial_button_index(dial_char);
+  if (index < 0) {
+    *Row = *Column = 0;
+    return false;
+  }
+  *Row = TEMP_COEFF[index / 4];
+  *Column = TEMP_COEFF[4 + index % 4];
+  return true;
+}
+
 // N.B. bit-shifting to the right corresponds to a multiplication by 8.
 // Determine the number of buffers each tone and silence should occupy.
 DtmfGenerator::DtmfGenerator(int32_t FrameSize, int32_t DurationPush,
@@ -104,138 +128,14 @@ void DtmfGenerator::dtmfGenerating(int16_t y[]) {
     // coefficients for it.  Otherwise, we're mid-tone, so we can
     // just use whatever is already set.
     if (countDurationPushButton == tempCountDurationPushButton) {
-      // N.B. y2_1 and y2_2 always seem to be 31000
-      switch (pushDialButtons[count]) {
-      case '1':
-        tempCoeff1 = TEMP_COEFF[0];
-        tempCoeff2 = TEMP_COEFF[4];
-        y1_1 = TEMP_COEFF[0];
-        y2_1 = 31000;
-        y1_2 = TEMP_COEFF[4];
-        y2_2 = 31000;
-        break;
-      case '2':
-        tempCoeff1 = TEMP_COEFF[0];
-        tempCoeff2 = TEMP_COEFF[5];
-        y1_1 = TEMP_COEFF[0];
-        y2_1 = 31000;
-        y1_2 = TEMP_COEFF[5];
-        y2_2 = 31000;
-        break;
-      case '3':
-        tempCoeff1 = TEMP_COEFF[0];
-        tempCoeff2 = TEMP_COEFF[6];
-        y1_1 = TEMP_COEFF[0];
-        y2_1 = 31000;
-        y1_2 = TEMP_COEFF[6];
-        y2_2 = 31000;
-        break;
-      case 'A':
-        tempCoeff1 = TEMP_COEFF[0];
-        tempCoeff2 = TEMP_COEFF[7];
-        y1_1 = TEMP_COEFF[0];
-        y2_1 = 31000;
-        y1_2 = TEMP_COEFF[7];
-        y2_2 = 31000;
-        break;
-      case '4':
-        tempCoeff1 = TEMP_COEFF[1];
-        tempCoeff2 = TEMP_COEFF[4];
-        y1_1 = TEMP_COEFF[1];
-        y2_1 = 31000;
-        y1_2 = TEMP_COEFF[4];
-        y2_2 = 31000;
-        break;
-      case '5':
-        tempCoeff1 = TEMP_COEFF[1];
-        tempCoeff2 = TEMP_COEFF[5];
-        y1_1 = TEMP_COEFF[1];
-        y2_1 = 31000;
-        y1_2 = TEMP_COEFF[5];
-        y2_2 = 31000;
-        break;
-      case '6':
-        tempCoeff1 = TEMP_COEFF[1];
-        tempCoeff2 = TEMP_COEFF[6];
-        y1_1 = TEMP_COEFF[1];
-        y2_1 = 31000;
-        y1_2 = TEMP_COEFF[6];
-        y2_2 = 31000;
-        break;
-      case 'B':
-        tempCoeff1 = TEMP_COEFF[1];
-        tempCoeff2 = TEMP_COEFF[7];
-        y1_1 = TEMP_COEFF[1];
-        y2_1 = 31000;
-        y1_2 = TEMP_COEFF[7];
-        y2_2 = 31000;
-        break;
-      case '7':
-        tempCoeff1 = TEMP_COEFF[2];
-        tempCoeff2 = TEMP_COEFF[4];
-        y1_1 = TEMP_COEFF[2];
-        y2_1 = 31000;
-        y1_2 = TEMP_COEFF[4];
-        y2_2 = 31000;
-        break;
-      case '8':
-        tempCoeff1 = TEMP_COEFF[2];
-        tempCoeff2 = TEMP_COEFF[5];
-        y1_1 = TEMP_COEFF[2];
-        y2_1 = 31000;
-        y1_2 = TEMP_COEFF[5];
-        y2_2 = 31000;
-        break;
-      case '9':
-        tempCoeff1 = TEMP_COEFF[2];
-        tempCoeff2 = TEMP_COEFF[6];
-        y1_1 = TEMP_COEFF[2];
-        y2_1 = 31000;
-        y1_2 = TEMP_COEFF[6];
-        y2_2 = 31000;
-        break;
-      case 'C':
-        tempCoeff1 = TEMP_COEFF[2];
-        tempCoeff2 = TEMP_COEFF[7];
-        y1_1 = TEMP_COEFF[2];
-        y2_1 = 31000;
-        y1_2 = TEMP_COEFF[7];
-        y2_2 = 31000;
-        break;
-      case '*':
-        tempCoeff1 = TEMP_COEFF[3];
-        tempCoeff2 = TEMP_COEFF[4];
-        y1_1 = TEMP_COEFF[3];
-        y2_1 = 31000;
-        y1_2 = TEMP_COEFF[4];
-        y2_2 = 31000;
-        break;
-      case '0':
-        tempCoeff1 = TEMP_COEFF[3];
-        tempCoeff2 = TEMP_COEFF[5];
-        y1_1 = TEMP_COEFF[3];
-        y2_1 = 31000;
-        y1_2 = TEMP_COEFF[5];
-        y2_2 = 31000;
-        break;
-      case '#':
-        tempCoeff1 = TEMP_COEFF[3];
-        tempCoeff2 = TEMP_COEFF[6];
-        y1_1 = TEMP_COEFF[3];
-        y2_1 = 31000;
-        y1_2 = TEMP_COEFF[6];
-        y2_2 = 31000;
-        break;
-      case 'D':
-        tempCoeff1 = TEMP_COEFF[3];
-        tempCoeff2 = TEMP_COEFF[7];
-        y1_1 = TEMP_COEFF[3];
-        y2_1 = 31000;
-        y1_2 = TEMP_COEFF[7];
-        y2_2 = 31000;
-        break;
-      default:
-        tempCoeff1 = tempCoeff2 = 0;
+      // N.B. y2_1 and y2_2 always start out as DTMF_OSCILLATOR_START
+      if (dtmf_button_coefficients(pushDialButtons[count], &tempCoeff1,
+                                   &tempCoeff2)) {
+        y1_1 = tempCoeff1;
+        y2_1 = DTMF_OSCILLATOR_START;
+        y1_2 = tempCoeff2;
+        y2_2 = DTMF_OSCILLATOR_START;
+      } else {
         y1_1 = 0;
         y2_1 = 0;
         y1_2 = 0;
@@ -312,3 +212,142 @@ DtmfGenerator::transmitNewDialButtonsArray(char dialButtonsArray[],
   readyFlag = 0;
   return 1;
 }
+
+// The stream generator only ever runs at the base rate, where 1 ms is 8
+// samples.
+static uint32_t ms_to_samples(int32_t Duration) {
+  return Duration > 0 ? static_cast<uint32_t>(Duration) << 3 : 0;
+}
+
+DtmfToneTemplates::DtmfToneTemplates(uint32_t length)
+    : length_(length), samples_(static_cast<size_t>(length) * 16) {
+  for (int button = 0; button < 16; ++button) {
+    int16_t row = TEMP_COEFF[button / 4], column = TEMP_COEFF[4 + button % 4];
+    State &state = end_[button];
+    state.y1_row = row;
+    state.y1_column = column;
+    state.y2_row = DTMF_OSCILLATOR_START;
+    state.y2_column = DTMF_OSCILLATOR_START;
+    frequency_oscillator(row, column, &samples_[button * length_], length_,
+                         &state.y1_row, &state.y1_column, &state.y2_row,
+                         &state.y2_column);
+  }
+}
+
+const DtmfToneTemplates &DtmfToneTemplates::Default() {
+  static const DtmfToneTemplates templates;
+  return templates;
+}
+
+DtmfStreamGenerator::DtmfStreamGenerator(int32_t DurationPush,
+                                         int32_t DurationPause,
+                                         const DtmfToneTemplates *templates,
+                                         size_t queue_capacity)
+    : queue_(queue_capacity), tone_samples_(ms_to_samples(DurationPush)),
+      pause_samples_(ms_to_samples(DurationPause)), templates_(templates),
+      tone_left_(0), pause_left_(0), button_(0), tone_position_(0),
+      coeff_row_(0), coeff_column_(0), y1_row_(0), y1_column_(0), y2_row_(0),
+      y2_column_(0) {}
+
+bool DtmfStreamGenerator::Enqueue(char dial_char) {
+  return EnqueueSamples(dial_char, tone_samples_, pause_samples_);
+}
+
+bool DtmfStreamGenerator::Enqueue(char dial_char, int32_t DurationPush,
+                                  int32_t DurationPause) {
+  return EnqueueSamples(dial_char, ms_to_samples(DurationPush),
+                        ms_to_samples(DurationPause));
+}
+
+bool DtmfStreamGenerator::EnqueueSamples(char dial_char, uint32_t tone_samples,
+                                         uint32_t pause_samples) {
+  int16_t row, column;
+  if (!dtmf_button_coefficients(dial_char, &row, &column))
+    return false;
+  return queue_.Push(DtmfStreamDigit{dial_char, tone_samples, pause_samples});
+}
+
+size_t DtmfStreamGenerator::EnqueueString(const char *dial_chars) {
+  size_t queued = 0;
+  for (; *dial_chars; ++dial_chars) {
+    int16_t row, column;
+    if (!dtmf_button_coefficients(*dial_chars, &row, &column))
+      continue;
+    if (!Enqueue(*dial_chars))
+      break;
+    ++queued;
+  }
+  return queued;
+}
+
+size_t DtmfStreamGenerator::Generate(int16_t *out, size_t count) {
+  size_t done = 0;
+  while (done < count) {
+    if (tone_left_ == 0 && pause_left_ == 0) {
+      DtmfStreamDigit digit;
+      if (!queue_.Pop(&digit))
+        break;
+      // Restart the oscillator exactly as DtmfGenerator does for every tone.
+      dtmf_button_coefficients(digit.dial_char, &coeff_row_, &coeff_column_);
+      button_ = dial_button_index(digit.dial_char);
+      tone_position_ = 0;
+      y1_row_ = coeff_row_;
+      y1_column_ = coeff_column_;
+      y2_row_ = DTMF_OSCILLATOR_START;
+      y2_column_ = DTMF_OSCILLATOR_START;
+      tone_left_ = digit.tone_samples;
+      pause_left_ = digit.pause_samples;
+    }
+
+    size_t span;
+    if (tone_left_) {
+      span = count - done < tone_left_ ? count - done : tone_left_;
+      GenerateTone(out + done, static_cast<uint32_t>(span));
+      tone_left_ -= static_cast<uint32_t>(span);
+    } else {
+      span = count - done < pause_left_ ? count - done : pause_left_;
+      for (size_t ii = 0; ii < span; ++ii)
+        out[done + ii] = 0;
+      pause_left_ -= static_cast<uint32_t>(span);
+    }
+    done += span;
+  }
+
+  for (size_t ii = done; ii < count; ++ii)
+    out[ii] = 0;
+  return done;
+}
+
+void DtmfStreamGenerator::Reset() {
+  DtmfStreamDigit digit;
+  while (queue_.Pop(&digit))
+    ;
+  tone_left_ = 0;
+  pause_left_ = 0;
+}
+
+void DtmfStreamGenerator::GenerateTone(int16_t *out, uint32_t count) {
+  if (templates_ && tone_position_ < templates_->length()) {
+    uint32_t length = templates_->length();
+    uint32_t copy =
+        count < length - tone_position_ ? count : length - tone_position_;
+    memcpy(out, templates_->samples(button_) + tone_position_,
+           copy * sizeof(int16_t));
+    tone_position_ += copy;
+    out += copy;
+    count -= copy;
+    if (tone_position_ == length) {
+      // Past the template: the oscillator takes over from where it ended.
+      const DtmfToneTemplates::State &state = templates_->end_[button_];
+      y1_row_ = state.y1_row;
+      y1_column_ = state.y1_column;
+      y2_row_ = state.y2_row;
+      y2_column_ = state.y2_column;
+    }
+  }
+  if (count) {
+    frequency_oscillator(coeff_row_, coeff_column_, out, count, &y1_row_,
+                         &y1_column_, &y2_row_, &y2_column_);
+    tone_position_ += count;
+  }
+}
@@ -7,8 +7,13 @@
 #ifndef _DTMF_GENERATOR_
 #define _DTMF_GENERATOR_
 
+#include <stddef.h>
 #include <stdint.h>
 
+#include <vector>
+
+#include "MpscQueue.hpp"
+
 // Class DtmfGenerator is used for generating of DTMF
 // frequences, corresponding push buttons.
 
@@ -80,6 +85,125 @@ public:
   int32_t getReadyFlag() const { return readyFlag ? 1 : 0; }
 };
 
+// The coefficients of the row (Row) and column (Column) frequencies of push
+// button dial_char, as the generators use them.  Returns false, with both set
+// to 0, for anything but 0-9, A-D, * and #.
+bool dtmf_button_coefficients(char dial_char, int16_t *Row, int16_t *Column);
+
+// Every tone starts the oscillator of each of its two frequencies with
+// y1 = its coefficient and y2 = DTMF_OSCILLATOR_START.
+const int32_t DTMF_OSCILLATOR_START = 31000;
+
+// One digit queued on a DtmfStreamGenerator, with its durations in samples.
+struct DtmfStreamDigit {
+  char dial_char;
+  uint32_t tone_samples;
+  uint32_t pause_samples;
+};
+
+// Class DtmfToneTemplates holds the first length() samples the oscillator
+// produces for each of the 16 push buttons.  Every tone restarts the
+// oscillator from the same state, so a tone's start is always the same and a
+// copy of its template is bit for bit what the oscillator would generate.
+// Tones longer than the template carry on with the oscillator from where the
+// template stopped.  Immutable once built; one instance can serve any number
+// of generators on any number of threads.
+class DtmfToneTemplates {
+public:
+  // The samples to keep for each button: 1024 samples, 128 ms, covers
+  // ordinary dialing in 32 KB.
+  static const uint32_t DEFAULT_LENGTH = 1024;
+
+  explicit DtmfToneTemplates(uint32_t length = DEFAULT_LENGTH);
+
+  // A shared instance of DEFAULT_LENGTH, built on first use.
+  static const DtmfToneTemplates &Default();
+
+  uint32_t length() const { return length_; }
+
+  // The template of a button, by its index in "123A456B789C*0#D".
+  const int16_t *samples(int button) const {
+    return &samples_[static_cast<size_t>(button) * length_];
+  }
+
+private:
+  friend class DtmfStreamGenerator;
+
+  // The oscillator's state after the last sample of a template.
+  struct State {
+    int32_t y1_row, y1_column, y2_row, y2_column;
+  };
+
+  uint32_t length_;
+  std::vector<int16_t> samples_;
+  State end_[16];
+};
+
+// Class DtmfStreamGenerator generates DTMF at 8 kHz from a queue of digits.
+// Any thread may queue digits while the generating thread fills buffers of
+// whatever length it likes; tones and pauses start and end on exactly the
+// sample their durations say, wherever the buffer boundaries fall.  The
+// queue is allocated up front, so neither side ever allocates.
+class DtmfStreamGenerator {
+public:
+  // DurationPush - default duration of a pushed button in ms
+  // DurationPause - default duration of the pause after it in ms
+  // templates - if not null, tones are copied from these rather than run on
+  // the oscillator; they must outlive the generator
+  // queue_capacity - the most digits that can wait to be generated, rounded
+  // up to a power of two
+  explicit DtmfStreamGenerator(int32_t DurationPush = 70,
+                               int32_t DurationPause = 50,
+                               const DtmfToneTemplates *templates = nullptr,
+                               size_t queue_capacity = 256);
+
+  // Queues a digit with the default durations, or the given ones in ms.
+  // Safe to call from any number of threads at once; never blocks.  Returns
+  // false, queueing nothing, if dial_char isn't 0-9, A-D, * or #, or if the
+  // queue is full.
+  bool Enqueue(char dial_char);
+  bool Enqueue(char dial_char, int32_t DurationPush, int32_t DurationPause);
+  // The same with the durations in samples.
+  bool EnqueueSamples(char dial_char, uint32_t tone_samples,
+                      uint32_t pause_samples);
+  // Queues every digit of a NUL-terminated string with the default durations.
+  // Returns the number queued; invalid characters are skipped, and the rest
+  // of the string once the queue is full.
+  size_t EnqueueString(const char *dial_chars);
+
+  // Writes count samples to out: the queued digits and their pauses, then
+  // silence once the queue runs dry.  Returns how many of the samples came
+  // from the queue; the rest are zero.  The generating thread only.
+  size_t Generate(int16_t *out, size_t count);
+
+  // True while a digit or its pause is being generated or more are queued.
+  // The generating thread only.
+  bool busy() const { return tone_left_ || pause_left_ || !queue_.empty(); }
+
+  // Drops the digit being generated and everything queued so far.  The
+  // generating thread only.
+  void Reset();
+
+private:
+  // Writes the next count samples of the current tone.
+  void GenerateTone(int16_t *out, uint32_t count);
+
+  MpscQueue<DtmfStreamDigit> queue_;
+  uint32_t tone_samples_;
+  uint32_t pause_samples_;
+  const DtmfToneTemplates *templates_;
+
+  // The samples left of the current tone and of the pause after it.
+  uint32_t tone_left_;
+  uint32_t pause_left_;
+  // The button of the current tone and the samples of it generated so far.
+  int button_;
+  uint32_t tone_position_;
+  // The oscillator of the current tone, as in DtmfGenerator.
+  int16_t coeff_row_, coeff_column_;
+  int32_t y1_row_, y1_column_, y2_row_, y2_column_;
+};
+
 /*			Example:
 
 DtmfGenerator dtmfGen( 256, // frame size
@@ -0,0 +1,358 @@
+//
+// A DTMF generator for many channels that advance in lock step.
+//
+
+#include "DtmfGeneratorBank.hpp"
+#include <algorithm>
+#include <cassert>
+
+#if !defined(DTMF_NO_SIMD) && (defined(__GNUC__) || defined(__clang__)) &&   \
+    (defined(__x86_64__) || defined(__i386__))
+#define GENERATOR_X86 1
+#include <immintrin.h>
+#endif
+
+// The number of frames generated into the tile at a time.
+static const int TILE_FRAMES = 256;
+
+// This is the same function as in DtmfGenerator.cpp
+static inline int32_t MPY48SR(int16_t o16, int32_t o32) {
+  uint32_t Temp0;
+  int32_t Temp1;
+  Temp0 = (((uint16_t)o32 * o16) + 0x4000) >> 15;
+  Temp1 = (int16_t)(o32 >> 16) * o16;
+  return (Temp1 << 1) + Temp0;
+}
+
+// The kernels advance the oscillators of DTMF_GENERATOR_LANES channels by
+// COUNT samples, exactly as frequency_oscillator in DtmfGenerator.cpp does
+// for one, and write the samples frame by frame to Out.  The samples of the
+// lanes whose Active is 0 are written as 0.
+//
+// Coeffs     The row coefficients of the lanes, then their column
+//            coefficients.
+// State      y1 of the row oscillators, y1 of the column ones, then y2 of
+//            both, DTMF_GENERATOR_LANES each.
+typedef void (*oscillator_kernel)(const int32_t Coeffs[], int32_t State[],
+                                  const int32_t Active[], uint32_t COUNT,
+                                  int16_t Out[]);
+
+static void oscillator_kernel_scalar(const int32_t Coeffs[], int32_t State[],
+                                     const int32_t Active[], uint32_t COUNT,
+                                     int16_t Out[]) {
+  const int LANES = DTMF_GENERATOR_LANES;
+  for (int ll = 0; ll < LANES; ++ll) {
+    int16_t Coeff0 = (int16_t)Coeffs[ll], Coeff1 = (int16_t)Coeffs[LANES + ll];
+    int32_t Temp1_0 = State[ll], Temp1_1 = State[LANES + ll];
+    int32_t Temp2_0 = State[2 * LANES + ll], Temp2_1 = State[3 * LANES + ll];
+    for (uint32_t ii = 0; ii < COUNT; ++ii) {
+      int32_t Temp0 = MPY48SR(Coeff0, Temp1_0 << 1) - Temp2_0;
+      int32_t Temp1 = MPY48SR(Coeff1, Temp1_1 << 1) - Temp2_1;
+      Temp2_0 = Temp1_0, Temp2_1 = Temp1_1;
+      Temp1_0 = Temp0, Temp1_1 = Temp1, Temp0 += Temp1;
+      // Every coefficient of a push button is non-zero, so Subject in
+      // frequency_oscillator always is too.
+      Out[ii * LANES + ll] = (int16_t)((Temp0 >> 1) & Active[ll]);
+    }
+    State[ll] = Temp1_0, State[LANES + ll] = Temp1_1;
+    State[2 * LANES + ll] = Temp2_0, State[3 * LANES + ll] = Temp2_1;
+  }
+}
+
+#ifdef GENERATOR_X86
+
+// MPY48SR as in Goertzel.cpp, one recurrence per 32-bit lane.
+__attribute__((target("sse4.1"))) static inline __m128i
+mpy48sr_sse41(__m128i Koeff, __m128i o32) {
+  const __m128i Mask = _mm_set1_epi32(0xffff);
+  const __m128i Round = _mm_set1_epi32(0x4000);
+  __m128i Low = _mm_mullo_epi32(_mm_and_si128(o32, Mask), Koeff);
+  Low = _mm_srai_epi32(_mm_add_epi32(Low, Round), 15);
+  __m128i High = _mm_mullo_epi32(_mm_srai_epi32(o32, 16), Koeff);
+  return _mm_add_epi32(_mm_slli_epi32(High, 1), Low);
+}
+
+// DTMF_GENERATOR_LANES / 4 vectors, whose recurrences are independent and
+// so hide each other's latency.
+__attribute__((target("sse4.1"))) static void
+oscillator_kernel_sse41(const int32_t Coeffs[], int32_t State[],
+                        const int32_t Active[], uint32_t COUNT,
+                        int16_t Out[]) {
+  const int LANES = DTMF_GENERATOR_LANES, VECTORS = LANES / 4;
+  const __m128i Low16 = _mm_set1_epi32(0xffff);
+  __m128i C0[VECTORS], C1[VECTORS], Y1_0[VECTORS], Y1_1[VECTORS],
+      Y2_0[VECTORS], Y2_1[VECTORS], Mask[VECTORS];
+  for (int vv = 0; vv < VECTORS; ++vv) {
+    const int32_t *Lanes = State + 4 * vv;
+    C0[vv] = _mm_loadu_si128((const __m128i *)(Coeffs + 4 * vv));
+    C1[vv] = _mm_loadu_si128((const __m128i *)(Coeffs + LANES + 4 * vv));
+    Y1_0[vv] = _mm_loadu_si128((const __m128i *)Lanes);
+    Y1_1[vv] = _mm_loadu_si128((const __m128i *)(Lanes + LANES));
+    Y2_0[vv] = _mm_loadu_si128((const __m128i *)(Lanes + 2 * LANES));
+    Y2_1[vv] = _mm_loadu_si128((const __m128i *)(Lanes + 3 * LANES));
+    // The low 16 bits of the active lanes: packing them with unsigned
+    // saturation is then the truncation to int16_t.
+    Mask[vv] = _mm_and_si128(
+        _mm_loadu_si128((const __m128i *)(Active + 4 * vv)), Low16);
+  }
+  for (uint32_t ii = 0; ii < COUNT; ++ii) {
+    __m128i Sum[VECTORS];
+    for (int vv = 0; vv < VECTORS; ++vv) {
+      __m128i Temp0 =
+          _mm_sub_epi32(mpy48sr_sse41(C0[vv], _mm_slli_epi32(Y1_0[vv], 1)),
+                        Y2_0[vv]);
+      __m128i Temp1 =
+          _mm_sub_epi32(mpy48sr_sse41(C1[vv], _mm_slli_epi32(Y1_1[vv], 1)),
+                        Y2_1[vv]);
+      Y2_0[vv] = Y1_0[vv], Y2_1[vv] = Y1_1[vv];
+      Y1_0[vv] = Temp0, Y1_1[vv] = Temp1;
+      Sum[vv] = _mm_and_si128(
+          _mm_srai_epi32(_mm_add_epi32(Temp0, Temp1), 1), Mask[vv]);
+    }
+    for (int vv = 0; vv < VECTORS; vv += 2)
+      _mm_storeu_si128((__m128i *)(Out + ii * LANES + 4 * vv),
+                       _mm_packus_epi32(Sum[vv], Sum[vv + 1]));
+  }
+  for (int vv = 0; vv < VECTORS; ++vv) {
+    int32_t *Lanes = State + 4 * vv;
+    _mm_storeu_si128((__m128i *)Lanes, Y1_0[vv]);
+    _mm_storeu_si128((__m128i *)(Lanes + LANES), Y1_1[vv]);
+    _mm_storeu_si128((__m128i *)(Lanes + 2 * LANES), Y2_0[vv]);
+    _mm_storeu_si128((__m128i *)(Lanes + 3 * LANES), Y2_1[vv]);
+  }
+}
+
+__attribute__((target("avx2"))) static inline __m256i
+mpy48sr_avx2(__m256i Koeff, __m256i o32) {
+  const __m256i Mask = _mm256_set1_epi32(0xffff);
+  const __m256i Round = _mm256_set1_epi32(0x4000);
+  __m256i Low = _mm256_mullo_epi32(_mm256_and_si256(o32, Mask), Koeff);
+  Low = _mm256_srai_epi32(_mm256_add_epi32(Low, Round), 15);
+  __m256i High = _mm256_mullo_epi32(_mm256_srai_epi32(o32, 16), Koeff);
+  return _mm256_add_epi32(_mm256_slli_epi32(High, 1), Low);
+}
+
+// DTMF_GENERATOR_LANES / 8 vectors; see oscillator_kernel_sse41.
+__attribute__((target("avx2"))) static void
+oscillator_kernel_avx2(const int32_t Coeffs[], int32_t State[],
+                       const int32_t Active[], uint32_t COUNT, int16_t Out[]) {
+  const int LANES = DTMF_GENERATOR_LANES, VECTORS = LANES / 8;
+  const __m256i Low16 = _mm256_set1_epi32(0xffff);
+  __m256i C0[VECTORS], C1[VECTORS], Y1_0[VECTORS], Y1_1[VECTORS],
+      Y2_0[VECTORS], Y2_1[VECTORS], Mask[VECTORS];
+  for (int vv = 0; vv < VECTORS; ++vv) {
+    const int32_t *Lanes = State + 8 * vv;
+    C0[vv] = _mm256_loadu_si256((const __m256i *)(Coeffs + 8 * vv));
+    C1[vv] = _mm256_loadu_si256((const __m256i *)(Coeffs + LANES + 8 * vv));
+    Y1_0[vv] = _mm256_loadu_si256((const __m256i *)Lanes);
+    Y1_1[vv] = _mm256_loadu_si256((const __m256i *)(Lanes + LANES));
+    Y2_0[vv] = _mm256_loadu_si256((const __m256i *)(Lanes + 2 * LANES));
+    Y2_1[vv] = _mm256_loadu_si256((const __m256i *)(Lanes + 3 * LANES));
+    Mask[vv] = _mm256_and_si256(
+        _mm256_loadu_si256((const __m256i *)(Active + 8 * vv)), Low16);
+  }
+  for (uint32_t ii = 0; ii < COUNT; ++ii) {
+    __m256i Sum[VECTORS];
+    for (int vv = 0; vv < VECTORS; ++vv) {
+      __m256i Temp0 = _mm256_sub_epi32(
+          mpy48sr_avx2(C0[vv], _mm256_slli_epi32(Y1_0[vv], 1)), Y2_0[vv]);
+      __m256i Temp1 = _mm256_sub_epi32(
+          mpy48sr_avx2(C1[vv], _mm256_slli_epi32(Y1_1[vv], 1)), Y2_1[vv]);
+      Y2_0[vv] = Y1_0[vv], Y2_1[vv] = Y1_1[vv];
+      Y1_0[vv] = Temp0, Y1_1[vv] = Temp1;
+      Sum[vv] = _mm256_and_si256(
+          _mm256_srai_epi32(_mm256_add_epi32(Temp0, Temp1), 1), Mask[vv]);
+    }
+    // packus works within 128-bit halves; put the lanes back in order.
+    for (int vv = 0; vv < VECTORS; vv += 2)
+      _mm256_storeu_si256(
+          (__m256i *)(Out + ii * LANES + 8 * vv),
+          _mm256_permute4x64_epi64(_mm256_packus_epi32(Sum[vv], Sum[vv + 1]),
+                                   _MM_SHUFFLE(3, 1, 2, 0)));
+  }
+  for (int vv = 0; vv < VECTORS; ++vv) {
+    int32_t *Lanes = State + 8 * vv;
+    _mm256_storeu_si256((__m256i *)Lanes, Y1_0[vv]);
+    _mm256_storeu_si256((__m256i *)(Lanes + LANES), Y1_1[vv]);
+    _mm256_storeu_si256((__m256i *)(Lanes + 2 * LANES), Y2_0[vv]);
+    _mm256_storeu_si256((__m256i *)(Lanes + 3 * LANES), Y2_1[vv]);
+  }
+}
+
+#endif
+
+// Pick the widest kernel the CPU supports.
+static oscillator_kernel select_oscillator_kernel() {
+#ifdef GENERATOR_X86
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2"))
+    return oscillator_kernel_avx2;
+  if (__builtin_cpu_supports("sse4.1"))
+    return oscillator_kernel_sse41;
+#endif
+  return oscillator_kernel_scalar;
+}
+
+static oscillator_kernel kernel() {
+  static const oscillator_kernel Kernel = select_oscillator_kernel();
+  return Kernel;
+}
+
+// Like the stream generator, the bank only runs at the base rate, where 1 ms
+// is 8 samples.
+static uint32_t ms_to_samples(int32_t Duration) {
+  return Duration > 0 ? static_cast<uint32_t>(Duration) << 3 : 0;
+}
+
+DtmfGeneratorBank::DtmfGeneratorBank(int channel_count, int32_t DurationPush,
+                                     int32_t DurationPause)
+    : channel_count_(channel_count),
+      lane_count_((channel_count + DTMF_GENERATOR_LANES - 1) /
+                  DTMF_GENERATOR_LANES * DTMF_GENERATOR_LANES),
+      tone_samples_(ms_to_samples(DurationPush)),
+      pause_samples_(ms_to_samples(DurationPause)), queues_(channel_count),
+      tone_left_(lane_count_), pause_left_(lane_count_),
+      coeff_row_(lane_count_), coeff_column_(lane_count_),
+      y1_row_(lane_count_), y1_column_(lane_count_), y2_row_(lane_count_),
+      y2_column_(lane_count_), active_(lane_count_),
+      tile_(TILE_FRAMES * DTMF_GENERATOR_LANES) {
+  assert(channel_count > 0);
+}
+
+bool DtmfGeneratorBank::Enqueue(int channel, char dial_char) {
+  return EnqueueSamples(channel, dial_char, tone_samples_, pause_samples_);
+}
+
+bool DtmfGeneratorBank::EnqueueSamples(int channel, char dial_char,
+                                       uint32_t tone_samples,
+                                       uint32_t pause_samples) {
+  assert(channel >= 0 && channel < channel_count_);
+  int16_t row, column;
+  if (!dtmf_button_coefficients(dial_char, &row, &column))
+    return false;
+  queues_[channel].push_back(
+      DtmfStreamDigit{dial_char, tone_samples, pause_samples});
+  return true;
+}
+
+size_t DtmfGeneratorBank::EnqueueString(int channel, const char *dial_chars) {
+  size_t queued = 0;
+  for (; *dial_chars; ++dial_chars)
+    if (Enqueue(channel, *dial_chars))
+      ++queued;
+  return queued;
+}
+
+bool DtmfGeneratorBank::busy(int channel) const {
+  return tone_left_[channel] || pause_left_[channel] ||
+         !queues_[channel].empty();
+}
+
+void DtmfGeneratorBank::Reset(int channel) {
+  queues_[channel].clear();
+  tone_left_[channel] = 0;
+  pause_left_[channel] = 0;
+  active_[channel] = 0;
+}
+
+void DtmfGeneratorBank::StartDigit(int lane) {
+  if (lane >= channel_count_)
+    return;
+  std::deque<DtmfStreamDigit> &queue = queues_[lane];
+  while (tone_left_[lane] == 0 && pause_left_[lane] == 0 && !queue.empty()) {
+    const DtmfStreamDigit &digit = queue.front();
+    int16_t row, column;
+    dtmf_button_coefficients(digit.dial_char, &row, &column);
+    coeff_row_[lane] = row;
+    coeff_column_[lane] = column;
+    y1_row_[lane] = row;
+    y1_column_[lane] = column;
+    y2_row_[lane] = DTMF_OSCILLATOR_START;
+    y2_column_[lane] = DTMF_OSCILLATOR_START;
+    tone_left_[lane] = digit.tone_samples;
+    pause_left_[lane] = digit.pause_samples;
+    queue.pop_front();
+  }
+  active_[lane] = tone_left_[lane] ? -1 : 0;
+}
+
+template <typename Emit>
+void DtmfGeneratorBank::GenerateGroup(int first, int frame_count, Emit emit) {
+  const int LANES = DTMF_GENERATOR_LANES;
+  // The kernel wants the state of the group in one block.
+  int32_t Coeffs[2 * LANES], State[4 * LANES];
+
+  int done = 0;
+  while (done < frame_count) {
+    // Run until the first lane reaches the end of its tone or pause.
+    uint32_t span = std::min(frame_count - done, TILE_FRAMES);
+    bool any_tone = false;
+    for (int ll = first; ll < first + LANES; ++ll) {
+      StartDigit(ll);
+      if (tone_left_[ll]) {
+        span = std::min(span, tone_left_[ll]);
+        any_tone = true;
+      } else if (pause_left_[ll]) {
+        span = std::min(span, pause_left_[ll]);
+      }
+    }
+
+    if (any_tone) {
+      std::copy(&coeff_row_[first], &coeff_row_[first] + LANES, Coeffs);
+      std::copy(&coeff_column_[first], &coeff_column_[first] + LANES,
+                Coeffs + LANES);
+      std::copy(&y1_row_[first], &y1_row_[first] + LANES, State);
+      std::copy(&y1_column_[first], &y1_column_[first] + LANES,
+                State + LANES);
+      std::copy(&y2_row_[first], &y2_row_[first] + LANES, State + 2 * LANES);
+      std::copy(&y2_column_[first], &y2_column_[first] + LANES,
+                State + 3 * LANES);
+      kernel()(Coeffs, State, &active_[first], span, &tile_[0]);
+      std::copy(State, State + LANES, &y1_row_[first]);
+      std::copy(State + LANES, State + 2 * LANES, &y1_column_[first]);
+      std::copy(State + 2 * LANES, State + 3 * LANES, &y2_row_[first]);
+      std::copy(State + 3 * LANES, State + 4 * LANES, &y2_column_[first]);
+    } else {
+      std::fill(tile_.begin(), tile_.begin() + span * LANES, 0);
+    }
+
+    for (int ll = first; ll < first + LANES; ++ll) {
+      if (tone_left_[ll])
+        tone_left_[ll] -= span;
+      else if (pause_left_[ll])
+        pause_left_[ll] -= span;
+    }
+    emit(done, static_cast<int>(span));
+    done += span;
+  }
+}
+
+void DtmfGeneratorBank::GenerateInterleaved(int16_t *frames,
+                                            int frame_count) {
+  const int LANES = DTMF_GENERATOR_LANES;
+  for (int first = 0; first < channel_count_; first += LANES) {
+    int lanes = std::min(LANES, channel_count_ - first);
+    GenerateGroup(first, frame_count, [&](int offset, int span) {
+      const int16_t *tile = &tile_[0];
+      int16_t *out = frames + offset * channel_count_ + first;
+      for (int ii = 0; ii < span; ++ii, tile += LANES, out += channel_count_)
+        std::copy(tile, tile + lanes, out);
+    });
+  }
+}
+
+void DtmfGeneratorBank::GeneratePlanar(int16_t *const *channels,
+                                       int frame_count) {
+  const int LANES = DTMF_GENERATOR_LANES;
+  for (int first = 0; first < channel_count_; first += LANES) {
+    int lanes = std::min(LANES, channel_count_ - first);
+    GenerateGroup(first, frame_count, [&](int offset, int span) {
+      for (int ll = 0; ll < lanes; ++ll) {
+        const int16_t *tile = &tile_[ll];
+        int16_t *out = channels[first + ll] + offset;
+        for (int ii = 0; ii < span; ++ii, tile += LANES)
+          out[ii] = *tile;
+      }
+    });
+  }
+}
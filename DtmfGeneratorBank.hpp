@@ -0,0 +1,94 @@
+//
+// A DTMF generator for many channels that advance in lock step.
+//
+
+#ifndef DTMF_GENERATOR_BANK
+#define DTMF_GENERATOR_BANK
+
+#include <stddef.h>
+#include <stdint.h>
+#include <deque>
+#include <vector>
+
+#include "DtmfGenerator.hpp"
+
+// The number of channels whose oscillators run together: several vectors'
+// worth, so that their recurrences hide each other's latency.
+const int DTMF_GENERATOR_LANES = 32;
+
+// Generates DTMF at 8 kHz for channel_count channels at once, e.g. all the
+// legs of a load test.  Every channel has its own queue of digits, and the
+// oscillator state of all channels is kept in structure-of-arrays form so
+// that the oscillators of DTMF_GENERATOR_LANES channels run together, one
+// channel per SIMD lane.  On x86 the lanes are SSE4.1 or AVX2, whichever the
+// CPU supports; DTMF_NO_SIMD forces the portable loop.
+//
+// Each channel generates exactly the samples a DtmfStreamGenerator queued
+// with the same digits would.  Unlike DtmfStreamGenerator, the queues belong
+// to the generating thread.
+class DtmfGeneratorBank {
+public:
+  // DurationPush - default duration of a pushed button in ms
+  // DurationPause - default duration of the pause after it in ms
+  explicit DtmfGeneratorBank(int channel_count, int32_t DurationPush = 70,
+                             int32_t DurationPause = 50);
+
+  int channel_count() const { return channel_count_; }
+
+  // Queue digits on a channel, as DtmfStreamGenerator does.
+  bool Enqueue(int channel, char dial_char);
+  bool EnqueueSamples(int channel, char dial_char, uint32_t tone_samples,
+                      uint32_t pause_samples);
+  size_t EnqueueString(int channel, const char *dial_chars);
+
+  // True while the channel has a digit, or the pause after it, to finish or
+  // more queued.
+  bool busy(int channel) const;
+
+  // Drops the digit being generated on a channel and everything queued.
+  void Reset(int channel);
+
+  // Writes frame_count frames of channel_count interleaved samples.
+  void GenerateInterleaved(int16_t *frames, int frame_count);
+
+  // Writes frame_count samples to each of the channel_count pointers.
+  void GeneratePlanar(int16_t *const *channels, int frame_count);
+
+private:
+  int channel_count_;
+
+  // channel_count_ rounded up to a whole number of lane groups.
+  int lane_count_;
+
+  uint32_t tone_samples_;
+  uint32_t pause_samples_;
+
+  std::vector<std::deque<DtmfStreamDigit>> queues_;
+
+  // Per lane, as in DtmfStreamGenerator: the samples left of the current
+  // tone and pause, the coefficients, and the oscillator state.  active_ is
+  // -1 for the lanes in a tone and 0 for the rest.
+  std::vector<uint32_t> tone_left_;
+  std::vector<uint32_t> pause_left_;
+  std::vector<int32_t> coeff_row_;
+  std::vector<int32_t> coeff_column_;
+  std::vector<int32_t> y1_row_;
+  std::vector<int32_t> y1_column_;
+  std::vector<int32_t> y2_row_;
+  std::vector<int32_t> y2_column_;
+  std::vector<int32_t> active_;
+
+  // The samples of a single lane group, frame by frame.
+  std::vector<int16_t> tile_;
+
+  // Generates frame_count frames for the lane group starting at lane first,
+  // calling Emit(offset, span) whenever tile_ holds the span frames starting
+  // at offset.
+  template <typename Emit>
+  void GenerateGroup(int first, int frame_count, Emit emit);
+
+  // Moves the lane on to its next digit, if it is done with its current one.
+  void StartDigit(int lane);
+};
+
+#endif
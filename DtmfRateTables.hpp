@@ -0,0 +1,103 @@
+//
+// Goertzel coefficient tables and batch lengths for any sample rate,
+// generated at compile time.
+//
+
+#ifndef DTMF_RATE_TABLES
+#define DTMF_RATE_TABLES
+
+#include <stdint.h>
+
+// The number of Goertzel recurrences the detector runs per batch.
+const int DTMF_COEFF_COUNT = 18;
+
+// The sample rate the detector was designed for, and its batch length there.
+const int DTMF_BASE_SAMPLE_RATE = 8000;
+const int DTMF_BASE_BATCH_SIZE = 102;
+
+// The frequencies, in Hz, the detector looks at, in the order of CONSTANTS
+// (see DtmfDetector.cpp).  They are the frequencies CONSTANTS was generated
+// from at 8 kHz, close to whole multiples of 8000 / 102 Hz, i.e. to bins of
+// a 102-point DFT.  Given to 4 decimals, so that the 8 kHz table generated
+// from them is exactly CONSTANTS.
+constexpr double DTMF_COEFF_FREQUENCIES[DTMF_COEFF_COUNT] = {
+    705.8761,  784.3232,  862.7397,  941.1675,  1176.4770, 1333.3333,
+    1490.1751, 1647.0745, 1098.0628, 548.9815,  78.3366,   235.3073,
+    313.7742,  392.1573,  2039.2121, 2509.7827, 2980.3966, 3529.3849};
+
+// Everything the detector needs to know about a sample rate.
+struct DtmfRateTables {
+  int sample_rate;
+  // Samples per batch.  A batch lasts as long as at 8 kHz, 12.75 ms, so the
+  // frequency resolution stays the same.
+  int batch_size;
+  // The Goertzel state is shifted right by this many bits before the
+  // magnitudes are computed, see goertzel_filter_bank.  It grows with
+  // batch_size, so that the magnitudes keep the range they have at 8 kHz.
+  int magnitude_shift;
+  // round(32768 * cos(2 * pi * frequency / sample_rate)), per frequency.
+  int16_t koeffs[DTMF_COEFF_COUNT];
+};
+
+namespace dtmf_detail {
+
+constexpr double PI = 3.14159265358979323846;
+
+// cos(x) for 0 <= x <= pi, accurate to double precision.
+constexpr double cosine(double x) {
+  // cos(x) == -cos(pi - x) keeps the series short.
+  double sign = 1;
+  if (x > PI / 2) {
+    x = PI - x;
+    sign = -1;
+  }
+  double term = 1, sum = 1;
+  for (int nn = 1; nn < 20; ++nn) {
+    term *= -x * x / ((2 * nn - 1) * (2 * nn));
+    sum += term;
+  }
+  return sign * sum;
+}
+
+constexpr int16_t koeff(double frequency, int sample_rate) {
+  double value = 32768 * cosine(2 * PI * frequency / sample_rate);
+  long rounded = static_cast<long>(value < 0 ? value - 0.5 : value + 0.5);
+  return static_cast<int16_t>(rounded > 32767 ? 32767 : rounded);
+}
+
+} // namespace dtmf_detail
+
+constexpr DtmfRateTables dtmf_rate_tables(int sample_rate) {
+  DtmfRateTables tables{};
+  tables.sample_rate = sample_rate;
+  tables.batch_size =
+      (DTMF_BASE_BATCH_SIZE * sample_rate + DTMF_BASE_SAMPLE_RATE / 2) /
+      DTMF_BASE_SAMPLE_RATE;
+  tables.magnitude_shift = 10;
+  while ((DTMF_BASE_BATCH_SIZE << (tables.magnitude_shift - 10)) <
+         tables.batch_size)
+    ++tables.magnitude_shift;
+  for (int kk = 0; kk < DTMF_COEFF_COUNT; ++kk)
+    tables.koeffs[kk] =
+        dtmf_detail::koeff(DTMF_COEFF_FREQUENCIES[kk], sample_rate);
+  return tables;
+}
+
+// The Goertzel state grows with the batch length; above 48 kHz it no longer
+// fits in 31 bits for loud input.
+const int DTMF_MAX_SAMPLE_RATE = 48000;
+
+constexpr int DTMF_MAX_BATCH_SIZE =
+    dtmf_rate_tables(DTMF_MAX_SAMPLE_RATE).batch_size;
+
+// The tables for SampleRate, as a compile-time constant.
+template <int SampleRate> struct DtmfRate {
+  static_assert(SampleRate >= DTMF_BASE_SAMPLE_RATE,
+                "DTMF detection needs a sample rate of at least 8 kHz");
+  static_assert(SampleRate <= DTMF_MAX_SAMPLE_RATE,
+                "DTMF detection supports sample rates up to 48 kHz");
+
+  static constexpr DtmfRateTables tables = dtmf_rate_tables(SampleRate);
+};
+
+#endif
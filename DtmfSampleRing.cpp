@@ -0,0 +1,78 @@
+//
+// A detector fed by another thread through a lock-free sample ring, see
+// DtmfSampleRing.hpp.
+//
+
+#include "DtmfSampleRing.hpp"
+#include <algorithm>
+#include <cassert>
+
+// Adds Count to a counter that only the calling thread writes, without a
+// locked read-modify-write.
+static inline void add_counter(std::atomic<uint64_t> *Counter,
+                               uint64_t Count) {
+  Counter->store(Counter->load(std::memory_order_relaxed) + Count,
+                 std::memory_order_relaxed);
+}
+
+DtmfSampleRing::DtmfSampleRing(DtmfDetectorBase *detector, int capacity)
+    : detector_(detector), samples_(capacity), queued_(0), dropped_(0),
+      full_(0), detected_(0), peak_fill_(0) {
+  assert(detector && capacity > 0);
+}
+
+int DtmfSampleRing::Push(const int16_t *samples, int sample_count) {
+  int written = static_cast<int>(samples_.Write(samples, sample_count));
+  add_counter(&queued_, written);
+  if (written < sample_count) {
+    add_counter(&dropped_, sample_count - written);
+    add_counter(&full_, 1);
+  }
+  return written;
+}
+
+int DtmfSampleRing::Reserve(int16_t **samples) {
+  int room = static_cast<int>(samples_.Reserve(samples));
+  if (room == 0)
+    add_counter(&full_, 1);
+  return room;
+}
+
+void DtmfSampleRing::Commit(int sample_count) {
+  samples_.Commit(sample_count);
+  add_counter(&queued_, sample_count);
+}
+
+int DtmfSampleRing::Drain(int max_samples) {
+  int done = 0;
+  // A piece at a time: the queued samples wrap around the end of the ring,
+  // and the producer may queue more meanwhile.
+  while (done < max_samples) {
+    const int16_t *samples;
+    size_t readable = samples_.Peek(&samples);
+    if (readable == 0)
+      break;
+    if (done == 0) {
+      uint64_t fill = samples_.size();
+      if (fill > peak_fill_.load(std::memory_order_relaxed))
+        peak_fill_.store(fill, std::memory_order_relaxed);
+    }
+    int count = static_cast<int>(
+        std::min<size_t>(readable, static_cast<size_t>(max_samples - done)));
+    detector_->Detect(samples, count);
+    samples_.Consume(count);
+    done += count;
+  }
+  add_counter(&detected_, done);
+  return done;
+}
+
+DtmfSampleRingStats DtmfSampleRing::GetStats() const {
+  DtmfSampleRingStats stats;
+  stats.queued = queued_.load(std::memory_order_relaxed);
+  stats.dropped = dropped_.load(std::memory_order_relaxed);
+  stats.full = full_.load(std::memory_order_relaxed);
+  stats.detected = detected_.load(std::memory_order_relaxed);
+  stats.peak_fill = peak_fill_.load(std::memory_order_relaxed);
+  return stats;
+}
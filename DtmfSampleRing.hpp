@@ -0,0 +1,83 @@
+//
+// A detector fed by another thread through a lock-free sample ring.
+//
+
+#ifndef DTMF_SAMPLE_RING
+#define DTMF_SAMPLE_RING
+
+#include <atomic>
+#include <stdint.h>
+
+#include "DtmfDetector.hpp"
+#include "SpscRing.hpp"
+
+// The counters of a DtmfSampleRing.
+struct DtmfSampleRingStats {
+  // Samples queued by the producer.
+  uint64_t queued;
+  // Samples Push dropped because the ring was full.
+  uint64_t dropped;
+  // Calls to Push that did not find room for all of their samples, and to
+  // Reserve that found none: how often the producer ran into the consumer.
+  uint64_t full;
+  // Samples the consumer has run the detector over.
+  uint64_t detected;
+  // The most samples the consumer has found waiting.
+  uint64_t peak_fill;
+};
+
+// Attaches a ring of samples to a detector, for a capture thread (the
+// producer) and a detection thread (the consumer) that must not wait for
+// each other.  The producer copies samples in (Push) or writes them in place
+// (Reserve and Commit); the consumer runs the detector straight over the
+// ring (Drain), one contiguous piece at a time, so the samples are never
+// copied again on their way to it.  The detector's callbacks run on the
+// consumer thread, which must be the only one to use the detector.
+//
+// Neither side ever waits for the other, nor takes a lock.  When the
+// consumer falls behind, Push drops what does not fit and Reserve finds no
+// room; both are counted, so the producer can back off or account for the
+// loss.
+class DtmfSampleRing {
+public:
+  // capacity is rounded up to a power of two.
+  DtmfSampleRing(DtmfDetectorBase *detector, int capacity);
+
+  DtmfSampleRing(const DtmfSampleRing &) = delete;
+  DtmfSampleRing &operator=(const DtmfSampleRing &) = delete;
+
+  int capacity() const { return static_cast<int>(samples_.capacity()); }
+
+  // Producer.  Queues sample_count samples, and returns how many of them
+  // fit; the rest are dropped.
+  int Push(const int16_t *samples, int sample_count);
+
+  // Producer.  Points *samples at the free room to write samples in place,
+  // and returns how many fit there contiguously (0 if the ring is full);
+  // call again after Commit for more.
+  int Reserve(int16_t **samples);
+
+  // Producer.  Queues the first sample_count samples written after Reserve.
+  void Commit(int sample_count);
+
+  // Consumer.  Runs the detector over up to max_samples queued samples, and
+  // returns how many.
+  int Drain(int max_samples = INT32_MAX);
+
+  // Any thread.  The counters of both sides, each as of some recent moment.
+  DtmfSampleRingStats GetStats() const;
+
+private:
+  DtmfDetectorBase *detector_;
+  SpscRing<int16_t> samples_;
+
+  // Each counter is only written by one side, the producer's and the
+  // consumer's on cache lines of their own.
+  alignas(SPSC_CACHE_LINE) std::atomic<uint64_t> queued_;
+  std::atomic<uint64_t> dropped_;
+  std::atomic<uint64_t> full_;
+  alignas(SPSC_CACHE_LINE) std::atomic<uint64_t> detected_;
+  std::atomic<uint64_t> peak_fill_;
+};
+
+#endif
@@ -0,0 +1,102 @@
+//
+// A pool of worker threads that stay up between runs of tasks, see
+// DtmfThreadPool.hpp.
+//
+
+#include "DtmfThreadPool.hpp"
+#include <algorithm>
+#include <cassert>
+
+DtmfThreadPool::DtmfThreadPool(int thread_count)
+    : queues_(thread_count > 0
+                  ? thread_count
+                  : std::max(1u, std::thread::hardware_concurrency())),
+      next_queue_(0), run_(nullptr), generation_(0), busy_(0),
+      stopping_(false) {
+  threads_.reserve(queues_.size());
+  for (size_t ii = 0; ii < queues_.size(); ++ii)
+    threads_.emplace_back(&DtmfThreadPool::Work, this, ii);
+}
+
+DtmfThreadPool::~DtmfThreadPool() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stopping_ = true;
+  }
+  wake_.notify_all();
+  for (auto &thread : threads_)
+    thread.join();
+}
+
+void DtmfThreadPool::Add(size_t task) {
+  Queue &queue = queues_[next_queue_];
+  {
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    queue.tasks.push_back(task);
+  }
+  next_queue_ = (next_queue_ + 1) % queues_.size();
+}
+
+void DtmfThreadPool::Start(const std::function<void(size_t)> &run) {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    assert(busy_ == 0);
+    run_ = &run;
+    busy_ = thread_count();
+    ++generation_;
+  }
+  wake_.notify_all();
+}
+
+void DtmfThreadPool::Wait() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  done_.wait(lock, [this] { return busy_ == 0; });
+  run_ = nullptr;
+}
+
+void DtmfThreadPool::Work(size_t self) {
+  uint64_t seen = 0;
+  for (;;) {
+    const std::function<void(size_t)> *run;
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      wake_.wait(lock, [&] { return stopping_ || generation_ != seen; });
+      if (stopping_)
+        return;
+      seen = generation_;
+      run = run_;
+    }
+
+    size_t task;
+    while (Take(self, &task))
+      (*run)(task);
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (--busy_ == 0)
+      done_.notify_one();
+  }
+}
+
+bool DtmfThreadPool::Take(size_t self, size_t *task) {
+  {
+    Queue &own = queues_[self];
+    std::lock_guard<std::mutex> lock(own.mutex);
+    if (!own.tasks.empty()) {
+      *task = own.tasks.front();
+      own.tasks.pop_front();
+      return true;
+    }
+  }
+  // No tasks are added during a run, so once every deque has been found
+  // empty the run is done.
+  for (size_t ii = 1; ii < queues_.size(); ++ii) {
+    Queue &victim = queues_[(self + ii) % queues_.size()];
+    std::lock_guard<std::mutex> lock(victim.mutex);
+    if (!victim.tasks.empty()) {
+      *task = victim.tasks.back();
+      victim.tasks.pop_back();
+      return true;
+    }
+  }
+  return false;
+}
@@ -0,0 +1,80 @@
+//
+// A pool of worker threads that stay up between runs of tasks.
+//
+
+#ifndef DTMF_THREAD_POOL
+#define DTMF_THREAD_POOL
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <stdint.h>
+#include <thread>
+#include <vector>
+
+// Runs tasks, numbered by the caller, on a fixed set of threads that are
+// started once and reused by every run, so that handing out work costs no
+// thread creation.  Each worker has a deque of tasks: it takes its own from
+// the front, and once that is empty, steals from the back of the others',
+// so that a worker stuck with a few long tasks does not hold up the end of
+// a run.
+//
+// One thread at a time adds tasks and runs them; a pool shared between
+// threads needs a lock around that.
+class DtmfThreadPool {
+public:
+  // thread_count 0 means one per hardware thread.
+  explicit DtmfThreadPool(int thread_count = 0);
+  ~DtmfThreadPool();
+
+  DtmfThreadPool(const DtmfThreadPool &) = delete;
+  DtmfThreadPool &operator=(const DtmfThreadPool &) = delete;
+
+  int thread_count() const { return static_cast<int>(threads_.size()); }
+
+  // Deals a task out to the workers round-robin.  Call before Start.
+  void Add(size_t task);
+
+  // Starts calling run(task), which must not throw, on the pool's threads
+  // for every task added since the last run, and returns at once, so that
+  // the calling thread can do something else meanwhile.  run must live until
+  // Wait returns.
+  void Start(const std::function<void(size_t)> &run);
+
+  // Returns once every task of the run is done.
+  void Wait();
+
+  // Start and Wait.
+  void Run(const std::function<void(size_t)> &run) {
+    Start(run);
+    Wait();
+  }
+
+private:
+  struct Queue {
+    std::mutex mutex;
+    std::deque<size_t> tasks;
+  };
+
+  std::vector<Queue> queues_;
+  size_t next_queue_;
+
+  // Guards what follows.
+  std::mutex mutex_;
+  std::condition_variable wake_;
+  std::condition_variable done_;
+  const std::function<void(size_t)> *run_;
+  // Counts the runs started, so that a worker wakes once per run.
+  uint64_t generation_;
+  // The workers still busy with the current run.
+  int busy_;
+  bool stopping_;
+
+  std::vector<std::thread> threads_;
+
+  void Work(size_t self);
+  bool Take(size_t self, size_t *task);
+};
+
+#endif
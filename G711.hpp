@@ -0,0 +1,75 @@
+//
+// G.711 mu-law and A-law decoding tables, generated at compile time.
+//
+
+#ifndef G711
+#define G711
+
+#include <stdint.h>
+
+// The two companding laws of G.711: mu-law (PCMU, AU encoding 1) and A-law
+// (PCMA, AU encoding 27).
+enum G711Law { G711_ULAW, G711_ALAW };
+
+// The linear sample for each of the 256 code words.  Both laws decode to the
+// top 14 or 13 bits of a 16-bit sample, so the values can be fed to the
+// detector as they are.
+struct G711Table {
+  int16_t samples[256];
+};
+
+namespace g711_detail {
+
+constexpr int16_t ulaw_decode(uint8_t code) {
+  // Code words are sent inverted.
+  int inverted = ~code & 0xff;
+  int exponent = (inverted >> 4) & 0x07;
+  int mantissa = inverted & 0x0f;
+  // 0x84 is the bias added by the encoder, so that every segment starts at a
+  // power of two.
+  int magnitude = (((mantissa << 3) + 0x84) << exponent) - 0x84;
+  return static_cast<int16_t>(inverted & 0x80 ? -magnitude : magnitude);
+}
+
+constexpr int16_t alaw_decode(uint8_t code) {
+  // Every even bit is sent inverted.
+  int toggled = code ^ 0x55;
+  int exponent = (toggled >> 4) & 0x07;
+  int mantissa = toggled & 0x0f;
+  int magnitude = exponent == 0 ? (mantissa << 4) + 8
+                                : ((mantissa << 4) + 0x108) << (exponent - 1);
+  // Unlike mu-law, a set sign bit means a positive sample.
+  return static_cast<int16_t>(toggled & 0x80 ? magnitude : -magnitude);
+}
+
+constexpr G711Table g711_table(G711Law law) {
+  G711Table table{};
+  for (int code = 0; code < 256; ++code)
+    table.samples[code] = law == G711_ULAW
+                              ? ulaw_decode(static_cast<uint8_t>(code))
+                              : alaw_decode(static_cast<uint8_t>(code));
+  return table;
+}
+
+} // namespace g711_detail
+
+inline constexpr G711Table G711_ULAW_TABLE = g711_detail::g711_table(G711_ULAW);
+inline constexpr G711Table G711_ALAW_TABLE = g711_detail::g711_table(G711_ALAW);
+
+inline const G711Table &g711_table(G711Law law) {
+  return law == G711_ULAW ? G711_ULAW_TABLE : G711_ALAW_TABLE;
+}
+
+// Spot checks against ITU-T G.711.
+static_assert(G711_ULAW_TABLE.samples[0x00] == -32124 &&
+                  G711_ULAW_TABLE.samples[0x80] == 32124 &&
+                  G711_ULAW_TABLE.samples[0xff] == 0 &&
+                  G711_ULAW_TABLE.samples[0x7f] == 0,
+              "bad mu-law table");
+static_assert(G711_ALAW_TABLE.samples[0xd5] == 8 &&
+                  G711_ALAW_TABLE.samples[0x55] == -8 &&
+                  G711_ALAW_TABLE.samples[0xaa] == 32256 &&
+                  G711_ALAW_TABLE.samples[0x2a] == -32256,
+              "bad A-law table");
+
+#endif
@@ -0,0 +1,597 @@
+//
+// Multi-frequency fixed-point Goertzel kernel shared by the DTMF detector.
+//
+
+#include "Goertzel.hpp"
+#include <cassert>
+#include <cmath>
+
+#if !defined(DTMF_NO_SIMD) && (defined(__GNUC__) || defined(__clang__)) &&   \
+    (defined(__x86_64__) || defined(__i386__))
+#define GOERTZEL_X86 1
+#include <immintrin.h>
+#endif
+
+// This is the same function as in DtmfGenerator.cpp
+static inline int32_t MPY48SR(int16_t o16, int32_t o32) {
+  uint32_t Temp0;
+  int32_t Temp1;
+  Temp0 = (((uint16_t)o32 * o16) + 0x4000) >> 15;
+  Temp1 = (int16_t)(o32 >> 16) * o16;
+  return (Temp1 << 1) + Temp0;
+}
+
+// Magnitude: prev_prev**prev_prev + prev*prev - coeff*prev*prev_prev
+//
+// Vk1      prev
+// Vk2      prev_prev
+// Shift    See GOERTZEL_MAGNITUDE_SHIFT.
+static inline int32_t
+goertzel_magnitude(int16_t Koeff, int32_t Vk1, int32_t Vk2,
+                   int32_t Shift = GOERTZEL_MAGNITUDE_SHIFT) {
+  int32_t Temp;
+  // TODO: what does shifting by 10 bits to the right achieve?  Probably to
+  // make room for the magnitude calculations.
+  Vk1 >>= Shift, Vk2 >>= Shift;
+  Temp = MPY48SR(Koeff, Vk1 << 1);
+  Temp = (int16_t)Temp * (int16_t)Vk2;
+  return (int16_t)Vk1 * (int16_t)Vk1 + (int16_t)Vk2 * (int16_t)Vk2 - Temp;
+}
+
+// The kernels below only advance the recurrences:
+// output = Input + 2*coeff*prev - prev_prev
+// N.B. bit-shifting to the left achieves the multiplication by 2.
+//
+// Koeffs, Vk1 and Vk2 are KOEFF_COUNT elements long.
+typedef void (*goertzel_kernel)(const int16_t Koeffs[], uint32_t KOEFF_COUNT,
+                                const int16_t arraySamples[], uint32_t COUNT,
+                                int32_t Vk1[], int32_t Vk2[]);
+
+static void goertzel_kernel_scalar(const int16_t Koeffs[],
+                                   uint32_t KOEFF_COUNT,
+                                   const int16_t arraySamples[], uint32_t COUNT,
+                                   int32_t Vk1[], int32_t Vk2[]) {
+  for (uint32_t ii = 0; ii < COUNT; ++ii) {
+    int32_t Sample = arraySamples[ii];
+    for (uint32_t kk = 0; kk < KOEFF_COUNT; ++kk) {
+      int32_t Temp = MPY48SR(Koeffs[kk], Vk1[kk] << 1) - Vk2[kk] + Sample;
+      Vk2[kk] = Vk1[kk];
+      Vk1[kk] = Temp;
+    }
+  }
+}
+
+// The channel kernels run every coefficient over CHANNEL_COUNT independent
+// channels, one channel per lane, and write the magnitudes straight away.
+typedef void (*goertzel_channel_kernel)(const int16_t Koeffs[],
+                                        uint32_t KOEFF_COUNT,
+                                        const int32_t arraySamples[],
+                                        uint32_t CHANNEL_COUNT, uint32_t COUNT,
+                                        int32_t Magnitudes[]);
+
+static void goertzel_channel_kernel_scalar(const int16_t Koeffs[],
+                                           uint32_t KOEFF_COUNT,
+                                           const int32_t arraySamples[],
+                                           uint32_t CHANNEL_COUNT,
+                                           uint32_t COUNT,
+                                           int32_t Magnitudes[]) {
+  for (uint32_t kk = 0; kk < KOEFF_COUNT; ++kk) {
+    for (uint32_t cc = 0; cc < CHANNEL_COUNT; ++cc) {
+      const int32_t *Sample = arraySamples + cc;
+      int32_t Vk1 = 0, Vk2 = 0;
+      for (uint32_t ii = 0; ii < COUNT; ++ii, Sample += CHANNEL_COUNT) {
+        int32_t Temp = MPY48SR(Koeffs[kk], Vk1 << 1) - Vk2 + *Sample;
+        Vk2 = Vk1;
+        Vk1 = Temp;
+      }
+      Magnitudes[kk * CHANNEL_COUNT + cc] =
+          goertzel_magnitude(Koeffs[kk], Vk1, Vk2);
+    }
+  }
+}
+
+#ifdef GOERTZEL_X86
+
+// Every 32-bit lane holds one recurrence.  MPY48SR is computed exactly as the
+// scalar version does it, using wrap-around 32-bit arithmetic:
+//   low  = (((uint16_t)x * k) + 0x4000) >> 15
+//   high = ((int16_t)(x >> 16) * k) << 1
+// with x = prev << 1.
+
+__attribute__((target("sse4.1"))) static inline __m128i
+mpy48sr_sse41(__m128i Koeff, __m128i o32) {
+  const __m128i Mask = _mm_set1_epi32(0xffff);
+  const __m128i Round = _mm_set1_epi32(0x4000);
+  __m128i Low = _mm_mullo_epi32(_mm_and_si128(o32, Mask), Koeff);
+  Low = _mm_srai_epi32(_mm_add_epi32(Low, Round), 15);
+  __m128i High = _mm_mullo_epi32(_mm_srai_epi32(o32, 16), Koeff);
+  return _mm_add_epi32(_mm_slli_epi32(High, 1), Low);
+}
+
+// LANES is the number of 4-lane vectors kept in registers for the whole pass.
+template <int LANES>
+__attribute__((target("sse4.1"))) static void
+goertzel_pass_sse41(const int16_t Koeffs[], const int16_t arraySamples[],
+                    uint32_t COUNT, int32_t Vk1[], int32_t Vk2[]) {
+  __m128i K[LANES], V1[LANES], V2[LANES];
+  for (int ll = 0; ll < LANES; ++ll) {
+    K[ll] = _mm_cvtepi16_epi32(
+        _mm_loadl_epi64(reinterpret_cast<const __m128i *>(Koeffs + 4 * ll)));
+    V1[ll] = _mm_loadu_si128(reinterpret_cast<const __m128i *>(Vk1 + 4 * ll));
+    V2[ll] = _mm_loadu_si128(reinterpret_cast<const __m128i *>(Vk2 + 4 * ll));
+  }
+  for (uint32_t ii = 0; ii < COUNT; ++ii) {
+    __m128i Sample = _mm_set1_epi32(arraySamples[ii]);
+    for (int ll = 0; ll < LANES; ++ll) {
+      __m128i Temp = mpy48sr_sse41(K[ll], _mm_slli_epi32(V1[ll], 1));
+      Temp = _mm_add_epi32(_mm_sub_epi32(Temp, V2[ll]), Sample);
+      V2[ll] = V1[ll];
+      V1[ll] = Temp;
+    }
+  }
+  for (int ll = 0; ll < LANES; ++ll) {
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(Vk1 + 4 * ll), V1[ll]);
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(Vk2 + 4 * ll), V2[ll]);
+  }
+}
+
+__attribute__((target("avx2"))) static inline __m256i
+mpy48sr_avx2(__m256i Koeff, __m256i o32) {
+  const __m256i Mask = _mm256_set1_epi32(0xffff);
+  const __m256i Round = _mm256_set1_epi32(0x4000);
+  __m256i Low = _mm256_mullo_epi32(_mm256_and_si256(o32, Mask), Koeff);
+  Low = _mm256_srai_epi32(_mm256_add_epi32(Low, Round), 15);
+  __m256i High = _mm256_mullo_epi32(_mm256_srai_epi32(o32, 16), Koeff);
+  return _mm256_add_epi32(_mm256_slli_epi32(High, 1), Low);
+}
+
+// LANES is the number of 8-lane vectors kept in registers for the whole pass.
+template <int LANES>
+__attribute__((target("avx2"))) static void
+goertzel_pass_avx2(const int16_t Koeffs[], const int16_t arraySamples[],
+                   uint32_t COUNT, int32_t Vk1[], int32_t Vk2[]) {
+  __m256i K[LANES], V1[LANES], V2[LANES];
+  for (int ll = 0; ll < LANES; ++ll) {
+    K[ll] = _mm256_cvtepi16_epi32(
+        _mm_loadu_si128(reinterpret_cast<const __m128i *>(Koeffs + 8 * ll)));
+    V1[ll] =
+        _mm256_loadu_si256(reinterpret_cast<const __m256i *>(Vk1 + 8 * ll));
+    V2[ll] =
+        _mm256_loadu_si256(reinterpret_cast<const __m256i *>(Vk2 + 8 * ll));
+  }
+  for (uint32_t ii = 0; ii < COUNT; ++ii) {
+    __m256i Sample = _mm256_set1_epi32(arraySamples[ii]);
+    for (int ll = 0; ll < LANES; ++ll) {
+      __m256i Temp = mpy48sr_avx2(K[ll], _mm256_slli_epi32(V1[ll], 1));
+      Temp = _mm256_add_epi32(_mm256_sub_epi32(Temp, V2[ll]), Sample);
+      V2[ll] = V1[ll];
+      V1[ll] = Temp;
+    }
+  }
+  for (int ll = 0; ll < LANES; ++ll) {
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(Vk1 + 8 * ll), V1[ll]);
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(Vk2 + 8 * ll), V2[ll]);
+  }
+}
+
+// The vector kernels work on whole vectors, so the coefficient and state
+// arrays are padded with zero coefficients up to a multiple of the vector
+// width.  At most 3 vectors are kept in registers per pass over the samples,
+// which covers all 18 DTMF coefficients in a single AVX2 pass.
+static void goertzel_kernel_sse41(const int16_t Koeffs[], uint32_t KOEFF_COUNT,
+                                  const int16_t arraySamples[], uint32_t COUNT,
+                                  int32_t Vk1[], int32_t Vk2[]) {
+  for (uint32_t kk = 0; kk < KOEFF_COUNT; kk += 12) {
+    switch ((KOEFF_COUNT - kk + 3) / 4) {
+    case 1:
+      goertzel_pass_sse41<1>(Koeffs + kk, arraySamples, COUNT, Vk1 + kk,
+                             Vk2 + kk);
+      break;
+    case 2:
+      goertzel_pass_sse41<2>(Koeffs + kk, arraySamples, COUNT, Vk1 + kk,
+                             Vk2 + kk);
+      break;
+    default:
+      goertzel_pass_sse41<3>(Koeffs + kk, arraySamples, COUNT, Vk1 + kk,
+                             Vk2 + kk);
+      break;
+    }
+  }
+}
+
+static void goertzel_kernel_avx2(const int16_t Koeffs[], uint32_t KOEFF_COUNT,
+                                 const int16_t arraySamples[], uint32_t COUNT,
+                                 int32_t Vk1[], int32_t Vk2[]) {
+  for (uint32_t kk = 0; kk < KOEFF_COUNT; kk += 24) {
+    switch ((KOEFF_COUNT - kk + 7) / 8) {
+    case 1:
+      goertzel_pass_avx2<1>(Koeffs + kk, arraySamples, COUNT, Vk1 + kk,
+                            Vk2 + kk);
+      break;
+    case 2:
+      goertzel_pass_avx2<2>(Koeffs + kk, arraySamples, COUNT, Vk1 + kk,
+                            Vk2 + kk);
+      break;
+    default:
+      goertzel_pass_avx2<3>(Koeffs + kk, arraySamples, COUNT, Vk1 + kk,
+                            Vk2 + kk);
+      break;
+    }
+  }
+}
+
+// BINS is the number of coefficients whose recurrences are interleaved in
+// registers, so that the long multiply latency of one recurrence is hidden
+// behind the others.
+template <int BINS>
+__attribute__((target("sse4.1"))) static void
+goertzel_channel_pass_sse41(const int16_t Koeffs[],
+                            const int32_t arraySamples[],
+                            uint32_t CHANNEL_COUNT, uint32_t COUNT,
+                            int32_t Magnitudes[]) {
+  for (uint32_t cc = 0; cc < CHANNEL_COUNT; cc += 4) {
+    __m128i K[BINS], V1[BINS], V2[BINS];
+    for (int bb = 0; bb < BINS; ++bb) {
+      K[bb] = _mm_set1_epi32(Koeffs[bb]);
+      V1[bb] = V2[bb] = _mm_setzero_si128();
+    }
+    const int32_t *Row = arraySamples + cc;
+    for (uint32_t ii = 0; ii < COUNT; ++ii, Row += CHANNEL_COUNT) {
+      __m128i Sample = _mm_loadu_si128(reinterpret_cast<const __m128i *>(Row));
+      for (int bb = 0; bb < BINS; ++bb) {
+        __m128i Temp = mpy48sr_sse41(K[bb], _mm_slli_epi32(V1[bb], 1));
+        Temp = _mm_add_epi32(_mm_sub_epi32(Temp, V2[bb]), Sample);
+        V2[bb] = V1[bb];
+        V1[bb] = Temp;
+      }
+    }
+    for (int bb = 0; bb < BINS; ++bb) {
+      int32_t Vk1[4], Vk2[4];
+      _mm_storeu_si128(reinterpret_cast<__m128i *>(Vk1), V1[bb]);
+      _mm_storeu_si128(reinterpret_cast<__m128i *>(Vk2), V2[bb]);
+      for (int ll = 0; ll < 4; ++ll)
+        Magnitudes[bb * CHANNEL_COUNT + cc + ll] =
+            goertzel_magnitude(Koeffs[bb], Vk1[ll], Vk2[ll]);
+    }
+  }
+}
+
+template <int BINS>
+__attribute__((target("avx2"))) static void
+goertzel_channel_pass_avx2(const int16_t Koeffs[],
+                           const int32_t arraySamples[],
+                           uint32_t CHANNEL_COUNT, uint32_t COUNT,
+                           int32_t Magnitudes[]) {
+  for (uint32_t cc = 0; cc < CHANNEL_COUNT; cc += 8) {
+    __m256i K[BINS], V1[BINS], V2[BINS];
+    for (int bb = 0; bb < BINS; ++bb) {
+      K[bb] = _mm256_set1_epi32(Koeffs[bb]);
+      V1[bb] = V2[bb] = _mm256_setzero_si256();
+    }
+    const int32_t *Row = arraySamples + cc;
+    for (uint32_t ii = 0; ii < COUNT; ++ii, Row += CHANNEL_COUNT) {
+      __m256i Sample =
+          _mm256_loadu_si256(reinterpret_cast<const __m256i *>(Row));
+      for (int bb = 0; bb < BINS; ++bb) {
+        __m256i Temp = mpy48sr_avx2(K[bb], _mm256_slli_epi32(V1[bb], 1));
+        Temp = _mm256_add_epi32(_mm256_sub_epi32(Temp, V2[bb]), Sample);
+        V2[bb] = V1[bb];
+        V1[bb] = Temp;
+      }
+    }
+    for (int bb = 0; bb < BINS; ++bb) {
+      int32_t Vk1[8], Vk2[8];
+      _mm256_storeu_si256(reinterpret_cast<__m256i *>(Vk1), V1[bb]);
+      _mm256_storeu_si256(reinterpret_cast<__m256i *>(Vk2), V2[bb]);
+      for (int ll = 0; ll < 8; ++ll)
+        Magnitudes[bb * CHANNEL_COUNT + cc + ll] =
+            goertzel_magnitude(Koeffs[bb], Vk1[ll], Vk2[ll]);
+    }
+  }
+}
+
+// Up to 4 coefficients are interleaved per pass over the channels.
+static void goertzel_channel_kernel_sse41(const int16_t Koeffs[],
+                                          uint32_t KOEFF_COUNT,
+                                          const int32_t arraySamples[],
+                                          uint32_t CHANNEL_COUNT,
+                                          uint32_t COUNT,
+                                          int32_t Magnitudes[]) {
+  for (uint32_t kk = 0; kk < KOEFF_COUNT; kk += 4) {
+    int32_t *Out = Magnitudes + kk * CHANNEL_COUNT;
+    switch (KOEFF_COUNT - kk) {
+    case 1:
+      goertzel_channel_pass_sse41<1>(Koeffs + kk, arraySamples,
+                                     CHANNEL_COUNT, COUNT, Out);
+      break;
+    case 2:
+      goertzel_channel_pass_sse41<2>(Koeffs + kk, arraySamples,
+                                     CHANNEL_COUNT, COUNT, Out);
+      break;
+    case 3:
+      goertzel_channel_pass_sse41<3>(Koeffs + kk, arraySamples,
+                                     CHANNEL_COUNT, COUNT, Out);
+      break;
+    default:
+      goertzel_channel_pass_sse41<4>(Koeffs + kk, arraySamples,
+                                     CHANNEL_COUNT, COUNT, Out);
+      break;
+    }
+  }
+}
+
+static void goertzel_channel_kernel_avx2(const int16_t Koeffs[],
+                                         uint32_t KOEFF_COUNT,
+                                         const int32_t arraySamples[],
+                                         uint32_t CHANNEL_COUNT, uint32_t COUNT,
+                                         int32_t Magnitudes[]) {
+  for (uint32_t kk = 0; kk < KOEFF_COUNT; kk += 4) {
+    int32_t *Out = Magnitudes + kk * CHANNEL_COUNT;
+    switch (KOEFF_COUNT - kk) {
+    case 1:
+      goertzel_channel_pass_avx2<1>(Koeffs + kk, arraySamples,
+                                    CHANNEL_COUNT, COUNT, Out);
+      break;
+    case 2:
+      goertzel_channel_pass_avx2<2>(Koeffs + kk, arraySamples,
+                                    CHANNEL_COUNT, COUNT, Out);
+      break;
+    case 3:
+      goertzel_channel_pass_avx2<3>(Koeffs + kk, arraySamples,
+                                    CHANNEL_COUNT, COUNT, Out);
+      break;
+    default:
+      goertzel_channel_pass_avx2<4>(Koeffs + kk, arraySamples,
+                                    CHANNEL_COUNT, COUNT, Out);
+      break;
+    }
+  }
+}
+
+#endif
+
+// The single-precision kernels advance the same recurrences in float:
+// output = Input + coeff*prev - prev_prev
+// with coeff = 2*cos(w), i.e. Koeff / 2**14.  Koeffs, Vk1 and Vk2 are
+// KOEFF_COUNT elements long.
+typedef void (*goertzel_float_kernel)(const float Koeffs[],
+                                      uint32_t KOEFF_COUNT,
+                                      const int16_t arraySamples[],
+                                      uint32_t COUNT, float Vk1[],
+                                      float Vk2[]);
+
+static void goertzel_float_kernel_scalar(const float Koeffs[],
+                                         uint32_t KOEFF_COUNT,
+                                         const int16_t arraySamples[],
+                                         uint32_t COUNT, float Vk1[],
+                                         float Vk2[]) {
+  for (uint32_t ii = 0; ii < COUNT; ++ii) {
+    float Sample = arraySamples[ii];
+    for (uint32_t kk = 0; kk < KOEFF_COUNT; ++kk) {
+      float Temp = Koeffs[kk] * Vk1[kk] + (Sample - Vk2[kk]);
+      Vk2[kk] = Vk1[kk];
+      Vk1[kk] = Temp;
+    }
+  }
+}
+
+#ifdef GOERTZEL_X86
+
+// LANES is the number of 8-lane vectors kept in registers for the whole pass.
+// Each step is a single fused multiply-add on the critical path, where the
+// fixed-point kernels have two 32-bit multiplies.
+template <int LANES>
+__attribute__((target("avx2,fma"))) static void
+goertzel_float_pass_fma(const float Koeffs[], const int16_t arraySamples[],
+                        uint32_t COUNT, float Vk1[], float Vk2[]) {
+  __m256 K[LANES], V1[LANES], V2[LANES];
+  for (int ll = 0; ll < LANES; ++ll) {
+    K[ll] = _mm256_loadu_ps(Koeffs + 8 * ll);
+    V1[ll] = _mm256_loadu_ps(Vk1 + 8 * ll);
+    V2[ll] = _mm256_loadu_ps(Vk2 + 8 * ll);
+  }
+  for (uint32_t ii = 0; ii < COUNT; ++ii) {
+    __m256 Sample = _mm256_set1_ps(arraySamples[ii]);
+    for (int ll = 0; ll < LANES; ++ll) {
+      __m256 Temp =
+          _mm256_fmadd_ps(K[ll], V1[ll], _mm256_sub_ps(Sample, V2[ll]));
+      V2[ll] = V1[ll];
+      V1[ll] = Temp;
+    }
+  }
+  for (int ll = 0; ll < LANES; ++ll) {
+    _mm256_storeu_ps(Vk1 + 8 * ll, V1[ll]);
+    _mm256_storeu_ps(Vk2 + 8 * ll, V2[ll]);
+  }
+}
+
+// Padded like the fixed-point vector kernels.
+static void goertzel_float_kernel_fma(const float Koeffs[],
+                                      uint32_t KOEFF_COUNT,
+                                      const int16_t arraySamples[],
+                                      uint32_t COUNT, float Vk1[],
+                                      float Vk2[]) {
+  for (uint32_t kk = 0; kk < KOEFF_COUNT; kk += 24) {
+    switch ((KOEFF_COUNT - kk + 7) / 8) {
+    case 1:
+      goertzel_float_pass_fma<1>(Koeffs + kk, arraySamples, COUNT, Vk1 + kk,
+                                 Vk2 + kk);
+      break;
+    case 2:
+      goertzel_float_pass_fma<2>(Koeffs + kk, arraySamples, COUNT, Vk1 + kk,
+                                 Vk2 + kk);
+      break;
+    default:
+      goertzel_float_pass_fma<3>(Koeffs + kk, arraySamples, COUNT, Vk1 + kk,
+                                 Vk2 + kk);
+      break;
+    }
+  }
+}
+
+#endif
+
+struct goertzel_kernels {
+  goertzel_kernel bins;
+  goertzel_channel_kernel channels;
+  goertzel_float_kernel float_bins;
+};
+
+// Pick the widest kernels the CPU supports.
+static goertzel_kernels select_goertzel_kernels() {
+  goertzel_kernels Kernels = {goertzel_kernel_scalar,
+                              goertzel_channel_kernel_scalar,
+                              goertzel_float_kernel_scalar};
+#ifdef GOERTZEL_X86
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+    Kernels.float_bins = goertzel_float_kernel_fma;
+  if (__builtin_cpu_supports("avx2")) {
+    Kernels.bins = goertzel_kernel_avx2;
+    Kernels.channels = goertzel_channel_kernel_avx2;
+  } else if (__builtin_cpu_supports("sse4.1")) {
+    Kernels.bins = goertzel_kernel_sse41;
+    Kernels.channels = goertzel_channel_kernel_sse41;
+  }
+#endif
+  return Kernels;
+}
+
+static const goertzel_kernels &kernels() {
+  static const goertzel_kernels Kernels = select_goertzel_kernels();
+  return Kernels;
+}
+
+void goertzel_filter_bank(const int16_t Koeffs[], uint32_t KOEFF_COUNT,
+                          const int16_t arraySamples[], uint32_t COUNT,
+                          int32_t Magnitudes[], int32_t MagnitudeShift) {
+  assert(KOEFF_COUNT <= GOERTZEL_MAX_KOEFFS);
+
+  // Koeff    The coefficients, padded with zeros to a whole vector.
+  // Vk1      prev, one per coefficient
+  // Vk2      prev_prev, one per coefficient
+  int16_t Koeff[GOERTZEL_MAX_KOEFFS] = {0};
+  int32_t Vk1[GOERTZEL_MAX_KOEFFS] = {0}, Vk2[GOERTZEL_MAX_KOEFFS] = {0};
+  uint32_t kk;
+
+  for (kk = 0; kk < KOEFF_COUNT; ++kk)
+    Koeff[kk] = Koeffs[kk];
+
+  kernels().bins(Koeff, KOEFF_COUNT, arraySamples, COUNT, Vk1, Vk2);
+
+  for (kk = 0; kk < KOEFF_COUNT; ++kk)
+    Magnitudes[kk] =
+        goertzel_magnitude(Koeff[kk], Vk1[kk], Vk2[kk], MagnitudeShift);
+}
+
+// A Q14 coefficient in float is exact: 2^-14 is a power of two.
+const float KOEFF_SCALE = 1.0f / (1 << 14);
+
+void goertzel_filter_bank_float(const int16_t Koeffs[], uint32_t KOEFF_COUNT,
+                                const int16_t arraySamples[], uint32_t COUNT,
+                                int32_t Shift, int32_t Magnitudes[],
+                                int32_t MagnitudeShift) {
+  assert(KOEFF_COUNT <= GOERTZEL_MAX_KOEFFS);
+
+  // Koeff    2*cos(w), padded with zeros to a whole vector.  Scaling by a
+  //          power of two is exact.
+  // Vk1      prev, one per coefficient
+  // Vk2      prev_prev, one per coefficient
+  float Koeff[GOERTZEL_MAX_KOEFFS] = {0};
+  float Vk1[GOERTZEL_MAX_KOEFFS] = {0}, Vk2[GOERTZEL_MAX_KOEFFS] = {0};
+
+  for (uint32_t kk = 0; kk < KOEFF_COUNT; ++kk)
+    Koeff[kk] = Koeffs[kk] * KOEFF_SCALE;
+
+  kernels().float_bins(Koeff, KOEFF_COUNT, arraySamples, COUNT, Vk1, Vk2);
+
+  goertzel_state_magnitudes_float(Koeffs, KOEFF_COUNT, Vk1, Vk2, Shift,
+                                  Magnitudes, MagnitudeShift);
+}
+
+void goertzel_advance(const int16_t Koeffs[], uint32_t KOEFF_COUNT,
+                      const int16_t arraySamples[], uint32_t COUNT,
+                      int32_t Vk1[], int32_t Vk2[]) {
+  assert(KOEFF_COUNT <= GOERTZEL_MAX_KOEFFS);
+
+  // The kernels need the same padding as in goertzel_filter_bank.
+  int16_t Koeff[GOERTZEL_MAX_KOEFFS];
+  int32_t Vk1Pad[GOERTZEL_MAX_KOEFFS], Vk2Pad[GOERTZEL_MAX_KOEFFS];
+  uint32_t kk;
+
+  for (kk = 0; kk < KOEFF_COUNT; ++kk) {
+    Koeff[kk] = Koeffs[kk];
+    Vk1Pad[kk] = Vk1[kk];
+    Vk2Pad[kk] = Vk2[kk];
+  }
+  // Zeroing a whole AVX2 vector of padding is enough, and much cheaper than
+  // zeroing all of GOERTZEL_MAX_KOEFFS on every hop.
+  for (; kk < ((KOEFF_COUNT + 7) & ~7u); ++kk)
+    Koeff[kk] = 0, Vk1Pad[kk] = 0, Vk2Pad[kk] = 0;
+
+  kernels().bins(Koeff, KOEFF_COUNT, arraySamples, COUNT, Vk1Pad, Vk2Pad);
+
+  for (kk = 0; kk < KOEFF_COUNT; ++kk) {
+    Vk1[kk] = Vk1Pad[kk];
+    Vk2[kk] = Vk2Pad[kk];
+  }
+}
+
+void goertzel_advance_float(const int16_t Koeffs[], uint32_t KOEFF_COUNT,
+                            const int16_t arraySamples[], uint32_t COUNT,
+                            float Vk1[], float Vk2[]) {
+  assert(KOEFF_COUNT <= GOERTZEL_MAX_KOEFFS);
+
+  // Padded as in goertzel_advance.
+  float Koeff[GOERTZEL_MAX_KOEFFS];
+  float Vk1Pad[GOERTZEL_MAX_KOEFFS], Vk2Pad[GOERTZEL_MAX_KOEFFS];
+  uint32_t kk;
+
+  for (kk = 0; kk < KOEFF_COUNT; ++kk) {
+    Koeff[kk] = Koeffs[kk] * KOEFF_SCALE;
+    Vk1Pad[kk] = Vk1[kk];
+    Vk2Pad[kk] = Vk2[kk];
+  }
+  for (; kk < ((KOEFF_COUNT + 7) & ~7u); ++kk)
+    Koeff[kk] = 0, Vk1Pad[kk] = 0, Vk2Pad[kk] = 0;
+
+  kernels().float_bins(Koeff, KOEFF_COUNT, arraySamples, COUNT, Vk1Pad,
+                       Vk2Pad);
+
+  for (kk = 0; kk < KOEFF_COUNT; ++kk) {
+    Vk1[kk] = Vk1Pad[kk];
+    Vk2[kk] = Vk2Pad[kk];
+  }
+}
+
+void goertzel_state_magnitudes_float(const int16_t Koeffs[],
+                                     uint32_t KOEFF_COUNT, const float Vk1[],
+                                     const float Vk2[], int32_t Shift,
+                                     int32_t Magnitudes[],
+                                     int32_t MagnitudeShift) {
+  // The state of the fixed-point recurrences on the shifted samples, before
+  // goertzel_magnitude shifts it right by MagnitudeShift.
+  const float Scale = std::ldexp(1.0f, Shift - MagnitudeShift);
+  for (uint32_t kk = 0; kk < KOEFF_COUNT; ++kk) {
+    float Koeff = Koeffs[kk] * KOEFF_SCALE;
+    float Prev = Vk1[kk] * Scale, PrevPrev = Vk2[kk] * Scale;
+    float Magnitude =
+        Prev * Prev + PrevPrev * PrevPrev - Koeff * Prev * PrevPrev;
+    // Never negative but for rounding; clamp rather than wrap.
+    if (Magnitude <= 0)
+      Magnitudes[kk] = 0;
+    else if (Magnitude >= 2147483520.0f)
+      Magnitudes[kk] = INT32_MAX;
+    else
+      Magnitudes[kk] = static_cast<int32_t>(Magnitude);
+  }
+}
+
+void goertzel_filter_channels(const int16_t Koeffs[], uint32_t KOEFF_COUNT,
+                              const int32_t arraySamples[],
+                              uint32_t CHANNEL_COUNT, uint32_t COUNT,
+                              int32_t Magnitudes[]) {
+  assert(CHANNEL_COUNT % GOERTZEL_CHANNEL_ALIGN == 0);
+  kernels().channels(Koeffs, KOEFF_COUNT, arraySamples, CHANNEL_COUNT, COUNT,
+                     Magnitudes);
+}
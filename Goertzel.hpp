@@ -0,0 +1,108 @@
+//
+// Multi-frequency fixed-point Goertzel kernel shared by the DTMF detector.
+//
+
+#ifndef DTMF_GOERTZEL
+#define DTMF_GOERTZEL
+
+#include <stdint.h>
+
+// The largest number of coefficients goertzel_filter_bank accepts in a single
+// call.
+const unsigned GOERTZEL_MAX_KOEFFS = 48;
+
+// The Goertzel state is shifted right by this many bits before the magnitudes
+// are computed, so that they fit in 32 bits.  Right for batches of 102
+// samples; longer batches need more, see DtmfRateTables.
+const int32_t GOERTZEL_MAGNITUDE_SHIFT = 10;
+
+// The fixed-point Goertzel algorithm, run for several frequencies at once.
+// For a good description and walkthrough, see:
+// https://sites.google.com/site/hobbydebraj/home/goertzel-algorithm-dtmf-detection
+//
+// Every coefficient gets its own recurrence, but all of them are advanced
+// together in a single pass over arraySamples.  On x86 the recurrences are
+// packed into SSE4.1 or AVX2 lanes, whichever the CPU supports (checked once,
+// at runtime); everywhere else a portable scalar loop is used.  Building with
+// DTMF_NO_SIMD defined forces the scalar loop.  All variants produce exactly
+// the same magnitudes.
+//
+// Koeffs           Coefficients, one per frequency.  Must be KOEFF_COUNT
+//                  elements long.
+// KOEFF_COUNT      The number of coefficients, at most GOERTZEL_MAX_KOEFFS.
+// arraySamples     Input samples to process.  Must be COUNT elements long.
+// COUNT            The number of elements in arraySamples.
+// Magnitudes       Detected magnitude of each frequency.  Must be KOEFF_COUNT
+//                  elements long.
+// MagnitudeShift   See GOERTZEL_MAGNITUDE_SHIFT.
+void goertzel_filter_bank(
+    const int16_t Koeffs[], uint32_t KOEFF_COUNT, const int16_t arraySamples[],
+    uint32_t COUNT, int32_t Magnitudes[],
+    int32_t MagnitudeShift = GOERTZEL_MAGNITUDE_SHIFT);
+
+// goertzel_filter_bank in single precision, for DTMF_BACKEND_FLOAT.  The
+// recurrences run in float on the samples as they are, with fused
+// multiply-adds in AVX2 lanes where the CPU has them (and a scalar loop
+// otherwise), so nothing is truncated along the way.  The magnitudes come
+// out on the scale of goertzel_filter_bank run on the samples shifted left
+// by Shift bits, and agree with it to within its rounding; values that do
+// not fit in 31 bits are clamped.
+void goertzel_filter_bank_float(
+    const int16_t Koeffs[], uint32_t KOEFF_COUNT, const int16_t arraySamples[],
+    uint32_t COUNT, int32_t Shift, int32_t Magnitudes[],
+    int32_t MagnitudeShift = GOERTZEL_MAGNITUDE_SHIFT);
+
+// The recurrences of goertzel_filter_bank alone, for input that arrives in
+// pieces: their state is carried from one call to the next.
+//
+// Vk1              prev, one per coefficient.  Must be KOEFF_COUNT elements
+//                  long and start out as zeros.
+// Vk2              prev_prev, one per coefficient.  Likewise.
+void goertzel_advance(const int16_t Koeffs[], uint32_t KOEFF_COUNT,
+                      const int16_t arraySamples[], uint32_t COUNT,
+                      int32_t Vk1[], int32_t Vk2[]);
+
+// goertzel_filter_bank_float split in two: the recurrences are advanced over
+// each piece with goertzel_advance_float, and the magnitudes are computed
+// from the final state with goertzel_state_magnitudes_float.  Each sample
+// goes through exactly the same operations as in a single pass, so the
+// magnitudes are bit for bit those of goertzel_filter_bank_float, however
+// the input is split.
+//
+// Vk1              prev, one per coefficient.  Must be KOEFF_COUNT elements
+//                  long and start out as zeros.
+// Vk2              prev_prev, one per coefficient.  Likewise.
+void goertzel_advance_float(const int16_t Koeffs[], uint32_t KOEFF_COUNT,
+                            const int16_t arraySamples[], uint32_t COUNT,
+                            float Vk1[], float Vk2[]);
+
+// Shift            As in goertzel_filter_bank_float.
+void goertzel_state_magnitudes_float(
+    const int16_t Koeffs[], uint32_t KOEFF_COUNT, const float Vk1[],
+    const float Vk2[], int32_t Shift, int32_t Magnitudes[],
+    int32_t MagnitudeShift = GOERTZEL_MAGNITUDE_SHIFT);
+
+// goertzel_filter_channels processes channels in groups of this many.
+const unsigned GOERTZEL_CHANNEL_ALIGN = 8;
+
+// The same algorithm as goertzel_filter_bank, run over CHANNEL_COUNT
+// independent channels at once, one channel per SIMD lane.
+//
+// Koeffs           Coefficients, one per frequency.  Must be KOEFF_COUNT
+//                  elements long.
+// KOEFF_COUNT      The number of coefficients.
+// arraySamples     Input samples, already widened to 32 bits and laid out
+//                  frame by frame: sample ii of channel cc is at
+//                  arraySamples[ii * CHANNEL_COUNT + cc].
+// CHANNEL_COUNT    The number of channels.  Must be a multiple of
+//                  GOERTZEL_CHANNEL_ALIGN; pad with silent channels.
+// COUNT            The number of frames in arraySamples.
+// Magnitudes       Detected magnitudes, laid out coefficient by coefficient:
+//                  coefficient kk of channel cc is at
+//                  Magnitudes[kk * CHANNEL_COUNT + cc].
+void goertzel_filter_channels(const int16_t Koeffs[], uint32_t KOEFF_COUNT,
+                              const int32_t arraySamples[],
+                              uint32_t CHANNEL_COUNT, uint32_t COUNT,
+                              int32_t Magnitudes[]);
+
+#endif
@@ -0,0 +1,108 @@
+//
+// A bounded lock-free queue for many producer threads and one consumer.
+//
+
+#ifndef MPSC_QUEUE
+#define MPSC_QUEUE
+
+#include <atomic>
+#include <cassert>
+#include <cstddef>
+#include <memory>
+
+#include "SpscRing.hpp"
+
+// A ring of cells, each with a sequence number that says whether it is free
+// for the producer whose turn it is or holds an element for the consumer
+// (D. Vyukov's bounded MPMC queue, with a single consumer).  Producers claim
+// a cell with a compare-and-swap on the tail, the consumer takes from the
+// head without any atomic read-modify-write.  The capacity is rounded up to
+// a power of two and all of the memory is allocated by the constructor:
+// Push never allocates, and reports a full queue instead.
+//
+// A producer that is preempted between claiming its cell and filling it in
+// hides its element, and the ones pushed after it, from Pop until it runs
+// again.
+template <typename T> class MpscQueue {
+public:
+  explicit MpscQueue(size_t capacity)
+      : mask_(round_up_capacity(capacity) - 1), cells_(new Cell[mask_ + 1]),
+        head_(0), tail_(0) {
+    for (size_t ii = 0; ii <= mask_; ++ii)
+      cells_[ii].sequence.store(ii, std::memory_order_relaxed);
+  }
+
+  MpscQueue(const MpscQueue &) = delete;
+  MpscQueue &operator=(const MpscQueue &) = delete;
+
+  size_t capacity() const { return mask_ + 1; }
+
+  // Any thread.  Returns false, queueing nothing, if the queue is full.
+  bool Push(const T &value) {
+    size_t tail = tail_.load(std::memory_order_relaxed);
+    Cell *cell;
+    for (;;) {
+      cell = &cells_[tail & mask_];
+      size_t sequence = cell->sequence.load(std::memory_order_acquire);
+      if (sequence == tail) {
+        // The cell is free; claim it, unless another producer got there
+        // first.
+        if (tail_.compare_exchange_weak(tail, tail + 1,
+                                        std::memory_order_relaxed))
+          break;
+      } else if (sequence < tail) {
+        // The cell still holds the element of the lap before.
+        return false;
+      } else {
+        tail = tail_.load(std::memory_order_relaxed);
+      }
+    }
+    cell->value = value;
+    cell->sequence.store(tail + 1, std::memory_order_release);
+    return true;
+  }
+
+  // The consumer thread only.  Returns false if the queue is empty.
+  bool Pop(T *value) {
+    Cell &cell = cells_[head_ & mask_];
+    if (cell.sequence.load(std::memory_order_acquire) != head_ + 1)
+      return false;
+    *value = cell.value;
+    // Free the cell for the producer one lap ahead.
+    cell.sequence.store(head_ + mask_ + 1, std::memory_order_release);
+    ++head_;
+    return true;
+  }
+
+  // The consumer thread only.
+  bool empty() const {
+    return cells_[head_ & mask_].sequence.load(std::memory_order_acquire) !=
+           head_ + 1;
+  }
+
+private:
+  struct Cell {
+    // The index the cell is free for while it equals it, and holds the
+    // element of while it is one more.
+    std::atomic<size_t> sequence;
+    T value;
+  };
+
+  static size_t round_up_capacity(size_t capacity) {
+    assert(capacity > 0);
+    size_t rounded = 1;
+    while (rounded < capacity)
+      rounded <<= 1;
+    return rounded;
+  }
+
+  size_t mask_;
+  std::unique_ptr<Cell[]> cells_;
+
+  // head_ is the index of the next element to pop, tail_ that of the next
+  // cell to claim.  Both grow without bound and are masked on access.
+  alignas(SPSC_CACHE_LINE) size_t head_;
+  alignas(SPSC_CACHE_LINE) std::atomic<size_t> tail_;
+};
+
+#endif
@@ -0,0 +1,140 @@
+//
+// A bounded lock-free queue for exactly one producer and one consumer thread.
+//
+
+#ifndef SPSC_RING
+#define SPSC_RING
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cstddef>
+#include <vector>
+
+// The size of a cache line, so that the producer's and the consumer's
+// indices do not share one.
+const size_t SPSC_CACHE_LINE = 64;
+
+// Elements are written by one thread and read by another without locks.
+// The capacity is rounded up to a power of two and all of the memory is
+// allocated by the constructor.  Besides copying elements in and out, the
+// producer can write elements in place (Reserve) and publish them afterwards
+// (Commit), and the consumer can look at the readable elements in place
+// (Peek) and release them afterwards (Consume).
+template <typename T> class SpscRing {
+public:
+  explicit SpscRing(size_t capacity)
+      : elements_(round_up_capacity(capacity)), mask_(elements_.size() - 1),
+        head_(0), tail_(0), cached_head_(0), cached_tail_(0) {}
+
+  size_t capacity() const { return elements_.size(); }
+
+  // Producer.  Copies as many of the count elements as fit, and returns how
+  // many that was.
+  size_t Write(const T *data, size_t count) {
+    size_t tail = tail_.load(std::memory_order_relaxed);
+    if (cached_head_ + elements_.size() - tail < count)
+      cached_head_ = head_.load(std::memory_order_acquire);
+    count = std::min(count, cached_head_ + elements_.size() - tail);
+
+    size_t first = std::min(count, elements_.size() - (tail & mask_));
+    std::copy(data, data + first, &elements_[tail & mask_]);
+    std::copy(data + first, data + count, &elements_[0]);
+    tail_.store(tail + count, std::memory_order_release);
+    return count;
+  }
+
+  bool Push(const T &element) { return Write(&element, 1) == 1; }
+
+  // Producer.  Points *data at the oldest free elements, to be written in
+  // place, and returns how many of them are contiguous; call again after
+  // Commit for the rest.
+  size_t Reserve(T **data) {
+    size_t tail = tail_.load(std::memory_order_relaxed);
+    size_t contiguous = elements_.size() - (tail & mask_);
+    if (cached_head_ + elements_.size() - tail < contiguous)
+      cached_head_ = head_.load(std::memory_order_acquire);
+    *data = &elements_[tail & mask_];
+    return std::min(cached_head_ + elements_.size() - tail, contiguous);
+  }
+
+  // Producer.  Publishes the count oldest free elements, which must have been
+  // returned by Reserve and written.
+  void Commit(size_t count) {
+    tail_.store(tail_.load(std::memory_order_relaxed) + count,
+                std::memory_order_release);
+  }
+
+  // Consumer.  Points *data at the oldest readable elements, and returns how
+  // many of them are contiguous; call again after Consume for the rest.
+  size_t Peek(const T **data) {
+    size_t head = head_.load(std::memory_order_relaxed);
+    if (cached_tail_ == head)
+      cached_tail_ = tail_.load(std::memory_order_acquire);
+    *data = &elements_[head & mask_];
+    return std::min(cached_tail_ - head, elements_.size() - (head & mask_));
+  }
+
+  // Consumer.  Releases the count oldest elements, which must have been
+  // returned by Peek.
+  void Consume(size_t count) {
+    head_.store(head_.load(std::memory_order_relaxed) + count,
+                std::memory_order_release);
+  }
+
+  // Consumer.  Copies up to count elements out, and returns how many.
+  size_t Read(T *data, size_t count) {
+    size_t done = 0;
+    while (done < count) {
+      const T *src;
+      size_t available = std::min(Peek(&src), count - done);
+      if (available == 0)
+        break;
+      std::copy(src, src + available, data + done);
+      Consume(available);
+      done += available;
+    }
+    return done;
+  }
+
+  bool Pop(T *element) { return Read(element, 1) == 1; }
+
+  // The number of readable elements.  Exact only on the consumer side, and
+  // only while the producer is idle.
+  size_t size() const {
+    return tail_.load(std::memory_order_acquire) -
+           head_.load(std::memory_order_acquire);
+  }
+
+  // Empties the ring.  Only while neither side is using it.
+  void Clear() {
+    head_.store(0, std::memory_order_relaxed);
+    tail_.store(0, std::memory_order_relaxed);
+    cached_head_ = 0;
+    cached_tail_ = 0;
+  }
+
+private:
+  static size_t round_up_capacity(size_t capacity) {
+    assert(capacity > 0);
+    size_t rounded = 1;
+    while (rounded < capacity)
+      rounded <<= 1;
+    return rounded;
+  }
+
+  std::vector<T> elements_;
+  size_t mask_;
+
+  // head_ is the index of the next element to read and only moves on the
+  // consumer side, tail_ the index of the next one to write, on the producer
+  // side.  Both grow without bound and are masked on access.  Each side keeps
+  // the last value of the other side's index it saw, and only reloads it
+  // when that is not enough.
+  alignas(SPSC_CACHE_LINE) std::atomic<size_t> head_;
+  alignas(SPSC_CACHE_LINE) std::atomic<size_t> tail_;
+  alignas(SPSC_CACHE_LINE) size_t cached_head_;
+  alignas(SPSC_CACHE_LINE) size_t cached_tail_;
+};
+
+#endif
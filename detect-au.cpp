@@ -1,157 +1,133 @@
 //
-// Utilize the DtmfDetector to detect tones in an AU file.
-// The file must be 8KHz, PCM encoded, mono.
+// Utilize the DtmfDetector to detect tones in AU and WAV files.
+// The files must be PCM (8 or 16 bits) or G.711 encoded, at 8KHz to 48KHz.
+// Every channel is scanned on its own.
+//
+// usage: detect-au [--no-mmap] filename...
+//
+// For every file, prints its format, then a line for every tone as soon as
+// it has ended: its channel, the tone, and its start and duration in
+// seconds.  The digits found in each channel come last.
 //
 
-#include <cassert>
 #include <cstdio>
-#include <cstdlib>
-#include <fstream>
-#include <iostream>
-#include <sstream>
+#include <cstring>
+#include <memory>
 #include <string>
+#include <vector>
 
 #include <stdint.h>
 
+#include "AudioFile.hpp"
 #include "DtmfDetector.hpp"
 
 //
-// The string ".snd" in big-endian byte ordering.  This identifies the file as
-// an AU sound file.
-//
-#define AU_MAGIC 0x2e736e64
-
-//
-// The size of the buffer we use for reading & processing the audio samples.
+// The number of frames handed to the detector at a time.  Large, so that the
+// per-call overhead vanishes; each channel is converted into a buffer of this
+// many samples at most.
 //
-
-using namespace std;
+const size_t CHUNK_FRAMES = 1 << 16;
 
 //
-// Swap the endianness of an 4-byte integer.
+// A detector that prints every tone it finds.
 //
-uint32_t swap32(uint32_t a) {
-  char b1, b2, b3, b4 = 0;
-  b1 = a;
-  b2 = a >> 8;
-  b3 = a >> 16;
-  b4 = a >> 24;
-  return (b1 << 24) + (b2 << 16) + (b3 << 8) + b4;
-}
-
-void swap16_inplace(uint16_t &a) {
-  a = ((a & 0x00FF) << 8) | ((a & 0xFF00) >> 8);
-}
-
-void swap16_inplace(int16_t &a) {
-  a = ((a & 0x00FF) << 8) | ((a & 0xFF00) >> 8);
-}
-
-struct au_header {
-  uint32_t magic;
-  uint32_t data_offset;
-  uint32_t data_size;
-  uint32_t encoding;
-  uint32_t sample_rate;
-  uint32_t nchannels;
+class ScanDetector : public DtmfDetectorBase {
+public:
+  ScanDetector(const DtmfRateTables &tables, int channel)
+      : DtmfDetectorBase(tables), channel_(channel) {}
+
+  const std::string &digits() const { return digits_; }
+
+private:
+  int channel_;
+  std::string digits_;
+
+  void OnToneEvent(const DtmfToneEvent &event) override {
+    double rate = sample_rate();
+    printf("%d %c %.3f %.3f\n", channel_, event.dial_char,
+           event.start_sample / rate, event.duration / rate);
+    digits_ += event.dial_char;
+  }
 };
 
-string au_header_tostr(au_header &h) {
-  stringstream ss;
-  ss << h.data_offset << " header bytes, " << h.data_size
-     << " data bytes, encoding type: " << h.encoding << ", " << h.sample_rate
-     << "Hz, " << h.nchannels << " channels";
-  return ss.str();
-}
-
-int main(int argc, char **argv) {
-  if (argc != 2) {
-    cerr << "usage: " << argv[0] << " filename.au" << endl;
-    return 1;
+static bool scan(const char *path, bool use_mmap) {
+  AudioFile file;
+  if (!file.Open(path, use_mmap)) {
+    fprintf(stderr, "%s: %s\n", path, file.error().c_str());
+    return false;
   }
-
-  ifstream fin(argv[1], ios::binary);
-  if (!fin.good()) {
-    cerr << argv[1] << ": unable to open file" << endl;
-    return 1;
+  const AudioFormat &format = file.format();
+  printf("%s: %s, %llu frames%s\n", path, audio_format_tostr(format).c_str(),
+         static_cast<unsigned long long>(file.frame_count()),
+         file.mapped() ? ", mapped" : "");
+
+  if (format.sample_rate < DTMF_BASE_SAMPLE_RATE ||
+      format.sample_rate > DTMF_MAX_SAMPLE_RATE) {
+    fprintf(stderr, "%s: unsupported sample rate\n", path);
+    return false;
   }
-  au_header header;
-  fin.read((char *)&header, sizeof(au_header));
-
-  //
-  // The data in the AU file header is stored in big-endian byte ordering.
-  // If we're on a little-endian machine, we need to reorder the bytes.
-  // While other arrangements (e.g. middle-endian) are also technically
-  // possible, this example does not support them, since they are relatively
-  // rare.
-  //
-  bool swap_endian = false;
-  if (header.magic == AU_MAGIC) {
-    swap_endian = false;
-  } else if (header.magic == swap32(AU_MAGIC)) {
-    swap_endian = true;
-    header.data_offset = swap32(header.data_offset);
-    header.data_size = swap32(header.data_size);
-    header.encoding = swap32(header.encoding);
-    header.sample_rate = swap32(header.sample_rate);
-    header.nchannels = swap32(header.nchannels);
-  } else {
-    cerr << "bad magic number: " << hex << header.magic << endl;
-    return 1;
+  const DtmfRateTables tables = dtmf_rate_tables(format.sample_rate);
+
+  std::vector<std::unique_ptr<ScanDetector>> detectors;
+  for (int ch = 0; ch < format.channel_count; ++ch)
+    detectors.emplace_back(new ScanDetector(tables, ch));
+
+  const bool mono = format.channel_count == 1;
+  const bool g711 =
+      format.encoding == AUDIO_ULAW || format.encoding == AUDIO_ALAW;
+  std::vector<int16_t> linear;
+
+  const uint8_t *data;
+  size_t count;
+  while ((count = file.Next(CHUNK_FRAMES, &data)) != 0) {
+    for (int ch = 0; ch < format.channel_count; ++ch) {
+      ScanDetector &detector = *detectors[ch];
+      if (mono && g711) {
+        // The detector decodes G.711 itself.
+        detector.Detect(data, static_cast<int>(count),
+                        format.encoding == AUDIO_ULAW ? G711_ULAW : G711_ALAW);
+      } else if (audio_is_native_linear(format) &&
+                 reinterpret_cast<uintptr_t>(data) % sizeof(int16_t) == 0) {
+        // Nothing to convert: detect in place.
+        detector.Detect(reinterpret_cast<const int16_t *>(data),
+                        static_cast<int>(count));
+      } else {
+        linear.resize(count);
+        audio_to_linear(format, data, count, ch, &linear[0]);
+        detector.Detect(&linear[0], static_cast<int>(count));
+      }
+    }
   }
 
-  cout << argv[1] << ": " << au_header_tostr(header) << endl;
-  //
-  // This example only supports a specific type of AU format:
-  //
-  // - no additional data in the header
-  // - linear PCM encoding
-  // - 8KHz sample rate
-  // - mono
-  //
-  if ((header.encoding != 2 && header.encoding != 3) ||
-      header.sample_rate != 8000 || header.nchannels != 1) {
-    cerr << argv[1] << ": unsupported AU format" << endl;
-    return 1;
+  for (int ch = 0; ch < format.channel_count; ++ch) {
+    detectors[ch]->Flush();
+    printf("%d: %s'\n", ch, detectors[ch]->digits().c_str());
   }
+  return true;
+}
 
-  fin.seekg(header.data_offset);
-
-  const int BUFLEN = 204;
-
-  int16_t sbuf[BUFLEN];
-  DtmfDetector detector;
-  while (true) {
-    if (header.encoding == 2) {
-      char cbuf[BUFLEN];
-      fin.read(cbuf, BUFLEN);
-      if (fin.eof()) {
-        break;
-      }
-
-      // Promote our 8-bit samples to 16 bits, since that's what the detector
-      // expects.  Shift them left during promotion, since the decoder won't
-      // pick them up otherwise (volume too low).
-      //
-      for (int j = 0; j < BUFLEN; ++j)
-        sbuf[j] = cbuf[j] << 8;
-
-    } else {
-      if (fin.eof()) {
-        break;
-      }
-      fin.read((char *)sbuf, BUFLEN * sizeof(int16_t));
-      if (swap_endian) {
-        for (int j = 0; j < BUFLEN; ++j) {
-          swap16_inplace(sbuf[j]);
-        }
-      }
-    }
-
-    detector.Detect(sbuf, BUFLEN);
-    cout << detector.GetResult() << "'" << endl;
+int main(int argc, char **argv) {
+  bool use_mmap = true;
+  std::vector<const char *> paths;
+  for (int ii = 1; ii < argc; ++ii) {
+    if (strcmp(argv[ii], "--no-mmap") == 0)
+      use_mmap = false;
+    else
+      paths.push_back(argv[ii]);
+  }
+  if (paths.empty()) {
+    fprintf(stderr, "usage: %s [--no-mmap] filename...\n", argv[0]);
+    return 1;
   }
 
-  fin.close();
-  return 0;
+  // Output is line by line, but nobody needs to see it before the next tone
+  // is found.
+  static char output[1 << 16];
+  setvbuf(stdout, output, _IOFBF, sizeof(output));
+
+  int status = 0;
+  for (const char *path : paths)
+    if (!scan(path, use_mmap))
+      status = 1;
+  return status;
 }
@@ -0,0 +1,702 @@
+//
+// Throughput benchmarks for the detector and the generator.
+//
+// Every benchmark is run for a growing number of iterations until it has
+// taken at least --benchmark_min_time seconds.  The results are printed as a
+// table, and written to --benchmark_out in the JSON format of Google
+// Benchmark, so that its tools/compare.py can compare two runs.
+//
+// usage: dtmf-bench [--benchmark_filter=REGEX] [--benchmark_min_time=SECONDS]
+//                   [--benchmark_out=FILE]
+//
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <functional>
+#include <memory>
+#include <regex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <stdint.h>
+
+#include "DtmfDetector.hpp"
+#include "DtmfDetectorBank.hpp"
+#include "DtmfGenerator.hpp"
+#include "DtmfGeneratorBank.hpp"
+#include "DtmfSampleRing.hpp"
+#include "DtmfThreadPool.hpp"
+
+//
+// The length of the test signals: 10 seconds at 8KHz.
+//
+const int SIGNAL_LENGTH = 80000;
+
+//
+// The frame size of the benchmarks that do not vary it: 20 ms, as in RTP.
+//
+const int FRAME_SIZE = 160;
+
+//
+// A small linear congruential generator, so that the signals are the same on
+// every platform.
+//
+struct Random {
+  uint32_t state;
+
+  explicit Random(uint32_t seed) : state(seed) {}
+
+  // Uniform in [-1, 1).
+  double Next() {
+    state = state * 1664525u + 1013904223u;
+    return static_cast<int32_t>(state) / 2147483648.0;
+  }
+};
+
+std::vector<int16_t> make_silence() {
+  return std::vector<int16_t>(SIGNAL_LENGTH, 0);
+}
+
+//
+// Low-pass filtered noise in bursts of a few hundred milliseconds, about as
+// loud and as bursty as speech.  Nearly all of it passes the silence check,
+// so this exercises the Goertzel filters and the decision.
+//
+std::vector<int16_t> make_speech_like() {
+  std::vector<int16_t> signal(SIGNAL_LENGTH);
+  Random random(1);
+  double filtered = 0;
+  for (int ii = 0; ii < SIGNAL_LENGTH; ++ii) {
+    filtered = 0.8 * filtered + 0.2 * random.Next();
+    // A 3 Hz syllable envelope, with a pause every other second.
+    double envelope = 0.5 + 0.5 * std::sin(2 * M_PI * 3 * ii / 8000.0);
+    if ((ii / 8000) % 2 == 1 && ii % 8000 > 5000)
+      envelope = 0.02;
+    signal[ii] = static_cast<int16_t>(20000 * envelope * filtered);
+  }
+  return signal;
+}
+
+//
+// Steady white noise a little louder than the silence check lets through,
+// like line hiss or comfort noise on a call that carries no DTMF.
+//
+std::vector<int16_t> make_hiss() {
+  std::vector<int16_t> signal(SIGNAL_LENGTH);
+  Random random(2);
+  for (int ii = 0; ii < SIGNAL_LENGTH; ++ii)
+    signal[ii] = static_cast<int16_t>(1200 * random.Next());
+  return signal;
+}
+
+//
+// All 16 digits, 40 ms each with 20 ms pauses, over and over.
+//
+std::vector<int16_t> make_dtmf() {
+  char digits[] = "123A456B789C*0#D";
+  DtmfGenerator generator(FRAME_SIZE, 40, 20);
+  std::vector<int16_t> signal;
+  int16_t frame[FRAME_SIZE];
+  while (static_cast<int>(signal.size()) < SIGNAL_LENGTH) {
+    generator.dtmfGeneratorReset();
+    generator.transmitNewDialButtonsArray(digits, 16);
+    while (!generator.getReadyFlag()) {
+      generator.dtmfGenerating(frame);
+      signal.insert(signal.end(), frame, frame + FRAME_SIZE);
+    }
+  }
+  signal.resize(SIGNAL_LENGTH);
+  return signal;
+}
+
+//
+// A benchmark runs iterations iterations of its workload and returns the
+// number of items (samples, or frames times channels) it processed.
+//
+typedef std::function<int64_t(int64_t iterations)> BenchmarkFunction;
+
+struct Benchmark {
+  std::string name;
+  BenchmarkFunction run;
+};
+
+struct Result {
+  std::string name;
+  int64_t iterations;
+  // Per iteration, in nanoseconds.
+  double real_time;
+  double cpu_time;
+  double items_per_second;
+};
+
+//
+// Keeps the compiler from optimizing a result away.
+//
+volatile size_t sink;
+
+Result run_benchmark(const Benchmark &benchmark, double min_time) {
+  int64_t iterations = 1;
+  for (;;) {
+    std::clock_t cpu_start = std::clock();
+    auto start = std::chrono::steady_clock::now();
+    int64_t items = benchmark.run(iterations);
+    double real = std::chrono::duration<double>(
+                      std::chrono::steady_clock::now() - start)
+                      .count();
+    double cpu = static_cast<double>(std::clock() - cpu_start) / CLOCKS_PER_SEC;
+
+    if (real >= min_time || iterations >= 1000000000) {
+      Result result;
+      result.name = benchmark.name;
+      result.iterations = iterations;
+      result.real_time = real * 1e9 / iterations;
+      result.cpu_time = cpu * 1e9 / iterations;
+      result.items_per_second = real > 0 ? items / real : 0;
+      return result;
+    }
+
+    // Aim a little past min_time, growing by at most 10x at a time, as
+    // Google Benchmark does.
+    double factor = real > 0 ? 1.4 * min_time / real : 10;
+    factor = std::min(10.0, std::max(2.0, factor));
+    iterations = static_cast<int64_t>(iterations * factor);
+  }
+}
+
+//
+// One iteration detects the whole signal, FRAME_SIZE samples per call.
+//
+template <DtmfBackend Backend = DTMF_BACKEND_FIXED>
+BenchmarkFunction
+detect_signal(const std::vector<int16_t> &signal,
+              const DtmfDetectorConfig &config = DtmfDetectorConfig()) {
+  return [&signal, config](int64_t iterations) {
+    DtmfRateDetector<DTMF_BASE_SAMPLE_RATE, Backend> detector(config);
+    for (int64_t it = 0; it < iterations; ++it)
+      for (int ii = 0; ii + FRAME_SIZE <= SIGNAL_LENGTH; ii += FRAME_SIZE)
+        detector.Detect(&signal[ii], FRAME_SIZE);
+    sink = detector.GetResult().size();
+    return iterations * (SIGNAL_LENGTH / FRAME_SIZE * FRAME_SIZE);
+  };
+}
+
+//
+// As detect_signal, looking for the call-progress and fax tones as well.
+//
+BenchmarkFunction detect_call_tones(const std::vector<int16_t> &signal) {
+  return [&signal](int64_t iterations) {
+    DtmfDetector detector;
+    detector.EnableCallTones(DTMF_CALL_TONES_PROGRESS | DTMF_CALL_TONES_FAX);
+    for (int64_t it = 0; it < iterations; ++it)
+      for (int ii = 0; ii + FRAME_SIZE <= SIGNAL_LENGTH; ii += FRAME_SIZE)
+        detector.Detect(&signal[ii], FRAME_SIZE);
+    sink = detector.GetResult().size();
+    return iterations * (SIGNAL_LENGTH / FRAME_SIZE * FRAME_SIZE);
+  };
+}
+
+//
+// One iteration is a single call with frame_size samples.
+//
+BenchmarkFunction detect_frame(const std::vector<int16_t> &signal,
+                               int frame_size) {
+  return [&signal, frame_size](int64_t iterations) {
+    DtmfDetector detector;
+    int offset = 0;
+    for (int64_t it = 0; it < iterations; ++it) {
+      detector.Detect(&signal[offset], frame_size);
+      offset += frame_size;
+      if (offset + frame_size > SIGNAL_LENGTH)
+        offset = 0;
+    }
+    sink = detector.GetResult().size();
+    return iterations * frame_size;
+  };
+}
+
+//
+// As detect_signal, with a sliding detector that decides every hop_size
+// samples.
+//
+BenchmarkFunction detect_sliding(const std::vector<int16_t> &signal,
+                                 int hop_size) {
+  return [&signal, hop_size](int64_t iterations) {
+    DtmfDetector detector(hop_size);
+    for (int64_t it = 0; it < iterations; ++it)
+      for (int ii = 0; ii + FRAME_SIZE <= SIGNAL_LENGTH; ii += FRAME_SIZE)
+        detector.Detect(&signal[ii], FRAME_SIZE);
+    sink = detector.GetResult().size();
+    return iterations * (SIGNAL_LENGTH / FRAME_SIZE * FRAME_SIZE);
+  };
+}
+
+//
+// As detect_signal, with a DtmfStreamDetector, which carries the batches that
+// straddle two frames instead of staging them.
+//
+BenchmarkFunction detect_stream(const std::vector<int16_t> &signal) {
+  return [&signal](int64_t iterations) {
+    char digits[64];
+    DtmfStreamDetector<> detector(digits, sizeof(digits));
+    for (int64_t it = 0; it < iterations; ++it) {
+      for (int ii = 0; ii + FRAME_SIZE <= SIGNAL_LENGTH; ii += FRAME_SIZE)
+        detector.Detect(&signal[ii], FRAME_SIZE);
+      detector.Digits().Clear();
+    }
+    sink = detector.Digits().size();
+    return iterations * (SIGNAL_LENGTH / FRAME_SIZE * FRAME_SIZE);
+  };
+}
+
+//
+// signal in mu-law code words.  The encoder is the nearest code word, which
+// is slow but only runs once.
+//
+std::vector<uint8_t> encode_ulaw(const std::vector<int16_t> &signal) {
+  const int16_t *decode = G711_ULAW_TABLE.samples;
+  std::vector<uint8_t> codes(signal.size());
+  for (size_t ii = 0; ii < signal.size(); ++ii) {
+    int best = 0;
+    for (int code = 1; code < 256; ++code)
+      if (std::abs(decode[code] - signal[ii]) <
+          std::abs(decode[best] - signal[ii]))
+        best = code;
+    codes[ii] = static_cast<uint8_t>(best);
+  }
+  return codes;
+}
+
+//
+// One iteration detects the whole signal, given as mu-law code words,
+// FRAME_SIZE samples per call.  If fused, the code words go to the detector
+// as they are; otherwise every frame is decoded to linear samples first.
+//
+BenchmarkFunction detect_ulaw(const std::vector<uint8_t> &codes, bool fused) {
+  return [&codes, fused](int64_t iterations) {
+    DtmfDetector detector;
+    int16_t frame[FRAME_SIZE];
+    for (int64_t it = 0; it < iterations; ++it) {
+      for (int ii = 0; ii + FRAME_SIZE <= SIGNAL_LENGTH; ii += FRAME_SIZE) {
+        if (fused) {
+          detector.Detect(&codes[ii], FRAME_SIZE, G711_ULAW);
+        } else {
+          for (int jj = 0; jj < FRAME_SIZE; ++jj)
+            frame[jj] = G711_ULAW_TABLE.samples[codes[ii + jj]];
+          detector.Detect(frame, FRAME_SIZE);
+        }
+      }
+    }
+    sink = detector.GetResult().size();
+    return iterations * (SIGNAL_LENGTH / FRAME_SIZE * FRAME_SIZE);
+  };
+}
+
+//
+// One iteration generates a single frame of FRAME_SIZE samples.
+//
+int64_t generate(int64_t iterations) {
+  char digits[] = "123A456B789C*0#D";
+  DtmfGenerator generator(FRAME_SIZE, 40, 20);
+  int16_t frame[FRAME_SIZE];
+  for (int64_t it = 0; it < iterations; ++it) {
+    if (generator.getReadyFlag()) {
+      generator.dtmfGeneratorReset();
+      generator.transmitNewDialButtonsArray(digits, 16);
+    }
+    generator.dtmfGenerating(frame);
+  }
+  sink = frame[0];
+  return iterations * FRAME_SIZE;
+}
+
+//
+// One iteration generates FRAME_SIZE samples of the same digits as generate()
+// on a DtmfStreamGenerator, from templates or on the oscillator.
+//
+BenchmarkFunction generate_stream(const DtmfToneTemplates *templates) {
+  return [templates](int64_t iterations) {
+    DtmfStreamGenerator generator(40, 20, templates);
+    int16_t frame[FRAME_SIZE];
+    for (int64_t it = 0; it < iterations; ++it) {
+      if (!generator.busy())
+        generator.EnqueueString("123A456B789C*0#D");
+      generator.Generate(frame, FRAME_SIZE);
+    }
+    sink = frame[0];
+    return iterations * FRAME_SIZE;
+  };
+}
+
+//
+// One iteration generates FRAME_SIZE interleaved frames of channel_count
+// channels that all keep dialing.
+//
+BenchmarkFunction generate_bank(int channel_count) {
+  return [channel_count](int64_t iterations) {
+    DtmfGeneratorBank bank(channel_count, 40, 20);
+    std::vector<int16_t> frames(FRAME_SIZE * channel_count);
+    for (int64_t it = 0; it < iterations; ++it) {
+      for (int channel = 0; channel < channel_count; ++channel)
+        if (!bank.busy(channel))
+          bank.EnqueueString(channel, "123A456B789C*0#D");
+      bank.GenerateInterleaved(&frames[0], FRAME_SIZE);
+    }
+    sink = frames[0];
+    return iterations * FRAME_SIZE * channel_count;
+  };
+}
+
+class CountingBank : public DtmfDetectorBank {
+public:
+  explicit CountingBank(int channel_count)
+      : DtmfDetectorBank(channel_count), tones(0) {}
+
+  size_t tones;
+
+protected:
+  void OnNewTone(int /* channel */, char /* dial_char */) override {
+    ++tones;
+  }
+};
+
+//
+// Interleaves channel_count channels taken from a mix of the DTMF and the
+// speech-like signals, each starting at a different offset.
+//
+std::vector<int16_t> interleave(const std::vector<int16_t> &dtmf,
+                                const std::vector<int16_t> &speech,
+                                int channel_count, int frame_count) {
+  std::vector<int16_t> frames(frame_count * channel_count);
+  for (int ch = 0; ch < channel_count; ++ch) {
+    const std::vector<int16_t> &source = ch % 2 ? speech : dtmf;
+    int offset = ch * 997 % SIGNAL_LENGTH;
+    for (int ii = 0; ii < frame_count; ++ii)
+      frames[ii * channel_count + ch] =
+          source[(offset + ii) % SIGNAL_LENGTH];
+  }
+  return frames;
+}
+
+//
+// One iteration detects a second of interleaved frames in a
+// DtmfDetectorBank, FRAME_SIZE frames per call.
+//
+BenchmarkFunction detect_bank(const std::vector<int16_t> &dtmf,
+                              const std::vector<int16_t> &speech,
+                              int channel_count) {
+  auto frames = std::make_shared<std::vector<int16_t>>(
+      interleave(dtmf, speech, channel_count, 8000));
+  return [frames, channel_count](int64_t iterations) {
+    CountingBank bank(channel_count);
+    for (int64_t it = 0; it < iterations; ++it)
+      for (int ii = 0; ii < 8000; ii += FRAME_SIZE)
+        bank.DetectInterleaved(&(*frames)[ii * channel_count], FRAME_SIZE);
+    sink = bank.tones;
+    return iterations * 8000 * channel_count;
+  };
+}
+
+//
+// detect_bank with the same channels in planar form.
+//
+BenchmarkFunction detect_bank_planar(const std::vector<int16_t> &dtmf,
+                                     const std::vector<int16_t> &speech,
+                                     int channel_count) {
+  auto frames = std::make_shared<std::vector<int16_t>>(
+      interleave(dtmf, speech, channel_count, 8000));
+  auto planes = std::make_shared<std::vector<int16_t>>(frames->size());
+  for (int ii = 0; ii < 8000; ++ii)
+    for (int ch = 0; ch < channel_count; ++ch)
+      (*planes)[ch * 8000 + ii] = (*frames)[ii * channel_count + ch];
+  return [planes, channel_count](int64_t iterations) {
+    CountingBank bank(channel_count);
+    std::vector<const int16_t *> channels(channel_count);
+    for (int64_t it = 0; it < iterations; ++it) {
+      for (int ii = 0; ii < 8000; ii += FRAME_SIZE) {
+        for (int ch = 0; ch < channel_count; ++ch)
+          channels[ch] = &(*planes)[ch * 8000 + ii];
+        bank.DetectPlanar(&channels[0], FRAME_SIZE);
+      }
+    }
+    sink = bank.tones;
+    return iterations * 8000 * channel_count;
+  };
+}
+
+//
+// The number of streams the thread scaling benchmark detects.
+//
+const int SCALING_STREAMS = 64;
+
+//
+// One iteration detects a second of each of SCALING_STREAMS streams, with a
+// DtmfDetector per stream, the streams split evenly between thread_count
+// threads.
+//
+BenchmarkFunction detect_threads(const std::vector<int16_t> &dtmf,
+                                 const std::vector<int16_t> &speech,
+                                 int thread_count) {
+  return [&dtmf, &speech, thread_count](int64_t iterations) {
+    std::vector<std::thread> threads;
+    // Each thread stores its count of tones in its own slot once it is done,
+    // and sink is written here after the join: sink is not atomic.
+    std::vector<size_t> tones(thread_count);
+    for (int tt = 0; tt < thread_count; ++tt) {
+      threads.emplace_back([&, tt] {
+        std::vector<DtmfDetector> detectors(SCALING_STREAMS);
+        size_t count = 0;
+        for (int64_t it = 0; it < iterations; ++it) {
+          for (int ss = tt; ss < SCALING_STREAMS; ss += thread_count) {
+            const std::vector<int16_t> &source = ss % 2 ? speech : dtmf;
+            int offset = ss * 997 % (SIGNAL_LENGTH - 8000);
+            for (int ii = 0; ii < 8000; ii += FRAME_SIZE)
+              detectors[ss].Detect(&source[offset + ii], FRAME_SIZE);
+            count += detectors[ss].GetResult().size();
+          }
+        }
+        tones[tt] = count;
+      });
+    }
+    for (auto &thread : threads)
+      thread.join();
+    size_t total = 0;
+    for (size_t count : tones)
+      total += count;
+    sink = total;
+    return iterations * 8000 * SCALING_STREAMS;
+  };
+}
+
+//
+// One iteration detects the whole signal in a single call to
+// DetectParallel, on a pool of thread_count threads started beforehand.
+//
+BenchmarkFunction detect_parallel(const std::vector<int16_t> &signal,
+                                  int thread_count) {
+  return [&signal, thread_count](int64_t iterations) {
+    DtmfDetector detector;
+    DtmfThreadPool pool(thread_count);
+    for (int64_t it = 0; it < iterations; ++it)
+      detector.DetectParallel(&signal[0], SIGNAL_LENGTH, pool);
+    sink = detector.GetResult().size();
+    return iterations * SIGNAL_LENGTH;
+  };
+}
+
+//
+// One iteration detects the whole signal on the calling thread, as another
+// thread writes it into a DtmfSampleRing in place, FRAME_SIZE samples at a
+// time.
+//
+BenchmarkFunction detect_ring(const std::vector<int16_t> &signal) {
+  return [&signal](int64_t iterations) {
+    DtmfDetector detector;
+    DtmfSampleRing ring(&detector, 16 * FRAME_SIZE);
+    const int length = SIGNAL_LENGTH / FRAME_SIZE * FRAME_SIZE;
+    const int64_t total = iterations * length;
+    std::thread producer([&] {
+      int64_t done = 0;
+      while (done < total) {
+        int16_t *room;
+        int count = ring.Reserve(&room);
+        if (count == 0) {
+          std::this_thread::yield();
+          continue;
+        }
+        int offset = static_cast<int>(done % length);
+        count = std::min(std::min(count, FRAME_SIZE), length - offset);
+        std::copy(&signal[offset], &signal[offset] + count, room);
+        ring.Commit(count);
+        done += count;
+      }
+    });
+    int64_t detected = 0;
+    while (detected < total) {
+      int count = ring.Drain();
+      if (count == 0)
+        std::this_thread::yield();
+      detected += count;
+    }
+    producer.join();
+    sink = detector.GetResult().size();
+    return total;
+  };
+}
+
+std::string json_escape(const std::string &text) {
+  std::string escaped;
+  for (char c : text) {
+    if (c == '"' || c == '\\')
+      escaped += '\\';
+    escaped += c;
+  }
+  return escaped;
+}
+
+bool write_json(const char *path, const std::vector<Result> &results,
+                const char *executable) {
+  FILE *out = fopen(path, "w");
+  if (!out)
+    return false;
+
+  char date[64];
+  std::time_t now = std::time(nullptr);
+  std::strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%S%z",
+                std::localtime(&now));
+
+  fprintf(out, "{\n  \"context\": {\n");
+  fprintf(out, "    \"date\": \"%s\",\n", date);
+  fprintf(out, "    \"executable\": \"%s\",\n",
+          json_escape(executable).c_str());
+  fprintf(out, "    \"num_cpus\": %u,\n", std::thread::hardware_concurrency());
+#ifdef NDEBUG
+  fprintf(out, "    \"library_build_type\": \"release\"\n");
+#else
+  fprintf(out, "    \"library_build_type\": \"debug\"\n");
+#endif
+  fprintf(out, "  },\n  \"benchmarks\": [\n");
+  for (size_t ii = 0; ii < results.size(); ++ii) {
+    const Result &result = results[ii];
+    std::string name = json_escape(result.name);
+    fprintf(out, "    {\n");
+    fprintf(out, "      \"name\": \"%s\",\n", name.c_str());
+    fprintf(out, "      \"run_name\": \"%s\",\n", name.c_str());
+    fprintf(out, "      \"run_type\": \"iteration\",\n");
+    fprintf(out, "      \"iterations\": %lld,\n",
+            static_cast<long long>(result.iterations));
+    fprintf(out, "      \"real_time\": %.6e,\n", result.real_time);
+    fprintf(out, "      \"cpu_time\": %.6e,\n", result.cpu_time);
+    fprintf(out, "      \"time_unit\": \"ns\",\n");
+    fprintf(out, "      \"items_per_second\": %.6e\n", result.items_per_second);
+    fprintf(out, "    }%s\n", ii + 1 < results.size() ? "," : "");
+  }
+  fprintf(out, "  ]\n}\n");
+  return fclose(out) == 0;
+}
+
+int main(int argc, char **argv) {
+  std::string filter = ".";
+  double min_time = 0.5;
+  const char *out_path = nullptr;
+  for (int ii = 1; ii < argc; ++ii) {
+    const char *arg = argv[ii];
+    if (strncmp(arg, "--benchmark_filter=", 19) == 0) {
+      filter = arg + 19;
+    } else if (strncmp(arg, "--benchmark_min_time=", 21) == 0) {
+      min_time = atof(arg + 21);
+    } else if (strncmp(arg, "--benchmark_out=", 16) == 0) {
+      out_path = arg + 16;
+    } else {
+      fprintf(stderr,
+              "usage: %s [--benchmark_filter=REGEX] "
+              "[--benchmark_min_time=SECONDS] [--benchmark_out=FILE]\n",
+              argv[0]);
+      return 1;
+    }
+  }
+
+  const std::vector<int16_t> silence = make_silence();
+  const std::vector<int16_t> speech = make_speech_like();
+  const std::vector<int16_t> hiss = make_hiss();
+  const std::vector<int16_t> dtmf = make_dtmf();
+
+  std::vector<Benchmark> benchmarks;
+  benchmarks.push_back({"BM_Detect/silence", detect_signal(silence)});
+  benchmarks.push_back({"BM_Detect/speech", detect_signal(speech)});
+  benchmarks.push_back({"BM_Detect/dtmf", detect_signal(dtmf)});
+  benchmarks.push_back({"BM_Detect/speech/float",
+                        detect_signal<DTMF_BACKEND_FLOAT>(speech)});
+  benchmarks.push_back(
+      {"BM_Detect/dtmf/float", detect_signal<DTMF_BACKEND_FLOAT>(dtmf)});
+  // A preset, and the same thresholds read from the config at run time.
+  DtmfDetectorConfig talk_off =
+      DtmfDetectorConfig::Preset(DTMF_PROFILE_TALK_OFF);
+  DtmfDetectorConfig custom = talk_off;
+  ++custom.harmonic_ratio;
+  benchmarks.push_back(
+      {"BM_Detect/dtmf/talk_off", detect_signal(dtmf, talk_off)});
+  benchmarks.push_back({"BM_Detect/dtmf/custom", detect_signal(dtmf, custom)});
+  DtmfDetectorConfig noise_gate;
+  noise_gate.noise_gate_ratio = 32;
+  benchmarks.push_back({"BM_Detect/hiss", detect_signal(hiss)});
+  benchmarks.push_back(
+      {"BM_Detect/hiss/noise_gate", detect_signal(hiss, noise_gate)});
+  benchmarks.push_back(
+      {"BM_Detect/dtmf/noise_gate", detect_signal(dtmf, noise_gate)});
+  benchmarks.push_back(
+      {"BM_Detect/silence/call_tones", detect_call_tones(silence)});
+  benchmarks.push_back(
+      {"BM_Detect/speech/call_tones", detect_call_tones(speech)});
+  benchmarks.push_back({"BM_Detect/hiss/call_tones", detect_call_tones(hiss)});
+  benchmarks.push_back({"BM_DetectStream/silence", detect_stream(silence)});
+  benchmarks.push_back({"BM_DetectStream/speech", detect_stream(speech)});
+  benchmarks.push_back({"BM_DetectStream/dtmf", detect_stream(dtmf)});
+  for (int hop_size : {51, 34}) {
+    benchmarks.push_back({"BM_DetectSliding/silence/" +
+                              std::to_string(hop_size),
+                          detect_sliding(silence, hop_size)});
+    benchmarks.push_back({"BM_DetectSliding/speech/" +
+                              std::to_string(hop_size),
+                          detect_sliding(speech, hop_size)});
+    benchmarks.push_back({"BM_DetectSliding/dtmf/" + std::to_string(hop_size),
+                          detect_sliding(dtmf, hop_size)});
+  }
+  for (int frame_size : {80, 102, 160, 320})
+    benchmarks.push_back({"BM_DetectFrame/" + std::to_string(frame_size),
+                          detect_frame(dtmf, frame_size)});
+  const std::vector<uint8_t> speech_ulaw = encode_ulaw(speech);
+  benchmarks.push_back(
+      {"BM_DetectUlaw/speech/fused", detect_ulaw(speech_ulaw, true)});
+  benchmarks.push_back(
+      {"BM_DetectUlaw/speech/decoded", detect_ulaw(speech_ulaw, false)});
+  benchmarks.push_back({"BM_Generate", generate});
+  benchmarks.push_back(
+      {"BM_GenerateStream/oscillator", generate_stream(nullptr)});
+  benchmarks.push_back({"BM_GenerateStream/templates",
+                        generate_stream(&DtmfToneTemplates::Default())});
+  for (int channels : {8, 128, 1024})
+    benchmarks.push_back({"BM_GenerateBank/" + std::to_string(channels),
+                          generate_bank(channels)});
+  for (int channels : {1, 8, 32, 128})
+    benchmarks.push_back({"BM_DetectBank/" + std::to_string(channels),
+                          detect_bank(dtmf, speech, channels)});
+  for (int channels : {8, 128})
+    benchmarks.push_back({"BM_DetectBankPlanar/" + std::to_string(channels),
+                          detect_bank_planar(dtmf, speech, channels)});
+  int max_threads =
+      std::max(1u, std::thread::hardware_concurrency());
+  for (int threads = 1; threads <= max_threads; threads *= 2)
+    benchmarks.push_back({"BM_DetectThreads/" + std::to_string(threads),
+                          detect_threads(dtmf, speech, threads)});
+  for (int threads = 1; threads <= max_threads; threads *= 2)
+    benchmarks.push_back({"BM_DetectParallel/" + std::to_string(threads),
+                          detect_parallel(speech, threads)});
+  benchmarks.push_back({"BM_DetectRing/speech", detect_ring(speech)});
+
+  std::regex pattern(filter);
+  std::vector<Result> results;
+  printf("%-30s %15s %15s %12s %15s\n", "Benchmark", "Time (ns)", "CPU (ns)",
+         "Iterations", "items/s");
+  for (const Benchmark &benchmark : benchmarks) {
+    if (!std::regex_search(benchmark.name, pattern))
+      continue;
+    Result result = run_benchmark(benchmark, min_time);
+    printf("%-30s %15.0f %15.0f %12lld %15.4g\n", result.name.c_str(),
+           result.real_time, result.cpu_time,
+           static_cast<long long>(result.iterations), result.items_per_second);
+    fflush(stdout);
+    results.push_back(result);
+  }
+
+  if (out_path && !write_json(out_path, results, argv[0])) {
+    fprintf(stderr, "%s: unable to write %s\n", argv[0], out_path);
+    return 1;
+  }
+  return 0;
+}
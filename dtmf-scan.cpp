@@ -0,0 +1,335 @@
+//
+// Scan many AU and WAV files for DTMF tones, in parallel.
+//
+// usage: dtmf-scan [-j THREADS] [--list FILE] [--no-mmap] [PATH...]
+//
+// Every PATH is a file, or a directory searched recursively for .au and .wav
+// files; --list reads more paths, one per line, from FILE ("-" for standard
+// input).  The files are scanned on a pool of THREADS worker threads (one
+// per hardware thread by default), with a detector per file and channel.
+//
+// A JSON object is written to standard output for every file, on a line of
+// its own, as soon as the file is done:
+//
+//   {"file": "a.wav", "format": "16-bit PCM, 8000Hz, 1 channels",
+//    "seconds": 6.8, "digits": ["0123"], "tones": [{"channel": 0,
+//    "tone": "0", "start": 0.0, "duration": 0.089}, ...],
+//    "processing_ms": 1.2}
+//
+// with one string of digits per channel, or {"file": ..., "error": ...}.
+// Throughput and per-file latency statistics go to standard error at the end.
+//
+
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <stdint.h>
+
+#include "AudioFile.hpp"
+#include "DtmfDetector.hpp"
+#include "DtmfThreadPool.hpp"
+
+//
+// The number of frames handed to the detectors at a time, as in detect-au.
+//
+const size_t CHUNK_FRAMES = 1 << 16;
+
+struct Tone {
+  int channel;
+  DtmfToneEvent event;
+};
+
+//
+// A detector that keeps the tones it finds.
+//
+class CollectingDetector : public DtmfDetectorBase {
+public:
+  CollectingDetector(const DtmfRateTables &tables, int channel,
+                     std::vector<Tone> *tones)
+      : DtmfDetectorBase(tables), channel_(channel), tones_(tones) {}
+
+private:
+  int channel_;
+  std::vector<Tone> *tones_;
+
+  void OnToneEvent(const DtmfToneEvent &event) override {
+    tones_->push_back(Tone{channel_, event});
+  }
+};
+
+struct ScanResult {
+  std::string error;
+  AudioFormat format;
+  uint64_t frame_count;
+  uint64_t bytes;
+  std::vector<Tone> tones;
+};
+
+//
+// Detects the tones of every channel of path, in the same way as detect-au.
+//
+static ScanResult scan_file(const std::string &path, bool use_mmap) {
+  ScanResult result = ScanResult();
+  AudioFile file;
+  if (!file.Open(path.c_str(), use_mmap)) {
+    result.error = file.error();
+    return result;
+  }
+  const AudioFormat &format = file.format();
+  result.format = format;
+  result.frame_count = file.frame_count();
+  result.bytes = file.frame_count() * audio_frame_bytes(format);
+  if (format.sample_rate < DTMF_BASE_SAMPLE_RATE ||
+      format.sample_rate > DTMF_MAX_SAMPLE_RATE) {
+    result.error = "unsupported sample rate";
+    return result;
+  }
+  const DtmfRateTables tables = dtmf_rate_tables(format.sample_rate);
+
+  std::vector<std::unique_ptr<CollectingDetector>> detectors;
+  for (int ch = 0; ch < format.channel_count; ++ch)
+    detectors.emplace_back(new CollectingDetector(tables, ch, &result.tones));
+
+  const bool mono = format.channel_count == 1;
+  const bool g711 =
+      format.encoding == AUDIO_ULAW || format.encoding == AUDIO_ALAW;
+  std::vector<int16_t> linear;
+
+  const uint8_t *data;
+  size_t count;
+  while ((count = file.Next(CHUNK_FRAMES, &data)) != 0) {
+    for (int ch = 0; ch < format.channel_count; ++ch) {
+      CollectingDetector &detector = *detectors[ch];
+      if (mono && g711) {
+        detector.Detect(data, static_cast<int>(count),
+                        format.encoding == AUDIO_ULAW ? G711_ULAW : G711_ALAW);
+      } else if (audio_is_native_linear(format) &&
+                 reinterpret_cast<uintptr_t>(data) % sizeof(int16_t) == 0) {
+        detector.Detect(reinterpret_cast<const int16_t *>(data),
+                        static_cast<int>(count));
+      } else {
+        linear.resize(count);
+        audio_to_linear(format, data, count, ch, &linear[0]);
+        detector.Detect(&linear[0], static_cast<int>(count));
+      }
+    }
+  }
+  for (auto &detector : detectors)
+    detector->Flush();
+
+  // Tones of different channels come out in the order they ended.
+  std::stable_sort(result.tones.begin(), result.tones.end(),
+                   [](const Tone &a, const Tone &b) {
+                     return a.event.start_sample < b.event.start_sample;
+                   });
+  return result;
+}
+
+static void append_json_string(std::string *out, const std::string &text) {
+  *out += '"';
+  for (unsigned char c : text) {
+    if (c == '"' || c == '\\') {
+      *out += '\\';
+      *out += static_cast<char>(c);
+    } else if (c < 0x20) {
+      char escaped[8];
+      snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+      *out += escaped;
+    } else {
+      *out += static_cast<char>(c);
+    }
+  }
+  *out += '"';
+}
+
+static std::string json_line(const std::string &path, const ScanResult &result,
+                             double processing_ms) {
+  std::string line = "{\"file\": ";
+  append_json_string(&line, path);
+  char number[128];
+
+  if (!result.error.empty()) {
+    line += ", \"error\": ";
+    append_json_string(&line, result.error);
+  } else {
+    const AudioFormat &format = result.format;
+    double rate = format.sample_rate;
+    line += ", \"format\": ";
+    append_json_string(&line, audio_format_tostr(format));
+    snprintf(number, sizeof(number), ", \"seconds\": %.3f",
+             result.frame_count / rate);
+    line += number;
+
+    line += ", \"digits\": [";
+    for (int ch = 0; ch < format.channel_count; ++ch) {
+      std::string digits;
+      for (const Tone &tone : result.tones)
+        if (tone.channel == ch)
+          digits += tone.event.dial_char;
+      if (ch)
+        line += ", ";
+      append_json_string(&line, digits);
+    }
+
+    line += "], \"tones\": [";
+    for (size_t ii = 0; ii < result.tones.size(); ++ii) {
+      const Tone &tone = result.tones[ii];
+      snprintf(number, sizeof(number),
+               "%s{\"channel\": %d, \"tone\": \"%c\", \"start\": %.3f, "
+               "\"duration\": %.3f}",
+               ii ? ", " : "", tone.channel, tone.event.dial_char,
+               tone.event.start_sample / rate, tone.event.duration / rate);
+      line += number;
+    }
+    line += "]";
+  }
+
+  snprintf(number, sizeof(number), ", \"processing_ms\": %.3f}\n",
+           processing_ms);
+  line += number;
+  return line;
+}
+
+static bool has_audio_extension(const std::filesystem::path &path) {
+  std::string extension = path.extension().string();
+  std::transform(extension.begin(), extension.end(), extension.begin(),
+                 [](unsigned char c) { return std::tolower(c); });
+  return extension == ".au" || extension == ".wav";
+}
+
+static void add_path(const std::string &path, std::vector<std::string> *files) {
+  std::error_code error;
+  if (!std::filesystem::is_directory(path, error)) {
+    files->push_back(path);
+    return;
+  }
+  auto options = std::filesystem::directory_options::skip_permission_denied;
+  for (std::filesystem::recursive_directory_iterator it(path, options, error),
+       end;
+       it != end; it.increment(error)) {
+    if (error) {
+      std::cerr << path << ": " << error.message() << std::endl;
+      break;
+    }
+    if (it->is_regular_file(error) && has_audio_extension(it->path()))
+      files->push_back(it->path().string());
+  }
+}
+
+static double percentile(std::vector<double> sorted, double fraction) {
+  if (sorted.empty())
+    return 0;
+  size_t index = static_cast<size_t>(fraction * (sorted.size() - 1) + 0.5);
+  return sorted[index];
+}
+
+int main(int argc, char **argv) {
+  int thread_count = static_cast<int>(std::thread::hardware_concurrency());
+  bool use_mmap = true;
+  std::vector<std::string> files;
+
+  for (int ii = 1; ii < argc; ++ii) {
+    if (strcmp(argv[ii], "-j") == 0 && ii + 1 < argc) {
+      thread_count = atoi(argv[++ii]);
+    } else if (strcmp(argv[ii], "--list") == 0 && ii + 1 < argc) {
+      const char *list = argv[++ii];
+      std::ifstream fin;
+      if (strcmp(list, "-") != 0) {
+        fin.open(list);
+        if (!fin.good()) {
+          std::cerr << list << ": unable to open file" << std::endl;
+          return 1;
+        }
+      }
+      std::istream &in = strcmp(list, "-") == 0 ? std::cin : fin;
+      std::string line;
+      while (std::getline(in, line))
+        if (!line.empty())
+          add_path(line, &files);
+    } else if (strcmp(argv[ii], "--no-mmap") == 0) {
+      use_mmap = false;
+    } else if (argv[ii][0] == '-') {
+      std::cerr << "usage: " << argv[0]
+                << " [-j THREADS] [--list FILE] [--no-mmap] [PATH...]"
+                << std::endl;
+      return 1;
+    } else {
+      add_path(argv[ii], &files);
+    }
+  }
+  thread_count = std::max(1, thread_count);
+
+  // The largest files go first, so that no worker starts a long file just as
+  // the others run out of work.
+  std::vector<uint64_t> sizes(files.size());
+  std::vector<size_t> order(files.size());
+  for (size_t ii = 0; ii < files.size(); ++ii) {
+    std::error_code error;
+    uint64_t size = std::filesystem::file_size(files[ii], error);
+    sizes[ii] = error ? 0 : size;
+    order[ii] = ii;
+  }
+  std::stable_sort(order.begin(), order.end(),
+                   [&](size_t a, size_t b) { return sizes[a] > sizes[b]; });
+
+  DtmfThreadPool pool(thread_count);
+  for (size_t index : order)
+    pool.Add(index);
+
+  std::mutex output_mutex;
+  std::vector<double> latencies_ms(files.size());
+  std::atomic<uint64_t> bytes(0), errors(0);
+  std::atomic<uint64_t> audio_ms(0);
+
+  auto start = std::chrono::steady_clock::now();
+  pool.Run([&](size_t index) {
+    auto file_start = std::chrono::steady_clock::now();
+    ScanResult result = scan_file(files[index], use_mmap);
+    double ms = std::chrono::duration<double, std::milli>(
+                    std::chrono::steady_clock::now() - file_start)
+                    .count();
+    latencies_ms[index] = ms;
+    if (result.error.empty()) {
+      bytes += result.bytes;
+      audio_ms += result.frame_count * 1000 / result.format.sample_rate;
+    } else {
+      ++errors;
+    }
+
+    std::string line = json_line(files[index], result, ms);
+    std::lock_guard<std::mutex> lock(output_mutex);
+    fwrite(line.data(), 1, line.size(), stdout);
+  });
+  double wall = std::chrono::duration<double>(
+                    std::chrono::steady_clock::now() - start)
+                    .count();
+  fflush(stdout);
+
+  std::sort(latencies_ms.begin(), latencies_ms.end());
+  double audio_seconds = audio_ms.load() / 1000.0;
+  fprintf(stderr,
+          "%zu files (%llu errors), %d threads, %.3f s\n"
+          "audio: %.1f s, %.1f MB, %.0fx real time, %.1f MB/s, %.1f files/s\n"
+          "per file: p50 %.3f ms, p90 %.3f ms, p99 %.3f ms, max %.3f ms\n",
+          files.size(), static_cast<unsigned long long>(errors.load()),
+          thread_count, wall, audio_seconds, bytes.load() / 1e6,
+          wall > 0 ? audio_seconds / wall : 0,
+          wall > 0 ? bytes.load() / 1e6 / wall : 0,
+          wall > 0 ? files.size() / wall : 0, percentile(latencies_ms, 0.5),
+          percentile(latencies_ms, 0.9), percentile(latencies_ms, 0.99),
+          latencies_ms.empty() ? 0 : latencies_ms.back());
+  return errors.load() ? 1 : 0;
+}
@@ -0,0 +1,130 @@
+//
+// Checks that a DtmfStreamDetector fed 20 ms frames, which always straddle
+// batches, and a DtmfStreamGenerator that digits are queued on, never
+// allocate once constructed.
+//
+// Every allocation goes through the global operator new below, which counts
+// them.
+//
+
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <string>
+#include <vector>
+
+#include <stdint.h>
+
+#include "DtmfDetector.hpp"
+#include "DtmfGenerator.hpp"
+
+static unsigned long allocations = 0;
+
+void *operator new(std::size_t size) {
+  ++allocations;
+  if (void *p = std::malloc(size ? size : 1))
+    return p;
+  throw std::bad_alloc();
+}
+
+void *operator new[](std::size_t size) { return operator new(size); }
+
+void operator delete(void *p) noexcept { std::free(p); }
+
+void operator delete[](void *p) noexcept { std::free(p); }
+
+void operator delete(void *p, std::size_t) noexcept { std::free(p); }
+
+void operator delete[](void *p, std::size_t) noexcept { std::free(p); }
+
+// 20 ms at 8 kHz, as in RTP.
+const int FRAME_SIZE = 160;
+
+// The digits, then as long again of low-pass filtered noise, so that the
+// carried batches go through every stage of the decision.
+static std::vector<int16_t> make_signal(const char *digits) {
+  DtmfGenerator generator(FRAME_SIZE, 60, 40);
+  std::vector<int16_t> signal;
+  int16_t frame[FRAME_SIZE];
+  std::string buttons(digits);
+  generator.transmitNewDialButtonsArray(&buttons[0],
+                                        static_cast<unsigned>(buttons.size()));
+  while (!generator.getReadyFlag()) {
+    generator.dtmfGenerating(frame);
+    signal.insert(signal.end(), frame, frame + FRAME_SIZE);
+  }
+  uint32_t state = 1;
+  double filtered = 0;
+  for (size_t ii = 0, count = signal.size(); ii < count; ++ii) {
+    state = state * 1664525u + 1013904223u;
+    filtered = 0.8 * filtered + 0.2 * (static_cast<int32_t>(state) / 2e9);
+    signal.push_back(static_cast<int16_t>(20000 * filtered));
+  }
+  signal.resize(signal.size() / FRAME_SIZE * FRAME_SIZE);
+  return signal;
+}
+
+static bool check_detector(const char *digits) {
+  std::vector<int16_t> signal = make_signal(digits);
+  char storage[64];
+  DtmfStreamDetector<> detector(storage, sizeof(storage));
+
+  unsigned long before = allocations;
+  for (int pass = 0; pass < 2; ++pass) {
+    for (size_t ii = 0; ii < signal.size(); ii += FRAME_SIZE)
+      detector.Detect(&signal[ii], FRAME_SIZE);
+    if (pass == 0)
+      detector.Digits().Clear();
+  }
+  unsigned long count = allocations - before;
+
+  std::string found(detector.Digits().data(), detector.Digits().size());
+  if (found != digits) {
+    fprintf(stderr, "detected \"%s\", expected \"%s\"\n", found.c_str(),
+            digits);
+    return false;
+  }
+  if (count != 0) {
+    fprintf(stderr, "%lu allocations while detecting\n", count);
+    return false;
+  }
+  printf("detector: %zu frames, no allocations\n",
+         2 * signal.size() / FRAME_SIZE);
+  return true;
+}
+
+// Queues more digits than fit, so that Enqueue also runs into a full queue.
+static bool check_generator(const char *digits) {
+  DtmfStreamGenerator generator(40, 20, nullptr, 16);
+  int16_t frame[FRAME_SIZE];
+
+  unsigned long before = allocations;
+  size_t queued = 0, frames = 0;
+  for (int pass = 0; pass < 4; ++pass) {
+    queued += generator.EnqueueString(digits);
+    queued += generator.EnqueueString(digits);
+    while (generator.busy()) {
+      generator.Generate(frame, FRAME_SIZE);
+      ++frames;
+    }
+  }
+  unsigned long count = allocations - before;
+
+  if (queued != 4 * 16) {
+    fprintf(stderr, "queued %zu digits, expected %d\n", queued, 4 * 16);
+    return false;
+  }
+  if (count != 0) {
+    fprintf(stderr, "%lu allocations while generating\n", count);
+    return false;
+  }
+  printf("generator: %zu frames, no allocations\n", frames);
+  return true;
+}
+
+int main() {
+  const char digits[] = "123A456B789C*0#D";
+  bool passed = check_detector(digits);
+  passed = check_generator(digits) && passed;
+  return passed ? 0 : 1;
+}
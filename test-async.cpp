@@ -0,0 +1,237 @@
+//
+// Drives DtmfAsyncScheduler::Tick over frames from DtmfAsyncGenerator, into
+// one detector fed from the frame coroutine and one fed through a
+// DtmfSampleRing, and checks that:
+//
+// - next_digit gives the digits in the order they were generated, then '\0'
+//   once the detector is closed;
+// - next_frame resumes each generator's coroutine exactly once per tick;
+// - a tick resumes the frame waiters of every generator, and the digit
+//   waiters woken by them, before it returns;
+// - a digit already detected is taken without suspending, a detector may be
+//   waited on again once its waiter has been resumed, and, where assertions
+//   can be seen to fail, a second waiter at the same time aborts.
+//
+// Built as C++20, unlike the rest of the library.
+//
+// usage: test-async
+//
+
+// The one-waiter rule is an assertion.
+#undef NDEBUG
+
+#include <cstdio>
+#include <exception>
+#include <string>
+#include <vector>
+
+#include <stdint.h>
+
+#ifndef _WIN32
+#include <signal.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+#include "DtmfAsync.hpp"
+
+const char DIGITS[] = "0123456789ABCD*#";
+
+// 20 ms frames at 8 kHz.
+const int FRAME_SIZE = 160;
+
+// The frames of silence sent after the last digit before closing.
+const int TAIL_FRAMES = 10;
+
+const int MAX_TICKS = 1000;
+
+// A coroutine that runs as soon as it is called and frees itself when done.
+struct Task {
+  struct promise_type {
+    Task get_return_object() { return Task(); }
+    std::suspend_never initial_suspend() noexcept { return {}; }
+    std::suspend_never final_suspend() noexcept { return {}; }
+    void return_void() {}
+    void unhandled_exception() { std::terminate(); }
+  };
+};
+
+// A generator looped back into a detector, and what its coroutines saw.
+struct Session {
+  const char *name;
+  DtmfAsyncGenerator generator;
+  DtmfAsyncDetector<> detector;
+  // The detector is fed through it, if not null.
+  DtmfSampleRing *ring;
+
+  // The tick of every frame, of every tick where a digit was waiting to be
+  // taken once the frame was fed, and of every digit taken.
+  std::vector<uint64_t> frame_ticks;
+  std::vector<uint64_t> detected_ticks;
+  std::vector<uint64_t> digit_ticks;
+  std::string digits;
+  bool closed = false;
+
+  Session(const char *name, DtmfAsyncScheduler *scheduler)
+      : name(name), generator(scheduler, FRAME_SIZE), detector(scheduler),
+        ring(nullptr) {}
+};
+
+// Sends the frames of the session's generator to its detector until the
+// digits have all been sent, and then closes the detector.
+static Task send(DtmfAsyncScheduler *scheduler, Session *session) {
+  int silent_frames = 0;
+  while (silent_frames < TAIL_FRAMES) {
+    DtmfAsyncFrame frame = co_await session->generator.next_frame();
+    session->frame_ticks.push_back(scheduler->ticks());
+    if (session->ring)
+      session->ring->Push(frame.samples, frame.sample_count);
+    else
+      session->detector.Detect(frame.samples, frame.sample_count);
+    // The waiting receiver takes every digit later in the same tick.
+    if (session->detector.pending_digits() > 0)
+      session->detected_ticks.push_back(scheduler->ticks());
+    silent_frames = session->generator.busy() ? 0 : silent_frames + 1;
+  }
+  session->detector.Close();
+}
+
+// Takes the session's digits until its detector is closed.
+static Task receive(DtmfAsyncScheduler *scheduler, Session *session) {
+  while (char dial_char = co_await session->detector.next_digit()) {
+    session->digits += dial_char;
+    session->digit_ticks.push_back(scheduler->ticks());
+  }
+  session->closed = true;
+}
+
+static bool check_sessions() {
+  DtmfAsyncScheduler scheduler;
+  Session direct("direct", &scheduler), ringed("ring", &scheduler);
+  DtmfSampleRing ring(&ringed.detector, 4 * FRAME_SIZE);
+  ringed.ring = &ring;
+  scheduler.Attach(&ring);
+
+  bool passed = true;
+  Session *sessions[] = {&direct, &ringed};
+  for (Session *session : sessions) {
+    session->generator.generator().EnqueueString(DIGITS);
+    send(&scheduler, session);
+    receive(&scheduler, session);
+  }
+  if (scheduler.pending() != 2) {
+    fprintf(stderr, "%zu frame waiters before the first tick, not 2\n",
+            scheduler.pending());
+    passed = false;
+  }
+
+  while ((!direct.closed || !ringed.closed) && scheduler.ticks() < MAX_TICKS)
+    scheduler.Tick();
+  scheduler.Detach(&ring);
+
+  for (Session *session : sessions) {
+    if (!session->closed || session->digits != DIGITS) {
+      fprintf(stderr, "%s: got \"%s\"%s, not \"%s\"\n", session->name,
+              session->digits.c_str(), session->closed ? "" : " unclosed",
+              DIGITS);
+      passed = false;
+    }
+    // Resumed once on every tick from the first until it stopped waiting.
+    for (size_t ii = 0; ii < session->frame_ticks.size(); ++ii)
+      if (session->frame_ticks[ii] != ii + 1) {
+        fprintf(stderr, "%s: frame %zu on tick %llu\n", session->name, ii,
+                static_cast<unsigned long long>(session->frame_ticks[ii]));
+        passed = false;
+        break;
+      }
+    if (session->digit_ticks != session->detected_ticks) {
+      fprintf(stderr, "%s: digits not taken on the tick they were detected\n",
+              session->name);
+      passed = false;
+    }
+  }
+  if (direct.frame_ticks != ringed.frame_ticks) {
+    fprintf(stderr, "the generators were not resumed on the same ticks\n");
+    passed = false;
+  }
+  if (scheduler.pending() != 0) {
+    fprintf(stderr, "%zu coroutines still waiting\n", scheduler.pending());
+    passed = false;
+  }
+  printf("sessions: %llu ticks, %s\n",
+         static_cast<unsigned long long>(scheduler.ticks()),
+         passed ? "passed" : "failed");
+  return passed;
+}
+
+// Feeds detector one digit and the pause after it.
+static void detect_digit(DtmfAsyncDetector<> *detector, char dial_char) {
+  DtmfStreamGenerator generator;
+  generator.Enqueue(dial_char);
+  std::vector<int16_t> samples(200 * DTMF_BASE_SAMPLE_RATE / 1000);
+  generator.Generate(samples.data(), samples.size());
+  detector->Detect(samples.data(), static_cast<int>(samples.size()));
+}
+
+// Takes one digit of detector.
+static Task take_digit(DtmfAsyncDetector<> *detector, std::string *digits) {
+  *digits += co_await detector->next_digit();
+}
+
+static bool check_waiters() {
+  DtmfAsyncScheduler scheduler;
+  DtmfAsyncDetector<> detector(&scheduler);
+  bool passed = true;
+
+  // Detected before it is awaited: taken without waiting for a tick.
+  std::string digits;
+  detect_digit(&detector, '5');
+  take_digit(&detector, &digits);
+  if (digits != "5" || scheduler.pending() != 0) {
+    fprintf(stderr, "a detected digit was not taken at once\n");
+    passed = false;
+  }
+
+  // One waiter after the other.
+  for (char dial_char : std::string("79")) {
+    take_digit(&detector, &digits);
+    detect_digit(&detector, dial_char);
+    if (scheduler.pending() != 1) {
+      fprintf(stderr, "the waiter was not made ready by its digit\n");
+      passed = false;
+    }
+    scheduler.Tick();
+  }
+  if (digits != "579" || scheduler.pending() != 0) {
+    fprintf(stderr, "waiters one after the other got \"%s\", not \"579\"\n",
+            digits.c_str());
+    passed = false;
+  }
+
+#ifndef _WIN32
+  // Two at once.
+  fflush(stdout);
+  pid_t child = fork();
+  if (child == 0) {
+    freopen("/dev/null", "w", stderr);
+    take_digit(&detector, &digits);
+    take_digit(&detector, &digits);
+    _exit(0);
+  }
+  int status;
+  if (child < 0 || waitpid(child, &status, 0) != child ||
+      !WIFSIGNALED(status) || WTERMSIG(status) != SIGABRT) {
+    fprintf(stderr, "a second waiter at once did not abort\n");
+    passed = false;
+  }
+#endif
+
+  printf("waiters: %s\n", passed ? "passed" : "failed");
+  return passed;
+}
+
+int main() {
+  bool passed = check_sessions();
+  passed = check_waiters() && passed;
+  return passed ? 0 : 1;
+}
@@ -0,0 +1,92 @@
+//
+// Compares the decisions of DTMF_BACKEND_FLOAT with those of
+// DTMF_BACKEND_FIXED, batch by batch, over the recordings in a directory and
+// generated signals, and checks that they differ no more than documented
+// with DTMF_BACKEND_FLOAT: not at all on the recordings and on speech, and
+// on digits made to sit on the edge of the thresholds, in at most one batch
+// in MAX_EDGE_BATCHES_PER and one digit string in MAX_EDGE_DIGITS_PER.
+//
+// usage: test-backends TEST_DATA_DIRECTORY
+//
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include <stdint.h>
+
+#include "DtmfDetector.hpp"
+#include "test-signals.hpp"
+
+const int MAX_EDGE_BATCHES_PER = 500;
+const int MAX_EDGE_DIGITS_PER = 4;
+
+// The decision of every whole batch of signal, and the digits.
+template <DtmfBackend Backend>
+static std::vector<char> decide(const std::vector<int16_t> &signal,
+                                std::string *digits) {
+  DtmfEventDetector<DTMF_BASE_SAMPLE_RATE, Backend> detector(1024);
+  detector.Detect(signal.data(), static_cast<int>(signal.size()));
+  detector.Flush();
+
+  std::vector<char> batches(signal.size() / DTMF_DETECTION_BATCH_SIZE, ' ');
+  DtmfToneEvent event;
+  while (detector.Events().Pop(&event)) {
+    for (uint64_t bb = event.start_sample / DTMF_DETECTION_BATCH_SIZE;
+         bb < event.end_sample / DTMF_DETECTION_BATCH_SIZE; ++bb)
+      batches[bb] = event.dial_char;
+    *digits += event.dial_char;
+  }
+  return batches;
+}
+
+int main(int argc, char **argv) {
+  if (argc != 2) {
+    fprintf(stderr, "usage: %s TEST_DATA_DIRECTORY\n", argv[0]);
+    return 2;
+  }
+
+  std::vector<Signal> signals;
+  if (!make_signals(argv[1], &signals))
+    return 1;
+
+  bool passed = true;
+  size_t edge_batches = 0, edge_signals = 0;
+  size_t different_batches = 0, different_digits = 0;
+  for (const Signal &signal : signals) {
+    std::string fixed_digits, float_digits;
+    std::vector<char> fixed =
+        decide<DTMF_BACKEND_FIXED>(signal.samples, &fixed_digits);
+    std::vector<char> single =
+        decide<DTMF_BACKEND_FLOAT>(signal.samples, &float_digits);
+    size_t different = 0;
+    for (size_t bb = 0; bb < fixed.size(); ++bb)
+      different += fixed[bb] != single[bb];
+    if (different)
+      printf("%s: %zu batches differ, \"%s\" fixed, \"%s\" float\n",
+             signal.name.c_str(), different, fixed_digits.c_str(),
+             float_digits.c_str());
+    if (!signal.edge) {
+      if (different || fixed_digits != float_digits) {
+        fprintf(stderr, "%s: the backends differ\n", signal.name.c_str());
+        passed = false;
+      }
+      continue;
+    }
+    edge_batches += fixed.size();
+    ++edge_signals;
+    different_batches += different;
+    different_digits += fixed_digits != float_digits;
+  }
+
+  printf("on the edge, %zu of %zu batch decisions and %zu of %zu digit "
+         "strings differ\n",
+         different_batches, edge_batches, different_digits, edge_signals);
+  if (different_batches * MAX_EDGE_BATCHES_PER > edge_batches ||
+      different_digits * MAX_EDGE_DIGITS_PER > edge_signals) {
+    fprintf(stderr, "more than 1 in %d batches or 1 in %d digit strings\n",
+            MAX_EDGE_BATCHES_PER, MAX_EDGE_DIGITS_PER);
+    passed = false;
+  }
+  return passed ? 0 : 1;
+}
@@ -0,0 +1,163 @@
+//
+// Checks the call-progress and fax tones, at 8 and 16 kHz: dial tone,
+// ringback, busy, reorder, CNG, CED and ANSam, each with its cadence and in
+// a little noise, must be reported exactly once, as that tone, close to
+// where it starts; the generated digits and speech-like signals must not be
+// reported as any.  The 8 kHz signals are upsampled for 16 kHz.
+//
+// usage: test-call-tones
+//
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <vector>
+
+#include <stdint.h>
+
+#include "DtmfDetector.hpp"
+#include "test-signals.hpp"
+
+// The tones start after this much noise, in ms, and are followed by as much.
+const int LEAD_MS = 500;
+
+// A detector that keeps every call tone it reports.
+template <int SampleRate> class CallToneCollector : public DtmfDetectorBase {
+public:
+  CallToneCollector() : DtmfDetectorBase(DtmfRate<SampleRate>::tables) {
+    EnableCallTones(DTMF_CALL_TONES_PROGRESS | DTMF_CALL_TONES_FAX);
+  }
+
+  std::vector<DtmfCallToneEvent> events;
+
+private:
+  void OnCallTone(const DtmfCallToneEvent &event) override {
+    events.push_back(event);
+  }
+};
+
+// A tone: up to two frequencies, and on and off times that repeat.
+struct CallTone {
+  const char *name;
+  DtmfCallTone tone;
+  double frequencies[2];
+  int on_ms, off_ms, cycles;
+  // The depth of the 15 Hz amplitude modulation of ANSam, and its phase
+  // reversals every 450 ms.
+  double modulation;
+  bool reversals;
+};
+
+const CallTone TONES[] = {
+    {"dial", DTMF_CALL_TONE_DIAL, {350, 440}, 3000, 0, 1, 0, false},
+    {"ringback", DTMF_CALL_TONE_RINGBACK, {440, 480}, 2000, 4000, 2, 0,
+     false},
+    {"busy", DTMF_CALL_TONE_BUSY, {480, 620}, 500, 500, 4, 0, false},
+    {"reorder", DTMF_CALL_TONE_REORDER, {480, 620}, 250, 250, 6, 0, false},
+    {"CNG", DTMF_CALL_TONE_CNG, {1100, 0}, 500, 3000, 2, 0, false},
+    {"CED", DTMF_CALL_TONE_CED, {2100, 0}, 3000, 0, 1, 0, false},
+    {"ANSam", DTMF_CALL_TONE_ANSAM, {2100, 0}, 3000, 0, 1, 0.2, true},
+};
+
+// The tone at sample_rate, after and before LEAD_MS of noise.
+static std::vector<int16_t> make_call_tone(const CallTone &tone,
+                                           int sample_rate) {
+  Random random(7);
+  const double level = 2000, noise = 50;
+  const int lead = LEAD_MS * sample_rate / 1000;
+  const int on = tone.on_ms * sample_rate / 1000;
+  const int period = (tone.on_ms + tone.off_ms) * sample_rate / 1000;
+  std::vector<int16_t> signal;
+  for (int ii = 0; ii < lead; ++ii)
+    signal.push_back(clip(noise * random.Next()));
+  for (int ii = 0; ii < tone.cycles * period; ++ii) {
+    double sample = noise * random.Next();
+    if (ii % period < on) {
+      double t = static_cast<double>(ii) / sample_rate;
+      double amplitude =
+          level * (1 + tone.modulation * std::sin(2 * M_PI * 15 * t));
+      double phase =
+          tone.reversals && static_cast<int>(t / 0.45) % 2 ? M_PI : 0;
+      for (double frequency : tone.frequencies)
+        if (frequency > 0)
+          sample += amplitude * std::sin(2 * M_PI * frequency * t + phase);
+    }
+    signal.push_back(clip(sample));
+  }
+  for (int ii = 0; ii < lead; ++ii)
+    signal.push_back(clip(noise * random.Next()));
+  return signal;
+}
+
+// An 8 kHz signal at twice the rate, by linear interpolation.
+static std::vector<int16_t> upsample(const std::vector<int16_t> &signal) {
+  std::vector<int16_t> upsampled;
+  for (size_t ii = 0; ii < signal.size(); ++ii) {
+    int next = ii + 1 < signal.size() ? signal[ii + 1] : signal[ii];
+    upsampled.push_back(signal[ii]);
+    upsampled.push_back(static_cast<int16_t>((signal[ii] + next) / 2));
+  }
+  return upsampled;
+}
+
+// The call tones found in signal, fed in 20 ms frames.
+template <int SampleRate>
+static std::vector<DtmfCallToneEvent>
+detect(const std::vector<int16_t> &signal) {
+  CallToneCollector<SampleRate> detector;
+  const int frame = SampleRate / 50;
+  for (size_t ii = 0; ii < signal.size(); ii += frame) {
+    size_t count = std::min<size_t>(frame, signal.size() - ii);
+    detector.Detect(&signal[ii], static_cast<int>(count));
+  }
+  return detector.events;
+}
+
+template <int SampleRate> static bool check_rate() {
+  bool passed = true;
+  // The tones are recognized a block at a time, and the first block of a
+  // tone may hold noise.
+  const uint64_t block = DtmfCallToneTracker::BLOCK_BATCHES *
+                         DtmfRate<SampleRate>::tables.batch_size;
+  const uint64_t onset = LEAD_MS * SampleRate / 1000;
+  for (const CallTone &tone : TONES) {
+    std::vector<DtmfCallToneEvent> events =
+        detect<SampleRate>(make_call_tone(tone, SampleRate));
+    if (events.size() != 1 || events[0].tone != tone.tone ||
+        events[0].start_sample + block < onset ||
+        events[0].start_sample > onset + block) {
+      fprintf(stderr, "%s at %d Hz: %zu events", tone.name, SampleRate,
+              events.size());
+      for (const DtmfCallToneEvent &event : events)
+        fprintf(stderr, ", tone %d from %llu", event.tone,
+                static_cast<unsigned long long>(event.start_sample));
+      fprintf(stderr, "\n");
+      passed = false;
+    }
+  }
+
+  // Nothing in digits or speech.
+  size_t false_events = 0;
+  for (uint32_t seed = 1; seed <= 20; ++seed) {
+    std::vector<int16_t> signals[] = {make_digits(seed),
+                                      make_speech_like(seed)};
+    for (std::vector<int16_t> &signal : signals) {
+      if (SampleRate != DTMF_BASE_SAMPLE_RATE)
+        signal = upsample(signal);
+      false_events += detect<SampleRate>(signal).size();
+    }
+  }
+  if (false_events != 0) {
+    fprintf(stderr, "%zu call tones in digits and speech at %d Hz\n",
+            false_events, SampleRate);
+    passed = false;
+  }
+  printf("%d Hz: %s\n", SampleRate, passed ? "passed" : "failed");
+  return passed;
+}
+
+int main() {
+  bool passed = check_rate<8000>();
+  passed = check_rate<16000>() && passed;
+  return passed ? 0 : 1;
+}
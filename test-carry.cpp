@@ -0,0 +1,121 @@
+//
+// Checks that carrying batches across calls (DTMF_STRADDLE_CARRY) decides
+// the same however the input is split: the recordings in a directory and
+// generated signals are fed in frames of each of FRAME_SIZES samples, and
+// the tone events and stage counters must be exactly those of a detector
+// staging the whole signal with DTMF_BACKEND_FLOAT, and the digits of a
+// DtmfStreamDetector the same for every frame size.
+//
+// usage: test-carry TEST_DATA_DIRECTORY
+//
+
+#include <algorithm>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include <stdint.h>
+
+#include "DtmfDetector.hpp"
+#include "test-signals.hpp"
+
+const int FRAME_SIZES[] = {37, 80, 160, 240};
+
+// A detector that keeps every tone event.
+class EventCollector : public DtmfDetectorBase {
+public:
+  explicit EventCollector(DtmfStraddleMode straddle_mode)
+      : DtmfDetectorBase(straddle_mode, DTMF_BACKEND_FLOAT) {}
+
+  std::vector<DtmfToneEvent> events;
+
+private:
+  void OnToneEvent(const DtmfToneEvent &event) override {
+    events.push_back(event);
+  }
+};
+
+static bool same_events(const std::vector<DtmfToneEvent> &a,
+                        const std::vector<DtmfToneEvent> &b) {
+  if (a.size() != b.size())
+    return false;
+  for (size_t ii = 0; ii < a.size(); ++ii) {
+    if (a[ii].dial_char != b[ii].dial_char ||
+        a[ii].start_sample != b[ii].start_sample ||
+        a[ii].end_sample != b[ii].end_sample ||
+        a[ii].peak_row_energy != b[ii].peak_row_energy ||
+        a[ii].peak_column_energy != b[ii].peak_column_energy)
+      return false;
+  }
+  return true;
+}
+
+static bool same_counters(const DtmfStageCounters &a,
+                          const DtmfStageCounters &b) {
+  return a.batches == b.batches && a.silent == b.silent &&
+         a.dial_tones_rejected == b.dial_tones_rejected &&
+         a.harmonics_rejected == b.harmonics_rejected &&
+         a.detected == b.detected;
+}
+
+// The digits of the events.
+static std::string digits_of(const std::vector<DtmfToneEvent> &events) {
+  std::string digits;
+  for (const DtmfToneEvent &event : events)
+    digits += event.dial_char;
+  return digits;
+}
+
+int main(int argc, char **argv) {
+  if (argc != 2) {
+    fprintf(stderr, "usage: %s TEST_DATA_DIRECTORY\n", argv[0]);
+    return 2;
+  }
+
+  std::vector<Signal> signals;
+  if (!make_signals(argv[1], &signals))
+    return 1;
+
+  bool passed = true;
+  size_t events = 0;
+  for (const Signal &signal : signals) {
+    const int length = static_cast<int>(signal.samples.size());
+    EventCollector staged(DTMF_STRADDLE_STAGE);
+    staged.Detect(signal.samples.data(), length);
+    staged.Flush();
+    events += staged.events.size();
+    const std::string digits = digits_of(staged.events);
+
+    for (int frame_size : FRAME_SIZES) {
+      EventCollector carried(DTMF_STRADDLE_CARRY);
+      char storage[256];
+      DtmfStreamDetector<> stream(storage, sizeof(storage));
+      for (int ii = 0; ii < length; ii += frame_size) {
+        int count = std::min(frame_size, length - ii);
+        carried.Detect(&signal.samples[ii], count);
+        stream.Detect(&signal.samples[ii], count);
+      }
+      carried.Flush();
+      stream.Flush();
+
+      std::string found(stream.Digits().data(), stream.Digits().size());
+      if (!same_events(carried.events, staged.events) ||
+          !same_counters(carried.GetStageCounters(),
+                         staged.GetStageCounters()) ||
+          found != digits) {
+        fprintf(stderr,
+                "%s in frames of %d: \"%s\" carried, \"%s\" streamed, "
+                "\"%s\" staged\n",
+                signal.name.c_str(), frame_size,
+                digits_of(carried.events).c_str(), found.c_str(),
+                digits.c_str());
+        passed = false;
+      }
+    }
+  }
+  printf("%zu signals, %zu tones, in frames of", signals.size(), events);
+  for (int frame_size : FRAME_SIZES)
+    printf(" %d", frame_size);
+  printf(" samples: %s\n", passed ? "the same" : "different");
+  return passed ? 0 : 1;
+}
@@ -0,0 +1,316 @@
+//
+// Checks that the division-free decision, DTMF_check_dial_tones and
+// DTMF_check_harmonics, decides exactly as the decision it replaced, which
+// divided: the same tone or none, the same max row and max column, and the
+// same rejecting check.  The magnitudes are those of every batch of the
+// recordings in a directory and of generated signals, at several offsets,
+// and random ones that sit on the edge of every ratio, some of them zero or
+// wrapped around to negative.  DTMF_check_dial_tones_lanes is checked
+// against the first stage of the reference on the random ones.
+//
+// usage: test-decision TEST_DATA_DIRECTORY
+//
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include <stdint.h>
+
+#include "DtmfDetection.hpp"
+#include "DtmfDetector.hpp"
+#include "Goertzel.hpp"
+#include "test-signals.hpp"
+
+// The thresholds of DTMF_PROFILE_DEFAULT, as the reference decision had them.
+const int32_t DIAL_TONE_RATIO = 6;
+const int32_t HARMONIC_RATIO = 16;
+
+// The batches are decided at every OFFSET_STEP samples.
+const int OFFSET_STEP = DTMF_DETECTION_BATCH_SIZE / 6;
+
+const int RANDOM_VECTOR_COUNT = 1000000;
+
+// No check rejected the batch.
+const DtmfRejectReason PASSED = DTMF_REJECT_REASON_COUNT;
+
+// What a decision made of a set of magnitudes.
+struct Outcome {
+  bool dial_tones_passed;
+  int32_t row, column;
+  char dial_char;
+  DtmfRejectReason reason;
+
+  bool operator==(const Outcome &other) const {
+    return dial_tones_passed == other.dial_tones_passed &&
+           (!dial_tones_passed ||
+            (row == other.row && column == other.column)) &&
+           dial_char == other.dial_char && reason == other.reason;
+  }
+};
+
+//-----------------------------------------------------------------
+// The reference: the decision as it was before it stopped dividing.
+
+static bool reference_other_dial_tone(const int32_t T[], int32_t Row,
+                                      int32_t Column, int32_t Other) {
+  if (Other != T[Column] && Other != T[Row]) {
+    if (T[Row] / Other < DIAL_TONE_RATIO)
+      return false;
+    // Column == 4 corresponds to 1176Hz.
+    if (T[Column] / Other <
+        (Column != 4 ? DIAL_TONE_RATIO : DIAL_TONE_RATIO / 3))
+      return false;
+  }
+  return true;
+}
+
+static bool reference_dial_tones(const int32_t T[], int32_t *pRow,
+                                 int32_t *pColumn, DtmfRejectReason *Reason) {
+  int32_t Row = 0, Temp = 0;
+  for (int ii = 0; ii < 4; ii++) {
+    if (Temp < T[ii]) {
+      Row = ii;
+      Temp = T[ii];
+    }
+  }
+  int32_t Column = 4;
+  Temp = 0;
+  for (int ii = 4; ii < 8; ii++) {
+    if (Temp < T[ii]) {
+      Column = ii;
+      Temp = T[ii];
+    }
+  }
+
+  if (T[Row] < DIAL_TONE_RATIO || T[Column] < DIAL_TONE_RATIO) {
+    *Reason = DTMF_REJECT_WEAK;
+    return false;
+  }
+  if (T[Row] < (T[Column] >> 2)) {
+    *Reason = DTMF_REJECT_TWIST;
+    return false;
+  }
+  if (T[Column] < ((T[Row] >> 1) - (T[Row] >> 3))) {
+    *Reason = DTMF_REJECT_REVERSE_TWIST;
+    return false;
+  }
+  for (int ii = 0; ii < 8; ii++) {
+    if (!reference_other_dial_tone(T, Row, Column, T[ii] ? T[ii] : 1)) {
+      *Reason = DTMF_REJECT_OTHER_DIAL_TONE;
+      return false;
+    }
+  }
+  *pRow = Row, *pColumn = Column;
+  return true;
+}
+
+static char reference_harmonics(const int32_t Magnitudes[], int32_t Row,
+                                int32_t Column, DtmfRejectReason *Reason) {
+  int32_t T[COEFF_NUMBER];
+  std::copy(Magnitudes, Magnitudes + COEFF_NUMBER, T);
+
+  int32_t Sum = 0;
+  for (int ii = 0; ii < 10; ii++)
+    Sum += T[ii];
+  Sum -= T[Row];
+  Sum -= T[Column];
+  Sum >>= 3;
+  if (!Sum)
+    Sum = 1;
+  if (T[Row] / Sum < DIAL_TONE_RATIO || T[Column] / Sum < DIAL_TONE_RATIO) {
+    *Reason = DTMF_REJECT_DIAL_TONE_RATIO;
+    return ' ';
+  }
+
+  for (unsigned ii = 0; ii < COEFF_NUMBER; ii++)
+    if (T[ii] == 0)
+      T[ii] = 1;
+  for (unsigned ii = 10; ii < COEFF_NUMBER; ii++) {
+    if (T[Row] / T[ii] < HARMONIC_RATIO || T[Column] / T[ii] < HARMONIC_RATIO) {
+      *Reason = DTMF_REJECT_HARMONIC;
+      return ' ';
+    }
+  }
+  for (int ii = 8; ii < 10; ii++) {
+    if (!reference_other_dial_tone(T, Row, Column, T[ii])) {
+      *Reason = DTMF_REJECT_OTHER_DIAL_TONE;
+      return ' ';
+    }
+  }
+
+  // The push buttons, row by row.
+  return "123A456B789C*0#D"[Row * 4 + Column - 4];
+}
+
+//-----------------------------------------------------------------
+
+static Outcome reference_decide(const int32_t T[]) {
+  Outcome outcome = {false, 0, 0, ' ', PASSED};
+  outcome.dial_tones_passed =
+      reference_dial_tones(T, &outcome.row, &outcome.column, &outcome.reason);
+  if (outcome.dial_tones_passed)
+    outcome.dial_char =
+        reference_harmonics(T, outcome.row, outcome.column, &outcome.reason);
+  return outcome;
+}
+
+static Outcome library_decide(const int32_t T[]) {
+  Outcome outcome = {false, 0, 0, ' ', PASSED};
+  outcome.dial_tones_passed = DTMF_check_dial_tones(
+      T, &outcome.row, &outcome.column, &outcome.reason);
+  if (outcome.dial_tones_passed)
+    outcome.dial_char = DTMF_check_harmonics(T, outcome.row, outcome.column,
+                                             &outcome.reason);
+  return outcome;
+}
+
+// Counts what the decisions of a set of vectors came to.
+struct Tally {
+  size_t decided = 0, different = 0, detected = 0;
+  size_t rejected[DTMF_REJECT_REASON_COUNT] = {};
+
+  // Decides T both ways; false if they differ.
+  bool Decide(const int32_t T[]) {
+    Outcome expected = reference_decide(T);
+    Outcome found = library_decide(T);
+    ++decided;
+    if (expected.reason == PASSED)
+      ++detected;
+    else
+      ++rejected[expected.reason];
+    if (found == expected)
+      return true;
+    ++different;
+    return false;
+  }
+
+  void Print(const char *what) const {
+    printf("%s: %zu decided, %zu detected, rejected", what, decided,
+           detected);
+    for (int ii = 0; ii < DTMF_REJECT_REASON_COUNT; ++ii)
+      printf(" %zu", rejected[ii]);
+    printf(", %zu different\n", different);
+  }
+};
+
+// The magnitudes of the batch at samples, as the staged fixed-point
+// detector computes them at 8 kHz, or false if the batch is silent.
+static bool batch_magnitudes(const int16_t *samples, int32_t T[]) {
+  int32_t AbsSum, Peak;
+  DTMF_batch_magnitudes(samples, DTMF_DETECTION_BATCH_SIZE, &AbsSum, &Peak);
+  if (AbsSum / DTMF_DETECTION_BATCH_SIZE < powerThreshold)
+    return false;
+  int32_t Dial = DTMF_normalization_shift(AbsSum, Peak);
+  int16_t normalized[DTMF_DETECTION_BATCH_SIZE];
+  for (int ii = 0; ii < DTMF_DETECTION_BATCH_SIZE; ++ii)
+    normalized[ii] = static_cast<int16_t>(samples[ii] * (1 << Dial));
+  goertzel_filter_bank(CONSTANTS, COEFF_NUMBER, normalized,
+                       DTMF_DETECTION_BATCH_SIZE, T);
+  return true;
+}
+
+// Magnitudes around those of a tone: a max row and a max column at a random
+// level and twist, and the other bins near the ratios they are checked
+// against, some of them tied with the max, zero, or negative.
+static void random_magnitudes(Random &random, int32_t T[]) {
+  const int32_t level = static_cast<int32_t>(
+      std::pow(2.0, 3 + 25 * (random.Next() + 1) / 2));
+  const int row = static_cast<int>(4 * (random.Next() + 1) / 2);
+  const int column = 4 + static_cast<int>(4 * (random.Next() + 1) / 2);
+  for (unsigned kk = 0; kk < COEFF_NUMBER; ++kk) {
+    double ratio = kk < 10 ? (kk < 8 ? DIAL_TONE_RATIO : 8 * DIAL_TONE_RATIO)
+                           : HARMONIC_RATIO;
+    double pick = random.Next();
+    if (pick < -0.9)
+      T[kk] = 0;
+    else if (pick < -0.8)
+      T[kk] = -static_cast<int32_t>(level * (random.Next() + 1));
+    else if (pick < -0.75)
+      T[kk] = level;
+    else
+      T[kk] = static_cast<int32_t>(level / ratio * (1 + 0.2 * random.Next()) /
+                                   1.15);
+  }
+  T[row] = level;
+  T[column] =
+      static_cast<int32_t>(level * std::pow(4.0, 1.2 * random.Next()));
+  if (random.Next() < -0.9)
+    T[column] = level;
+}
+
+int main(int argc, char **argv) {
+  if (argc != 2) {
+    fprintf(stderr, "usage: %s TEST_DATA_DIRECTORY\n", argv[0]);
+    return 2;
+  }
+
+  std::vector<Signal> signals;
+  if (!make_signals(argv[1], &signals))
+    return 1;
+
+  bool passed = true;
+  Tally batches;
+  for (const Signal &signal : signals) {
+    size_t different = batches.different;
+    for (size_t ii = 0;
+         ii + DTMF_DETECTION_BATCH_SIZE <= signal.samples.size();
+         ii += OFFSET_STEP) {
+      int32_t T[COEFF_NUMBER];
+      if (batch_magnitudes(&signal.samples[ii], T))
+        batches.Decide(T);
+    }
+    if (batches.different != different) {
+      fprintf(stderr, "%s: %zu batches decided differently\n",
+              signal.name.c_str(), batches.different - different);
+      passed = false;
+    }
+  }
+  batches.Print("batches");
+
+  // The random vectors, 13 at a time through the lanes as well.
+  const uint32_t LANES = 16, COUNT = 13;
+  Random random(1);
+  Tally vectors;
+  size_t lanes_different = 0;
+  for (int nn = 0; nn < RANDOM_VECTOR_COUNT; nn += COUNT) {
+    int32_t T[COUNT][COEFF_NUMBER];
+    int32_t Magnitudes[DTMF_FREQUENCY_NUMBER * LANES] = {};
+    for (uint32_t jj = 0; jj < COUNT; ++jj) {
+      random_magnitudes(random, T[jj]);
+      vectors.Decide(T[jj]);
+      for (unsigned kk = 0; kk < DTMF_FREQUENCY_NUMBER; ++kk)
+        Magnitudes[kk * LANES + jj] = T[jj][kk];
+    }
+
+    int32_t Row[LANES], Column[LANES];
+    bool Passed[LANES];
+    DTMF_check_dial_tones_lanes(Magnitudes, LANES, COUNT, Row, Column, Passed);
+    for (uint32_t jj = 0; jj < COUNT; ++jj) {
+      Outcome expected = reference_decide(T[jj]);
+      lanes_different +=
+          Passed[jj] != expected.dial_tones_passed ||
+          (Passed[jj] &&
+           (Row[jj] != expected.row || Column[jj] != expected.column));
+    }
+  }
+  vectors.Print("random magnitudes");
+  printf("random magnitudes: %zu different in lanes\n", lanes_different);
+  if (vectors.different != 0 || lanes_different != 0) {
+    fprintf(stderr, "random magnitudes decided differently\n");
+    passed = false;
+  }
+
+  // Every check must have been put to the test by the random vectors.
+  for (int ii = 0; ii < DTMF_REJECT_REASON_COUNT; ++ii) {
+    if (vectors.rejected[ii] == 0) {
+      fprintf(stderr, "no random magnitudes rejected for reason %d\n", ii);
+      passed = false;
+    }
+  }
+  if (vectors.detected == 0) {
+    fprintf(stderr, "no random magnitudes detected\n");
+    passed = false;
+  }
+  return passed ? 0 : 1;
+}
@@ -0,0 +1,140 @@
+//
+// The signals the tests decide: the recordings in a directory, and generated
+// speech and digits.
+//
+
+#ifndef TEST_SIGNALS
+#define TEST_SIGNALS
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+#include <stdint.h>
+
+#include "AudioFile.hpp"
+#include "DtmfDetector.hpp"
+
+// A signal, and whether it is made to sit on the edge of the thresholds.
+struct Signal {
+  std::string name;
+  std::vector<int16_t> samples;
+  bool edge;
+};
+
+// A small linear congruential generator, so that the signals are the same on
+// every platform.
+struct Random {
+  uint32_t state;
+
+  explicit Random(uint32_t seed) : state(seed) {}
+
+  // Uniform in [-1, 1).
+  double Next() {
+    state = state * 1664525u + 1013904223u;
+    return static_cast<int32_t>(state) / 2147483648.0;
+  }
+};
+
+// The first channel of an 8 kHz recording, or nothing if it is not one.
+inline std::vector<int16_t> read_recording(const std::string &path) {
+  std::vector<int16_t> samples;
+  AudioFile file;
+  if (!file.Open(path.c_str()) ||
+      file.format().sample_rate != DTMF_BASE_SAMPLE_RATE)
+    return samples;
+  const uint8_t *data;
+  while (size_t frames = file.Next(4096, &data)) {
+    size_t done = samples.size();
+    samples.resize(done + frames);
+    audio_to_linear(file.format(), data, frames, 0, &samples[done]);
+  }
+  return samples;
+}
+
+inline int16_t clip(double sample) {
+  return static_cast<int16_t>(
+      std::max(-32768.0, std::min(32767.0, std::round(sample))));
+}
+
+// 25 random digits, each at a random level, twist and frequency offset (up
+// to 2.5%), for 12 to 112 ms, with random gaps of 6 to 81 ms, all in white
+// noise: many batches end up on the edge of a threshold.
+inline std::vector<int16_t> make_digits(uint32_t seed) {
+  const double ROWS[] = {697, 770, 852, 941};
+  const double COLUMNS[] = {1209, 1336, 1477, 1633};
+  Random random(seed);
+  double level = 200 * std::pow(10.0, 1.1 * (random.Next() + 1));
+  double noise = level * (random.Next() + 1) / 2 * (seed % 3 == 0 ? 1 : 0.2);
+  std::vector<int16_t> signal;
+  double phase = 0;
+  for (int digit = 0; digit < 25; ++digit) {
+    int row = static_cast<int>(4 * (random.Next() + 1) / 2);
+    int column = static_cast<int>(4 * (random.Next() + 1) / 2);
+    double twist = std::pow(10.0, 6 * random.Next() / 20);
+    double offset = 1 + 0.025 * random.Next();
+    int tone = 100 + static_cast<int>(450 * (random.Next() + 1));
+    int gap = 50 + static_cast<int>(300 * (random.Next() + 1));
+    for (int ii = 0; ii < tone; ++ii, ++phase)
+      signal.push_back(clip(
+          level * std::sin(2 * M_PI * ROWS[row] * offset * phase / 8000) +
+          level * twist *
+              std::sin(2 * M_PI * COLUMNS[column] * offset * phase / 8000 +
+                       1) +
+          noise * random.Next()));
+    for (int ii = 0; ii < gap; ++ii)
+      signal.push_back(clip(noise * random.Next()));
+  }
+  return signal;
+}
+
+// A voice-like harmonic signal whose pitch changes every 100 ms, with a
+// syllable envelope.
+inline std::vector<int16_t> make_speech_like(uint32_t seed) {
+  Random random(seed);
+  double level = 500 + 4000 * (random.Next() + 1);
+  std::vector<int16_t> signal(80000);
+  double pitch = 0;
+  for (size_t ii = 0; ii < signal.size(); ++ii) {
+    if (ii % 800 == 0)
+      pitch = 180 + 100 * random.Next();
+    double sample = 0;
+    for (int harmonic = 1; harmonic < 20; ++harmonic)
+      sample += std::sin(2 * M_PI * pitch * harmonic * ii / 8000 + harmonic) /
+                harmonic;
+    double envelope = 0.5 + 0.5 * std::sin(2 * M_PI * 3 * ii / 8000.0);
+    signal[ii] = clip(level * envelope * sample);
+  }
+  return signal;
+}
+
+// The 8 kHz recordings in directory, in name order, then 20 speech-like
+// signals and 60 strings of edge digits.  False if there are no recordings.
+inline bool make_signals(const char *directory, std::vector<Signal> *signals) {
+  std::vector<std::string> paths;
+  for (const auto &entry : std::filesystem::directory_iterator(directory))
+    paths.push_back(entry.path().string());
+  std::sort(paths.begin(), paths.end());
+  for (const std::string &path : paths) {
+    std::vector<int16_t> samples = read_recording(path);
+    if (!samples.empty())
+      signals->push_back(Signal{path, samples, false});
+  }
+  if (signals->empty()) {
+    fprintf(stderr, "%s: no 8 kHz recordings\n", directory);
+    return false;
+  }
+
+  for (uint32_t seed = 1; seed <= 20; ++seed)
+    signals->push_back(Signal{"speech-like " + std::to_string(seed),
+                              make_speech_like(seed), false});
+  for (uint32_t seed = 1; seed <= 60; ++seed)
+    signals->push_back(
+        Signal{"digits " + std::to_string(seed), make_digits(seed), true});
+  return true;
+}
+
+#endif
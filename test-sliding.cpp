@@ -0,0 +1,120 @@
+//
+// Compares the decision of every window of a sliding detector with that of a
+// detector staging the same samples as a batch with DTMF_BACKEND_FLOAT, for
+// each hop in HOP_SIZES, over the recordings in a directory and generated
+// signals, and checks that they differ no more than documented: not at all
+// on the recordings and on speech, and on digits made to sit on the edge of
+// the thresholds, in at most one window in MAX_EDGE_WINDOWS_PER.
+//
+// usage: test-sliding TEST_DATA_DIRECTORY
+//
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include <stdint.h>
+
+#include "DtmfDetector.hpp"
+#include "test-signals.hpp"
+
+const int HOP_SIZES[] = {51, 34};
+
+const int MAX_EDGE_WINDOWS_PER = 500;
+
+// What the decision of a window came to, from the stage counters before and
+// after it.
+enum Outcome { SILENT, DIAL_TONES_REJECTED, HARMONICS_REJECTED, DETECTED };
+
+static Outcome outcome(const DtmfStageCounters &before,
+                       const DtmfStageCounters &after) {
+  if (after.silent != before.silent)
+    return SILENT;
+  if (after.dial_tones_rejected != before.dial_tones_rejected)
+    return DIAL_TONES_REJECTED;
+  if (after.harmonics_rejected != before.harmonics_rejected)
+    return HARMONICS_REJECTED;
+  return DETECTED;
+}
+
+// The outcome of every window of signal, one every hop_size samples.
+static std::vector<Outcome> slide(const std::vector<int16_t> &signal,
+                                  int hop_size) {
+  DtmfRateDetector<> detector(hop_size);
+  std::vector<Outcome> windows;
+  for (size_t ii = 0; ii + hop_size <= signal.size(); ii += hop_size) {
+    DtmfStageCounters before = detector.GetStageCounters();
+    detector.Detect(&signal[ii], hop_size);
+    if (detector.GetStageCounters().batches != before.batches)
+      windows.push_back(outcome(before, detector.GetStageCounters()));
+  }
+  return windows;
+}
+
+// The same windows, each staged as a batch by a detector fed from its
+// offset in the first hops.
+static std::vector<Outcome> stage(const std::vector<int16_t> &signal,
+                                  int hop_size) {
+  const int batch_size = DTMF_DETECTION_BATCH_SIZE;
+  std::vector<Outcome> windows;
+  if (signal.size() < static_cast<size_t>(batch_size))
+    return windows;
+  windows.resize((signal.size() - batch_size) / hop_size + 1);
+  for (int offset = 0; offset < batch_size; offset += hop_size) {
+    DtmfRateDetector<DTMF_BASE_SAMPLE_RATE, DTMF_BACKEND_FLOAT> detector;
+    for (size_t ii = offset; ii + batch_size <= signal.size();
+         ii += batch_size) {
+      DtmfStageCounters before = detector.GetStageCounters();
+      detector.Detect(&signal[ii], batch_size);
+      windows[ii / hop_size] = outcome(before, detector.GetStageCounters());
+    }
+  }
+  return windows;
+}
+
+int main(int argc, char **argv) {
+  if (argc != 2) {
+    fprintf(stderr, "usage: %s TEST_DATA_DIRECTORY\n", argv[0]);
+    return 2;
+  }
+
+  std::vector<Signal> signals;
+  if (!make_signals(argv[1], &signals))
+    return 1;
+
+  bool passed = true;
+  for (int hop_size : HOP_SIZES) {
+    size_t windows = 0, edge_windows = 0, different = 0;
+    for (const Signal &signal : signals) {
+      std::vector<Outcome> slid = slide(signal.samples, hop_size);
+      std::vector<Outcome> staged = stage(signal.samples, hop_size);
+      if (slid.size() != staged.size()) {
+        fprintf(stderr, "%s, hop %d: %zu windows slid, %zu staged\n",
+                signal.name.c_str(), hop_size, slid.size(), staged.size());
+        passed = false;
+        continue;
+      }
+
+      size_t signal_different = 0;
+      for (size_t ww = 0; ww < slid.size(); ++ww)
+        signal_different += slid[ww] != staged[ww];
+      windows += slid.size();
+      different += signal_different;
+      if (signal.edge) {
+        edge_windows += slid.size();
+      } else if (signal_different != 0) {
+        fprintf(stderr, "%s, hop %d: %zu windows decided differently\n",
+                signal.name.c_str(), hop_size, signal_different);
+        passed = false;
+      }
+    }
+    printf("hop %d: %zu windows, %zu decided differently\n", hop_size,
+           windows, different);
+    if (different * MAX_EDGE_WINDOWS_PER > edge_windows) {
+      fprintf(stderr, "hop %d: more than one edge window in %d different\n",
+              hop_size, MAX_EDGE_WINDOWS_PER);
+      passed = false;
+    }
+  }
+  return passed ? 0 : 1;
+}